@@ -16,19 +16,65 @@ echo "Building the project in Linux environment"
 : ${USE_SEMIHOSTING:="OFF"}
 # Enable st-term
 : ${USE_STTERM:="OFF"}
+# Enable the non-blocking ring console in RAM instead of st-term
+: ${USE_STTERM_RING:="OFF"}
 # Enable debug UART
 : ${USE_DBGUART:="ON"}
+# Send and receive on the debug UART with DMA
+: ${USE_DBGUART_DMA:="OFF"}
+# Baud rate of the debug UART
+: ${DBGUART_BAUDRATE:="115200"}
 # Enable GDB build
 : ${USE_GDB:="OFF"}
 # Enable overclock?
 : ${USE_OVERCLOCKING:="OFF"}
 # Enable FPU Acceleration for DSP
 : ${USE_FPU:="OFF"}
+# Process two channels (ADC1/ADC2 to DAC1 channel 1/2)
+: ${USE_STEREO:="OFF"}
+# Use the build time coefficients of source/src/inc/filter_chain_fixed.h
+: ${USE_FIXED_CHAIN:="OFF"}
+# Print the filter benchmark CSV on boot
+: ${USE_FILTER_BENCH:="OFF"}
+# Convolve with the IR of source/src/inc/fft_conv_ir.h (needs USE_FPU)
+: ${USE_FFT_CONV:="OFF"}
+# Number of samples processed per DMA half-transfer
+: ${DSP_BLOCK_SIZE:="32"}
+# Fixed-point biquad precision when USE_FPU=OFF (FAST_Q15, Q31, Q31_64)
+: ${DSP_Q_FORMAT:="Q31"}
+# ADC oversampling factor, decimated to the sample rate (1 to disable)
+: ${DSP_OVERSAMPLING:="1"}
+# Interpolate the output and run the DAC at the oversampled rate too
+: ${USE_OVERSAMPLED_DAC:="OFF"}
+# Send the spectrum of the output on the debug UART
+: ${USE_SPECTRUM:="OFF"}
+# Period of the spectrum frames in ms
+: ${SPECTRUM_PUBLISH_MS:="250"}
+# Measure RMS, peak, DC and clipping of the input and the output
+: ${USE_SIGNAL_STATS:="OFF"}
+# Track the DC offset of the ADC instead of subtracting the mid-scale
+: ${USE_DC_TRACKER:="OFF"}
+# Profile the cycles of the interrupt sections, dumped on the debug UART
+: ${USE_PROFILER:="OFF"}
+# Monitor the CPU load, the late blocks and the ADC overruns
+: ${USE_LOAD_MONITOR:="OFF"}
+# Alternate ADC1 and ADC2 on the input to double the maximum ADC rate (PA0 and PA6 wired together)
+: ${USE_ADC_INTERLEAVED:="OFF"}
+# ADC1 channels converted on every trigger, the first is the input (1 to disable)
+: ${ADC_SCAN_CHANNELS:="1"}
+# Edit the filter chain with binary commands on the debug UART
+: ${USE_CHAIN_CMD:="OFF"}
+# Stream the ADC input and the DAC output samples on the debug UART
+: ${USE_CAPTURE:="OFF"}
+# Keep every Nth sample of the capture (1 for the full rate)
+: ${CAPTURE_DECIMATION:="4"}
+# Send TRACE() as binary records on the debug UART, formatted by the host
+: ${USE_TRACE_LOG:="OFF"}
 # Select source folder. Give a false one to trigger an error
 : ${SRC:="src"}
 
-# Set default arch to stm32
-ARCHITECTURE=stm32
+# Select the architecture (stm32 for the firmware, host for the x86-64 Linux build)
+: ${ARCHITECTURE:="stm32"}
 # default generator
 IDE_GENERATOR="Unix Makefiles"
 # Current working directory
@@ -56,12 +102,52 @@ if [ "${ARCHITECTURE}" == "stm32" ]; then
                 -DUSE_STDPERIPH_DRIVER=${USE_STDPERIPH_DRIVER} \
                 -DUSE_SEMIHOSTING=${USE_SEMIHOSTING} \
                 -DUSE_STTERM=${USE_STTERM} \
+                -DUSE_STTERM_RING=${USE_STTERM_RING} \
                 -DUSE_DBGUART=${USE_DBGUART} \
+                -DUSE_DBGUART_DMA=${USE_DBGUART_DMA} \
+                -DDBGUART_BAUDRATE=${DBGUART_BAUDRATE} \
                 -DUSE_GDB=${USE_GDB} \
                 -DUSE_OVERCLOCKING=${USE_OVERCLOCKING} \
                 -DUSE_FPU=${USE_FPU} \
+                -DUSE_STEREO=${USE_STEREO} \
+                -DUSE_FIXED_CHAIN=${USE_FIXED_CHAIN} \
+                -DUSE_FILTER_BENCH=${USE_FILTER_BENCH} \
+                -DUSE_FFT_CONV=${USE_FFT_CONV} \
+                -DDSP_BLOCK_SIZE=${DSP_BLOCK_SIZE} \
+                -DDSP_Q_FORMAT=${DSP_Q_FORMAT} \
+                -DDSP_OVERSAMPLING=${DSP_OVERSAMPLING} \
+                -DUSE_OVERSAMPLED_DAC=${USE_OVERSAMPLED_DAC} \
+                -DUSE_SPECTRUM=${USE_SPECTRUM} \
+                -DSPECTRUM_PUBLISH_MS=${SPECTRUM_PUBLISH_MS} \
+                -DUSE_SIGNAL_STATS=${USE_SIGNAL_STATS} \
+                -DUSE_DC_TRACKER=${USE_DC_TRACKER} \
+                -DUSE_PROFILER=${USE_PROFILER} \
+                -DUSE_LOAD_MONITOR=${USE_LOAD_MONITOR} \
+                -DUSE_ADC_INTERLEAVED=${USE_ADC_INTERLEAVED} \
+                -DADC_SCAN_CHANNELS=${ADC_SCAN_CHANNELS} \
+                -DUSE_CHAIN_CMD=${USE_CHAIN_CMD} \
+                -DUSE_CAPTURE=${USE_CAPTURE} \
+                -DCAPTURE_DECIMATION=${CAPTURE_DECIMATION} \
+                -DUSE_TRACE_LOG=${USE_TRACE_LOG} \
                 -DSRC=${SRC} \
                 "
+elif [ "${ARCHITECTURE}" == "host" ]; then
+    CMAKE_FLAGS="${CMAKE_FLAGS} \
+                -DUSE_FPU=${USE_FPU} \
+                -DUSE_STEREO=${USE_STEREO} \
+                -DUSE_FIXED_CHAIN=${USE_FIXED_CHAIN} \
+                -DUSE_FFT_CONV=${USE_FFT_CONV} \
+                -DDSP_BLOCK_SIZE=${DSP_BLOCK_SIZE} \
+                -DDSP_Q_FORMAT=${DSP_Q_FORMAT} \
+                -DDSP_OVERSAMPLING=${DSP_OVERSAMPLING} \
+                -DUSE_OVERSAMPLED_DAC=${USE_OVERSAMPLED_DAC} \
+                -DUSE_SPECTRUM=${USE_SPECTRUM} \
+                -DSPECTRUM_PUBLISH_MS=${SPECTRUM_PUBLISH_MS} \
+                -DUSE_SIGNAL_STATS=${USE_SIGNAL_STATS} \
+                -DUSE_DC_TRACKER=${USE_DC_TRACKER} \
+                -DUSE_PROFILER=${USE_PROFILER} \
+                -DUSE_LOAD_MONITOR=${USE_LOAD_MONITOR} \
+                "
 else
     >&2 echo "*** Error: Architecture '${ARCHITECTURE}' unknown."
     exit 1
@@ -82,11 +168,33 @@ echo "IDE generator     : ${IDE_GENERATOR}"
 echo "Threads           : ${PARALLEL}"
 echo "Semihosting       : ${USE_SEMIHOSTING}"
 echo "st-term           : ${USE_STTERM}"
+echo "Ring console      : ${USE_STTERM_RING}"
 echo "Debug UART        : ${USE_DBGUART}"
+echo "Debug UART DMA    : ${USE_DBGUART_DMA}"
+echo "Debug UART baud   : ${DBGUART_BAUDRATE}"
 echo "Use FPU for DSP   : ${USE_FPU}"
+echo "Stereo            : ${USE_STEREO}"
+echo "Fixed chain       : ${USE_FIXED_CHAIN}"
+echo "Filter bench      : ${USE_FILTER_BENCH}"
+echo "FFT convolution   : ${USE_FFT_CONV}"
+echo "DSP block size    : ${DSP_BLOCK_SIZE}"
+echo "DSP Q format      : ${DSP_Q_FORMAT}"
+echo "Oversampling      : ${DSP_OVERSAMPLING}"
+echo "Oversampled DAC   : ${USE_OVERSAMPLED_DAC}"
+echo "Spectrum          : ${USE_SPECTRUM}"
+echo "Signal stats      : ${USE_SIGNAL_STATS}"
+echo "DC tracker        : ${USE_DC_TRACKER}"
+echo "Profiler          : ${USE_PROFILER}"
+echo "Load monitor      : ${USE_LOAD_MONITOR}"
+echo "Interleaved ADC   : ${USE_ADC_INTERLEAVED}"
+echo "ADC scan channels : ${ADC_SCAN_CHANNELS}"
+echo "Chain commands    : ${USE_CHAIN_CMD}"
+echo "Capture           : ${USE_CAPTURE}"
+echo "Capture decimation: ${CAPTURE_DECIMATION}"
+echo "Trace log         : ${USE_TRACE_LOG}"
 
-mkdir -p build-stm32
-cd build-stm32
+mkdir -p ${BUILD_ARCH_DIR}
+cd ${BUILD_ARCH_DIR}
 
 # setup cmake
 cmake ../source -G"${IDE_GENERATOR}" ${CMAKE_FLAGS}
@@ -29,6 +29,14 @@ file(GLOB DSP_LIB_SRC
     ${DSP_LIB_DIR}/TransformFunctions/*.c
 )
 
+# The bit reversal of arm_cfft_f32/q31 is only in assembly. The host
+# profile has a C version of it in host/arm_bitreversal2.c.
+if (CMAKE_CROSSCOMPILING)
+    set(DSP_LIB_SRC ${DSP_LIB_SRC} ${DSP_LIB_DIR}/TransformFunctions/arm_bitreversal2.S)
+else()
+    set(DSP_LIB_SRC ${DSP_LIB_SRC} ${CMAKE_SOURCE_DIR}/host/arm_bitreversal2.c)
+endif()
+
 set(DSP_LIB_COMPILE_FLAGS "${STM32_DEFINES} -D__FPU_PRESENT=1")
 
 set_source_files_properties(${DSP_LIB_SRC}
@@ -0,0 +1,38 @@
+# Build time coefficients of the fixed filter chain in
+# src/inc/filter_chain_fixed.h. The generator runs on the build machine, so
+# it's always built with the native compiler, also when the firmware is
+# cross compiled. Include this from the directory of the target that uses
+# the generated header and add ${FILTER_COEFFS_HEADER} to its sources.
+
+if (CMAKE_CROSSCOMPILING)
+    find_program(HOST_C_COMPILER NAMES cc gcc)
+    if (NOT HOST_C_COMPILER)
+        message(FATAL_ERROR "USE_FIXED_CHAIN needs a native C compiler for the coefficient generator")
+    endif()
+else()
+    set(HOST_C_COMPILER ${CMAKE_C_COMPILER})
+endif()
+
+set(FILTER_COEFFS_DIR ${CMAKE_CURRENT_BINARY_DIR}/generated)
+set(FILTER_COEFFS_HEADER ${FILTER_COEFFS_DIR}/filter_chain_coeffs.h)
+set(FILTER_COEFFS_GEN ${FILTER_COEFFS_DIR}/coeffs_gen)
+
+add_custom_command(
+    OUTPUT ${FILTER_COEFFS_HEADER}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${FILTER_COEFFS_DIR}
+    COMMAND ${HOST_C_COMPILER} -std=gnu11 -O2 -DARM_MATH_CM0
+        -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast
+        -I${CMAKE_SOURCE_DIR}/host/inc -I${CMAKE_SOURCE_DIR}/src/inc -I${CMAKE_SOURCE_DIR}/libs/cmsis/core
+        -o ${FILTER_COEFFS_GEN}
+        ${CMAKE_SOURCE_DIR}/host/coeffs_gen.c ${CMAKE_SOURCE_DIR}/src/biquad_design.c -lm
+    COMMAND ${FILTER_COEFFS_GEN} ${FILTER_COEFFS_HEADER}
+    DEPENDS
+        ${CMAKE_SOURCE_DIR}/host/coeffs_gen.c
+        ${CMAKE_SOURCE_DIR}/src/biquad_design.c
+        ${CMAKE_SOURCE_DIR}/src/inc/biquad_design.h
+        ${CMAKE_SOURCE_DIR}/src/inc/filter_chain_fixed.h
+    COMMENT "Generating the fixed filter chain coefficients"
+    VERBATIM
+)
+
+include_directories(${FILTER_COEFFS_DIR})
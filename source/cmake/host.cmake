@@ -0,0 +1,53 @@
+# Host (x86-64 Linux) build profile. It builds the DSP libraries and the
+# filter chain with the native compiler, so the filters can be tested and
+# benchmarked without flashing a board. There is no hardware access in this
+# profile, the DMA ping-pong of the firmware is emulated in host/main.c.
+
+message(STATUS "Building the host profile...")
+
+# CMSIS-DSP has no x86 path, so use the generic C code of the Cortex-M0
+# family. host/inc/core_cm0.h replaces the core header.
+string(REPLACE "-DARM_MATH_CM4" "-DARM_MATH_CM0 -DUSE_HOST" STM32_DEFINES "${STM32_DEFINES}")
+
+if (NOT USE_FPU AND DSP_Q_FORMAT STREQUAL "Q31_64")
+    message(FATAL_ERROR "DSP_Q_FORMAT=Q31_64 has no generic C implementation in CMSIS-DSP")
+endif()
+
+include_directories(
+    ${CMAKE_SOURCE_DIR}/host/inc
+)
+
+include (cmake/dsp_lib.cmake)
+
+# The filters_lib is only needed for reference, so it's optional here
+if (EXISTS "${CMAKE_SOURCE_DIR}/libs/filters_lib")
+    include (cmake/filters_lib.cmake)
+else()
+    message(STATUS "filters_lib submodule not found, skipping filterslib")
+endif()
+
+set(CMAKE_BUILD_TYPE Release)
+
+# CMSIS-DSP type-puns the SIMD loads and arm_math.h casts pointers to
+# 32-bit integers in the circular buffer helpers
+SET(CMAKE_C_FLAGS "-g -O3 -ffast-math -fno-strict-aliasing -Wall -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -std=gnu11" CACHE INTERNAL "c compiler flags")
+SET(CMAKE_CXX_FLAGS "-g -O3 -ffast-math -Wall -std=c++11" CACHE INTERNAL "cxx compiler flags")
+
+message(STATUS "System Processor      : ${CMAKE_SYSTEM_PROCESSOR}")
+message(STATUS
+    "BUILD FLAGS:\n"
+    "   defines         : ${STM32_DEFINES}\n"
+    "   c flags         : ${CMAKE_C_FLAGS}\n"
+    "   CMSIS           : ${CMSIS_DIR}\n"
+    "   Use FPU for DSP : ${USE_FPU}\n"
+    "   DSP block size  : ${DSP_BLOCK_SIZE}\n"
+    "   DSP Q format    : ${DSP_Q_FORMAT}\n"
+    "   Oversampling    : ${DSP_OVERSAMPLING}\n"
+    "   Spectrum        : ${USE_SPECTRUM}\n"
+    "   Signal stats    : ${USE_SIGNAL_STATS}\n"
+    "   DC tracker      : ${USE_DC_TRACKER}\n"
+    "   Profiler        : ${USE_PROFILER}\n"
+    "   Load monitor    : ${USE_LOAD_MONITOR}\n"
+)
+
+add_subdirectory(host)
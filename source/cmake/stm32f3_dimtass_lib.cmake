@@ -23,9 +23,15 @@ set(STM32_DIMTASS_LIB_SRC
     ${STM32_DIMTASS_LIB_DIR}/src/syscalls.c
 )
 
+if (ADC_SCAN_CHANNELS GREATER 1)
+  set(STM32_DIMTASS_LIB_SRC ${STM32_DIMTASS_LIB_SRC} ${STM32_DIMTASS_LIB_DIR}/src/dev_adc.c)
+endif()
 if (USE_DBGUART)
   set(STM32_DIMTASS_LIB_SRC ${STM32_DIMTASS_LIB_SRC} ${STM32_DIMTASS_LIB_DIR}/src/syscalls.c)
 endif()
 if (USE_STTERM)
   set(STM32_DIMTASS_LIB_SRC ${STM32_DIMTASS_LIB_SRC} ${STM32_DIMTASS_LIB_DIR}/src/syscalls.c)
+endif()
+if (USE_TRACE_LOG)
+  set(STM32_DIMTASS_LIB_SRC ${STM32_DIMTASS_LIB_SRC} ${STM32_DIMTASS_LIB_DIR}/src/trace_log.c)
 endif()
\ No newline at end of file
@@ -0,0 +1,29 @@
+/*
+ * arm_bitreversal2.c
+ *
+ * Host replacement of CMSIS-DSP TransformFunctions/arm_bitreversal2.S,
+ * which is only in ARM assembly. arm_cfft_f32 (and so arm_rfft_fast_f32)
+ * uses it to swap the complex samples with the bit reversal table.
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdint.h>
+
+void arm_bitreversal_32(uint32_t * pSrc, const uint16_t bitRevLen,
+		const uint16_t * pBitRevTab)
+{
+	for (uint32_t i=0; i<bitRevLen; i+=2) {
+		/* the table has byte offsets of the real parts */
+		uint32_t a = pBitRevTab[i] >> 2;
+		uint32_t b = pBitRevTab[i + 1] >> 2;
+		uint32_t tmp;
+
+		tmp = pSrc[a];
+		pSrc[a] = pSrc[b];
+		pSrc[b] = tmp;
+
+		tmp = pSrc[a + 1];
+		pSrc[a + 1] = pSrc[b + 1];
+		pSrc[b + 1] = tmp;
+	}
+}
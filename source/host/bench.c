@@ -0,0 +1,23 @@
+/*
+ * bench.c
+ *
+ * Host runner of the filter benchmark. It prints the CSV of
+ * filter_bench_run() to stdout.
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-bench [repeats] > bench.csv
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdlib.h>
+#include "filter_bench.h"
+
+#define SAMPLE_RATE 96000
+
+int main(int argc, char ** argv)
+{
+	uint32_t repeats = (argc > 1) ? (uint32_t) atoi(argv[1]) : 1000;
+
+	filter_bench_run(SAMPLE_RATE, repeats);
+	return 0;
+}
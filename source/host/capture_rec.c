@@ -0,0 +1,271 @@
+/*
+ * capture_rec.c
+ *
+ * Recorder of the capture frames of USE_CAPTURE (see src/inc/capture.h).
+ * It reads the COBS frames from the serial port or from a file, skips the
+ * text before the first frame, drops the frames with a bad CRC and writes
+ * the ADC and the DAC stream in two WAV files, <prefix>-adc.wav and
+ * <prefix>-dac.wav, as 16-bit PCM. A gap in the sequence numbers of a
+ * stream is reported and filled with silence, so the files keep the timing.
+ * It stops at the end of the input, after -t seconds of the ADC stream, or
+ * on Ctrl-C, and prints the frames, the gaps and the frames that the
+ * firmware dropped. Configure the serial port first, e.g.:
+ * 	stty -F /dev/ttyUSB0 2000000 raw -echo
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-capture [-o prefix] [-t seconds] [/dev/ttyUSB0 | file]
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "capture.h"
+
+/* The largest frame that the recorder accepts */
+#define MAX_NUM_OF_SAMPLES 4096
+#define MAX_FRAME_SIZE CAPTURE_FRAME_SIZE(MAX_NUM_OF_SAMPLES)
+/* Longer gaps are not filled, it's more likely a reset of the firmware */
+#define MAX_FILL_FRAMES 1000
+#define WAV_HEADER_SIZE 44
+/* The 12-bit samples are unsigned */
+#define SAMPLE_MID_SCALE 2048
+
+struct capture_file {
+	const char * name;
+	FILE * fp;
+	uint32_t fs;
+	uint8_t channels;
+	uint32_t next_seq;
+	uint32_t samples;
+	uint32_t frames;
+	uint32_t gaps;
+	uint32_t lost;
+	uint32_t dropped;
+};
+
+static volatile sig_atomic_t m_stop;
+
+static inline uint16_t get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return get_u16(p) | ((uint32_t) get_u16(&p[2]) << 16);
+}
+
+static void put_u16(uint8_t * p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void put_u32(uint8_t * p, uint32_t value)
+{
+	put_u16(p, value);
+	put_u16(&p[2], value >> 16);
+}
+
+/**
+ * @brief Write the WAV header. The sizes are set again when the file is
+ * 		closed.
+ */
+static void wav_header(struct capture_file * f)
+{
+	uint8_t h[WAV_HEADER_SIZE];
+	uint32_t data_size = f->samples * f->channels * 2;
+
+	memcpy(&h[0], "RIFF", 4);
+	put_u32(&h[4], 36 + data_size);
+	memcpy(&h[8], "WAVEfmt ", 8);
+	put_u32(&h[16], 16);
+	put_u16(&h[20], 1);
+	put_u16(&h[22], f->channels);
+	put_u32(&h[24], f->fs);
+	put_u32(&h[28], f->fs * f->channels * 2);
+	put_u16(&h[32], f->channels * 2);
+	put_u16(&h[34], 16);
+	memcpy(&h[36], "data", 4);
+	put_u32(&h[40], data_size);
+	fseek(f->fp, 0, SEEK_SET);
+	fwrite(h, 1, sizeof(h), f->fp);
+	fseek(f->fp, 0, SEEK_END);
+}
+
+/**
+ * @brief Write the samples, or silence if samples is NULL
+ */
+static void wav_write(struct capture_file * f, const uint8_t * samples, uint16_t num_of_samples)
+{
+	uint8_t pcm[MAX_NUM_OF_SAMPLES * 2];
+	uint32_t n = num_of_samples * f->channels;
+
+	for (uint32_t i=0; i<n; i++) {
+		/* 12-bit unsigned to 16-bit signed */
+		int16_t x = samples ? (int16_t) ((get_u16(&samples[i * 2]) - SAMPLE_MID_SCALE) * 16) : 0;
+		put_u16(&pcm[i * 2], (uint16_t) x);
+	}
+	fwrite(pcm, 2, n, f->fp);
+	f->samples += num_of_samples;
+}
+
+/**
+ * @brief Check a decoded frame and append it to the file of its stream
+ */
+static void record_frame(struct capture_file * files, const uint8_t * buf, int len)
+{
+	struct capture_file * f;
+	uint8_t channels = buf[2];
+	uint32_t seq = get_u32(&buf[4]);
+	uint32_t fs = get_u32(&buf[8]);
+	uint16_t num_of_samples = get_u16(&buf[16]);
+
+	if (buf[1] >= CAPTURE_NUM_OF_STREAMS || !channels || channels > CAPTURE_MAX_CHANNELS ||
+			num_of_samples * channels > MAX_NUM_OF_SAMPLES ||
+			len != CAPTURE_FRAME_SIZE(num_of_samples * channels)) {
+		fprintf(stderr, "Dropped a frame with bad size\n");
+		return;
+	}
+	f = &files[buf[1]];
+
+	if (!f->fp) {
+		if (!(f->fp = fopen(f->name, "wb"))) {
+			perror(f->name);
+			exit(1);
+		}
+		f->fs = fs;
+		f->channels = channels;
+		f->next_seq = seq;
+		wav_header(f);
+		printf("%s: %u Hz, %d channels, decimation %d\n", f->name, fs, channels, buf[3]);
+	}
+	else if (fs != f->fs || channels != f->channels) {
+		fprintf(stderr, "%s: the format changed, frame %u skipped\n", f->name, seq);
+		return;
+	}
+
+	if (seq != f->next_seq) {
+		uint32_t missing = seq - f->next_seq;
+
+		if (missing > MAX_FILL_FRAMES) {
+			fprintf(stderr, "%s: sequence jumped from %u to %u, not filled\n",
+					f->name, f->next_seq, seq);
+		}
+		else {
+			fprintf(stderr, "%s: %u frames missing before frame %u\n", f->name, missing, seq);
+			for (uint32_t i=0; i<missing; i++)
+				wav_write(f, NULL, num_of_samples);
+			f->lost += missing;
+		}
+		f->gaps++;
+	}
+	wav_write(f, &buf[CAPTURE_HEADER_SIZE], num_of_samples);
+	f->next_seq = seq + 1;
+	f->dropped = get_u32(&buf[12]);
+	f->frames++;
+}
+
+static void on_signal(int sig)
+{
+	m_stop = 1;
+}
+
+int main(int argc, char ** argv)
+{
+	static uint8_t buf[CAPTURE_COBS_SIZE(MAX_FRAME_SIZE)];
+	static char names[CAPTURE_NUM_OF_STREAMS][256];
+	struct capture_file files[CAPTURE_NUM_OF_STREAMS];
+	const char * prefix = "capture";
+	const char * stream_names[CAPTURE_NUM_OF_STREAMS] = {"adc", "dac"};
+	struct sigaction sa;
+	double seconds = 0;
+	uint32_t bad = 0;
+	size_t len = 0;
+	int overflow = 0;
+	int synced = 0;
+	int fd = STDIN_FILENO;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:t:")) != -1) {
+		if (opt == 'o') {
+			prefix = optarg;
+		}
+		else if (opt == 't') {
+			seconds = atof(optarg);
+		}
+		else {
+			fprintf(stderr, "Usage: %s [-o prefix] [-t seconds] [/dev/ttyUSB0 | file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc && !freopen(argv[optind], "rb", stdin)) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	memset(files, 0, sizeof(files));
+	for (int i=0; i<CAPTURE_NUM_OF_STREAMS; i++) {
+		snprintf(names[i], sizeof(names[i]), "%s-%s.wav", prefix, stream_names[i]);
+		files[i].name = names[i];
+	}
+
+	/* without SA_RESTART, so Ctrl-C also stops a blocking read */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!m_stop) {
+		uint8_t chunk[512];
+		ssize_t n = read(fd, chunk, sizeof(chunk));
+
+		if (n <= 0)
+			break;
+		for (ssize_t i=0; i<n && !m_stop; i++) {
+			if (chunk[i]) {
+				if (len < sizeof(buf))
+					buf[len++] = chunk[i];
+				else
+					overflow = 1;
+				continue;
+			}
+			/* the delimiter, also after the text that the firmware prints on boot */
+			if (len && !overflow) {
+				int size = cobs_frame_decode(buf, len, buf);
+
+				if (size >= CAPTURE_FRAME_SIZE(0) && buf[0] == CAPTURE_FRAME_TYPE &&
+						cobs_frame_crc16(buf, size - 2) == get_u16(&buf[size - 2])) {
+					record_frame(files, buf, size);
+					synced = 1;
+				}
+				else if (synced) {
+					fprintf(stderr, "Dropped a frame with bad CRC\n");
+					bad++;
+				}
+				/* else the text before the first frame */
+			}
+			len = 0;
+			overflow = 0;
+			if (seconds > 0 && files[CAPTURE_ADC].fp &&
+					files[CAPTURE_ADC].samples >= seconds * files[CAPTURE_ADC].fs)
+				m_stop = 1;
+		}
+	}
+
+	for (int i=0; i<CAPTURE_NUM_OF_STREAMS; i++) {
+		struct capture_file * f = &files[i];
+
+		if (!f->fp)
+			continue;
+		wav_header(f);
+		fclose(f->fp);
+		printf("%s: %u frames, %.2f s, %u gaps, %u frames missing, %u dropped by the firmware\n",
+				f->name, f->frames, (double) f->samples / f->fs, f->gaps, f->lost, f->dropped);
+	}
+	printf("%u frames with bad CRC\n", bad);
+	return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * chain_cli.c
+ *
+ * Host CLI of the filter chain commands of USE_CHAIN_CMD (see
+ * src/inc/chain_cmd.h). It sends a command frame on the serial port, waits
+ * for the response and skips the text that the firmware prints in the
+ * meantime. An edit that is answered with busy, while the previous edit
+ * still ramps, is sent again. A command that gets no response is sent again
+ * only if it can run twice, insert and remove can't, since the firmware may
+ * have done the edit and lost the response. Then the chain is listed, so
+ * the actual stages are shown.
+ * The filter types are given with their filters_lib names, e.g.
+ * so_butterworth_lpf, or with their number. Configure the serial port
+ * first, e.g.:
+ * 	stty -F /dev/ttyUSB0 115200 raw -echo
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 list
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 insert end so_butterworth_lpf 8000
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 set 1 so_parametric_cq_boost 1000 2 6
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 bypass 0 1
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 remove 0
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 stats
+ * 	./stm32f303xc-adc-dac-dsp-chain-cli /dev/ttyUSB0 rate 48000
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "biquad_design.h"
+#include "chain_cmd.h"
+
+#define RESPONSE_TIMEOUT_MS 500
+#define MAX_RETRIES 3
+#define MAX_BUSY_RETRIES 100
+#define BUSY_DELAY_US 10000
+/* The return of command() when an edit got no response */
+#define RESPONSE_LOST -2
+
+static int m_fd;
+
+static const char * const m_status_names[] = {
+	[CHAIN_CMD_OK] = "ok",
+	[CHAIN_CMD_ERR_BUSY] = "busy",
+	[CHAIN_CMD_ERR_PARAM] = "invalid parameters",
+	[CHAIN_CMD_ERR_UNKNOWN] = "unknown command",
+	[CHAIN_CMD_ERR_LENGTH] = "invalid length",
+};
+
+static inline uint16_t get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return get_u16(p) | ((uint32_t) get_u16(&p[2]) << 16);
+}
+
+static inline uint8_t * put_u32(uint8_t * p, uint32_t value)
+{
+	for (int i=0; i<4; i++)
+		*p++ = value >> (i * 8);
+	return p;
+}
+
+static inline float get_f32(const uint8_t * p)
+{
+	uint32_t raw = get_u32(p);
+	float value;
+
+	memcpy(&value, &raw, sizeof(value));
+	return value;
+}
+
+static inline uint8_t * put_f32(uint8_t * p, float value)
+{
+	uint32_t raw;
+
+	memcpy(&raw, &value, sizeof(raw));
+	return put_u32(p, raw);
+}
+
+/**
+ * @brief Read a byte before the timeout
+ * @return The byte or -1 on timeout
+ */
+static int read_byte(int timeout_ms)
+{
+	struct pollfd pfd = { .fd = m_fd, .events = POLLIN };
+	uint8_t c;
+
+	if (poll(&pfd, 1, timeout_ms) <= 0 || read(m_fd, &c, 1) != 1)
+		return -1;
+	return c;
+}
+
+/**
+ * @brief Wait for the response of a command
+ * @param[in] type The command
+ * @param[out] payload The payload of the response
+ * @return The payload length or -1 on timeout
+ */
+static int read_response(uint8_t type, uint8_t * payload)
+{
+	uint8_t buf[CHAIN_CMD_FRAME_SIZE(255)];
+	int c;
+
+	while ((c = read_byte(RESPONSE_TIMEOUT_MS)) >= 0) {
+		uint8_t checksum = 0;
+		size_t len;
+
+		if (c != CHAIN_CMD_SYNC0)
+			continue;
+		if ((c = read_byte(RESPONSE_TIMEOUT_MS)) != CHAIN_CMD_SYNC1)
+			continue;
+		/* type, length, payload and checksum */
+		for (len=2; len<CHAIN_CMD_HEADER_SIZE; len++) {
+			if ((c = read_byte(RESPONSE_TIMEOUT_MS)) < 0)
+				return -1;
+			buf[len] = c;
+		}
+		for (; len<CHAIN_CMD_FRAME_SIZE(buf[3]); len++) {
+			if ((c = read_byte(RESPONSE_TIMEOUT_MS)) < 0)
+				return -1;
+			buf[len] = c;
+		}
+		for (size_t i=2; i<len - 1; i++)
+			checksum ^= buf[i];
+		if (checksum != buf[len - 1] || buf[2] != (type | CHAIN_CMD_RESPONSE) || !buf[3])
+			continue;
+		memcpy(payload, &buf[CHAIN_CMD_HEADER_SIZE], buf[3]);
+		return buf[3];
+	}
+	return -1;
+}
+
+/**
+ * @brief Check if a command gives the same result when it runs twice
+ */
+static int command_is_idempotent(uint8_t type)
+{
+	return type != CHAIN_CMD_INSERT && type != CHAIN_CMD_REMOVE;
+}
+
+/**
+ * @brief Send a command and wait for its response. Busy edits are sent
+ * 		again, and so are the lost responses of the idempotent commands.
+ * @param[in] type The command
+ * @param[in] payload The payload of the command
+ * @param[in] len The payload length
+ * @param[out] resp The payload of the response, which starts with the status
+ * @return The length of the response, RESPONSE_LOST if an insert or a remove
+ * 		got no response and it's not known if it was done, or -1 on error
+ */
+static int command(uint8_t type, const uint8_t * payload, uint8_t len, uint8_t * resp)
+{
+	uint8_t frame[CHAIN_CMD_FRAME_SIZE(CHAIN_CMD_MAX_PAYLOAD)];
+	size_t size = CHAIN_CMD_FRAME_SIZE(len);
+	uint8_t checksum = 0;
+	int retries = 0, busy = 0;
+
+	frame[0] = CHAIN_CMD_SYNC0;
+	frame[1] = CHAIN_CMD_SYNC1;
+	frame[2] = type;
+	frame[3] = len;
+	if (len)
+		memcpy(&frame[CHAIN_CMD_HEADER_SIZE], payload, len);
+	for (size_t i=2; i<size - 1; i++)
+		checksum ^= frame[i];
+	frame[size - 1] = checksum;
+
+	while (1) {
+		if (write(m_fd, frame, size) != (ssize_t) size) {
+			perror("write");
+			return -1;
+		}
+		int resp_len = read_response(type, resp);
+		if (resp_len < 0) {
+			if (!command_is_idempotent(type)) {
+				fprintf(stderr, "No response, the edit may be done\n");
+				return RESPONSE_LOST;
+			}
+			if (++retries > MAX_RETRIES) {
+				fprintf(stderr, "No response\n");
+				return -1;
+			}
+			continue;
+		}
+		if (resp[0] == CHAIN_CMD_ERR_BUSY && ++busy <= MAX_BUSY_RETRIES) {
+			usleep(BUSY_DELAY_US);
+			continue;
+		}
+		if (resp[0] != CHAIN_CMD_OK) {
+			fprintf(stderr, "Error: %s\n", (resp[0] <= CHAIN_CMD_ERR_LENGTH) ?
+					m_status_names[resp[0]] : "unknown status");
+			return -1;
+		}
+		return resp_len;
+	}
+}
+
+/**
+ * @brief Parse a filter type, by name or by number
+ * @return The type or -1 on error
+ */
+static int parse_type(const char * arg)
+{
+	char * end;
+	long type = strtol(arg, &end, 0);
+
+	if (*arg && !*end)
+		return (type >= 0 && type < FILTER_NUM_OF_TYPES) ? (int) type : -1;
+	for (int i=0; i<FILTER_NUM_OF_TYPES; i++)
+		if (!strcmp(arg, biquad_type_name(i)))
+			return i;
+	return -1;
+}
+
+/**
+ * @brief Encode the stage of the arguments: type fc [q] [gain_db]
+ * @return The end of the stage or NULL on error
+ */
+static uint8_t * parse_stage(uint8_t * p, int argc, char ** argv)
+{
+	int type;
+
+	if (argc < 2 || argc > 4 || (type = parse_type(argv[0])) < 0) {
+		fprintf(stderr, "Invalid stage, the arguments are <type> <fc> [q] [gain_db]\n");
+		return NULL;
+	}
+	*p++ = type;
+	p = put_f32(p, strtof(argv[1], NULL));
+	p = put_f32(p, (argc > 2) ? strtof(argv[2], NULL) : 0);
+	return put_f32(p, (argc > 3) ? strtof(argv[3], NULL) : 0);
+}
+
+static int cmd_list(void)
+{
+	uint8_t resp[255];
+	uint8_t index;
+
+	if (command(CHAIN_CMD_LIST, NULL, 0, resp) < 7)
+		return -1;
+	printf("fs %u Hz, %d of %d stages\n", get_u32(&resp[1]), resp[5], resp[6]);
+	for (index=0; index<resp[5]; index++) {
+		uint8_t stage[255];
+		if (command(CHAIN_CMD_GET, &index, 1, stage) < 16)
+			return -1;
+		printf("%2d: %-24s fc %.1f q %.4f gain %.1f dB%s\n", stage[1],
+				biquad_type_name(stage[3]) ? biquad_type_name(stage[3]) : "?",
+				get_f32(&stage[4]), get_f32(&stage[8]), get_f32(&stage[12]),
+				stage[2] ? " (bypassed)" : "");
+	}
+	return 0;
+}
+
+static int cmd_stats(void)
+{
+	uint8_t resp[255];
+	const uint8_t * p = &resp[1];
+
+	if (command(CHAIN_CMD_STATS, NULL, 0, resp) < CHAIN_CMD_STATS_SIZE)
+		return -1;
+	printf("fs %u Hz, %u samples/s, %u cycles/sample\n",
+			get_u32(&p[0]), get_u32(&p[4]), get_u32(&p[8]));
+	if (p[12] & CHAIN_CMD_STATS_LOAD)
+		printf("load %.2f%% peak %.2f%% late blocks %u adc overruns %u\n",
+				get_u16(&p[13]) / 100.0, get_u16(&p[15]) / 100.0,
+				get_u32(&p[17]), get_u32(&p[21]));
+	if (p[12] & CHAIN_CMD_STATS_SIGNAL) {
+		for (int ch=0; ch<2; ch++) {
+			const uint8_t * s = &p[25 + ch * 12];
+			printf("%s rms %d min %d max %d dc %d %s %u\n", ch ? "dac" : "adc",
+					(int16_t) get_u16(&s[0]), (int16_t) get_u16(&s[2]),
+					(int16_t) get_u16(&s[4]), (int16_t) get_u16(&s[6]),
+					ch ? "clips" : "rails", get_u32(&s[8]));
+		}
+	}
+	return 0;
+}
+
+static void usage(const char * name)
+{
+	fprintf(stderr,
+			"Usage: %s <serial port> <command>\n"
+			"Commands:\n"
+			"  list\n"
+			"  insert <index | end> <type> <fc> [q] [gain_db]\n"
+			"  set <index> <type> <fc> [q] [gain_db]\n"
+			"  bypass <index> <0 | 1>\n"
+			"  remove <index>\n"
+			"  stats\n"
+			"  rate <fs>\n"
+			"Types:\n", name);
+	for (int i=0; i<FILTER_NUM_OF_TYPES; i++)
+		fprintf(stderr, "  %d: %s\n", i, biquad_type_name(i));
+}
+
+int main(int argc, char ** argv)
+{
+	uint8_t payload[CHAIN_CMD_MAX_PAYLOAD];
+	uint8_t resp[255];
+	uint8_t * p = payload;
+	const char * name = argv[0];
+	int ret = -1;
+
+	if (argc < 3) {
+		usage(name);
+		return 1;
+	}
+	if ((m_fd = open(argv[1], O_RDWR | O_NOCTTY)) < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	const char * cmd = argv[2];
+	argc -= 3;
+	argv += 3;
+	if (!strcmp(cmd, "list") && !argc)
+		ret = cmd_list();
+	else if (!strcmp(cmd, "stats") && !argc)
+		ret = cmd_stats();
+	else if (!strcmp(cmd, "insert") && argc >= 1) {
+		*p++ = strcmp(argv[0], "end") ? atoi(argv[0]) : 0xFF;
+		if ((p = parse_stage(p, argc - 1, &argv[1]))) {
+			int resp_len = command(CHAIN_CMD_INSERT, payload, p - payload, resp);
+			if (resp_len >= 2) {
+				printf("inserted stage %d\n", resp[1]);
+				ret = 0;
+			}
+			else if (resp_len == RESPONSE_LOST) {
+				cmd_list();
+			}
+		}
+	}
+	else if (!strcmp(cmd, "set") && argc >= 1) {
+		*p++ = atoi(argv[0]);
+		if ((p = parse_stage(p, argc - 1, &argv[1])))
+			ret = (command(CHAIN_CMD_SET, payload, p - payload, resp) < 0) ? -1 : 0;
+	}
+	else if (!strcmp(cmd, "bypass") && argc == 2) {
+		payload[0] = atoi(argv[0]);
+		payload[1] = atoi(argv[1]);
+		ret = (command(CHAIN_CMD_BYPASS, payload, 2, resp) < 0) ? -1 : 0;
+	}
+	else if (!strcmp(cmd, "rate") && argc == 1) {
+		put_u32(payload, strtoul(argv[0], NULL, 0));
+		if (command(CHAIN_CMD_RATE, payload, 4, resp) >= 5) {
+			printf("fs %u Hz\n", get_u32(&resp[1]));
+			ret = 0;
+		}
+	}
+	else if (!strcmp(cmd, "remove") && argc == 1) {
+		payload[0] = atoi(argv[0]);
+		ret = command(CHAIN_CMD_REMOVE, payload, 1, resp);
+		if (ret == RESPONSE_LOST)
+			cmd_list();
+		ret = (ret < 0) ? -1 : 0;
+	}
+	else
+		usage(name);
+
+	close(m_fd);
+	return ret ? 1 : 0;
+}
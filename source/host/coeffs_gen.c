@@ -0,0 +1,80 @@
+/*
+ * coeffs_gen.c
+ *
+ * Build time generator of the fixed filter chain coefficients. It designs
+ * the stages of filter_chain_fixed.h with biquad_design() and writes them
+ * in a header as const tables. The floats are written in hex, so the tables
+ * have the exact values of the design.
+ *
+ * Usage:
+ * 	coeffs_gen filter_chain_coeffs.h
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <ctype.h>
+#include "biquad_design.h"
+#include "filter_chain_fixed.h"
+
+#define FILTER_STAGE(type, fc, q, gain_db) { type, fc, q, gain_db },
+static const struct biquad_params m_params[] = {
+	FILTER_CHAIN_FIXED_STAGES
+};
+#undef FILTER_STAGE
+
+#define NUM_OF_STAGES (sizeof(m_params) / sizeof(m_params[0]))
+
+static void print_type(FILE * fp, enum biquad_type type)
+{
+	const char * name = biquad_type_name(type);
+
+	fprintf(fp, "FILTER_");
+	while (*name)
+		fputc(toupper((unsigned char) *name++), fp);
+}
+
+int main(int argc, char ** argv)
+{
+	float32_t coeffs[NUM_OF_STAGES][BIQUAD_NUM_COEFFS];
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <header>\n", argv[0]);
+		return 1;
+	}
+
+	for (unsigned s=0; s<NUM_OF_STAGES; s++) {
+		if (biquad_design(&m_params[s], FILTER_CHAIN_FIXED_FS, coeffs[s]) < 0) {
+			fprintf(stderr, "Invalid parameters in stage %u of filter_chain_fixed.h\n", s);
+			return 1;
+		}
+	}
+
+	FILE * fp = fopen(argv[1], "w");
+	if (!fp) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	fprintf(fp, "/* Generated by coeffs_gen from filter_chain_fixed.h. Do not edit. */\n");
+	fprintf(fp, "#ifndef FILTER_CHAIN_COEFFS_H_\n#define FILTER_CHAIN_COEFFS_H_\n\n");
+	fprintf(fp, "#include \"biquad_design.h\"\n#include \"filter_chain_fixed.h\"\n\n");
+	fprintf(fp, "#define FILTER_CHAIN_FIXED_NUM_OF_STAGES %u\n\n", (unsigned) NUM_OF_STAGES);
+
+	fprintf(fp, "static const struct biquad_params filter_chain_fixed_params[] = {\n");
+	for (unsigned s=0; s<NUM_OF_STAGES; s++) {
+		fprintf(fp, "\t{ ");
+		print_type(fp, m_params[s].type);
+		fprintf(fp, ", %a, %a, %a },\n", m_params[s].fc, m_params[s].q, m_params[s].gain_db);
+	}
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static const float32_t filter_chain_fixed_coeffs[] = {\n");
+	for (unsigned s=0; s<NUM_OF_STAGES; s++) {
+		fprintf(fp, "\t/* %s, fc: %g Hz */\n\t", biquad_type_name(m_params[s].type), m_params[s].fc);
+		for (int i=0; i<BIQUAD_NUM_COEFFS; i++)
+			fprintf(fp, "%af,%s", coeffs[s][i], (i < BIQUAD_NUM_COEFFS - 1) ? " " : "\n");
+	}
+	fprintf(fp, "};\n\n#endif /* FILTER_CHAIN_COEFFS_H_ */\n");
+
+	return fclose(fp) ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/*
+ * core_cm0.h
+ *
+ * Host replacement of the CMSIS core header. The host build defines
+ * ARM_MATH_CM0, so arm_math.h uses the generic C code of CMSIS-DSP and
+ * only needs the compiler macros from this file.
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef CORE_CM0_H_
+#define CORE_CM0_H_
+
+#include <stdint.h>
+
+#define __ASM				__asm
+#define __INLINE			inline
+#define __STATIC_INLINE		static inline
+
+#define __NOP()		do {} while (0)
+#define __DMB()		__sync_synchronize()
+/* the host build has no interrupts */
+#define __disable_irq()	do {} while (0)
+#define __enable_irq()	do {} while (0)
+
+#endif /* CORE_CM0_H_ */
@@ -0,0 +1,315 @@
+/*
+ * main.c
+ *
+ * Host runner of the filter chain. It emulates the ADC/DAC DMA ping-pong
+ * buffers of the firmware, feeds a test tone through the chain one half
+ * buffer at a time and prints the gain of the chain and the time that
+ * it needs per sample. With USE_STEREO the second channel gets the same
+ * tone inverted and its gain is printed too. With USE_FFT_CONV the IR of
+ * fft_conv_ir.h runs after the biquads, like in the firmware. With
+ * USE_OVERSAMPLING the ADC buffer is filled at DSP_OVERSAMPLING times the
+ * sample rate and it's decimated, like in the firmware. With USE_SPECTRUM
+ * the output is also captured and the spectrum frames are written to a
+ * file, which can be rendered with stm32f303xc-adc-dac-dsp-spectrum. With
+ * USE_SIGNAL_STATS the statistics of the last window are printed too. With
+ * USE_DC_TRACKER the ADC offset is tracked, like in the firmware, and the
+ * tone can be biased away from the mid-scale with ADC_BIAS. With
+ * USE_PROFILER the profiler statistics are printed at the end, in ns. With
+ * USE_LOAD_MONITOR the load of the blocks is measured against the time of
+ * a block and the average and the high-water mark are printed.
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-host [tone_hz] [seconds] [spectrum_file]
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "filter_chain.h"
+#ifdef USE_FIXED_CHAIN
+#include "filter_chain_coeffs.h"
+#endif
+#ifdef USE_FFT_CONV
+#include "fft_conv_ir.h"
+#endif
+#ifdef USE_SPECTRUM
+#include "spectrum.h"
+#endif
+#ifdef USE_SIGNAL_STATS
+#include "signal_stats.h"
+#endif
+#ifdef USE_LOAD_MONITOR
+#include "load_monitor.h"
+#endif
+#include "profiler.h"
+
+#define SAMPLE_RATE 96000
+#define TONE_AMPLITUDE 1800
+
+/* The DC level of the emulated ADC input */
+#ifndef ADC_BIAS
+#define ADC_BIAS ADC_MID_SCALE
+#endif
+
+#ifndef DSP_OVERSAMPLING
+#define DSP_OVERSAMPLING 1
+#endif
+
+/* Same as src/main.c */
+#define ADC_BLOCK_SIZE (DSP_BLOCK_SIZE * DSP_OVERSAMPLING)
+#ifdef USE_OVERSAMPLED_DAC
+#define DAC_RATE (SAMPLE_RATE * DSP_OVERSAMPLING)
+#define DAC_BLOCK_SIZE ADC_BLOCK_SIZE
+#else
+#define DAC_RATE SAMPLE_RATE
+#define DAC_BLOCK_SIZE DSP_BLOCK_SIZE
+#endif
+
+/* Same layout as the DMA buffers in src/main.c */
+struct tp_io {
+#ifdef USE_STEREO
+	uint32_t adc_buffer[2 * ADC_BLOCK_SIZE];
+	uint32_t dac_buffer[2 * DAC_BLOCK_SIZE];
+#else
+	uint16_t adc_buffer[2 * ADC_BLOCK_SIZE];
+	uint16_t dac_buffer[2 * DAC_BLOCK_SIZE];
+#endif
+};
+static struct tp_io io;
+
+#ifdef USE_OVERSAMPLING
+static struct oversampling os;
+#endif
+
+#ifdef USE_FFT_CONV
+static struct fft_conv conv[2];
+#endif
+
+#ifdef USE_DC_TRACKER
+static struct dc_tracker dc[2];
+#endif
+
+#ifdef USE_SPECTRUM
+static FILE * spectrum_file;
+
+/* The debug UART of the firmware */
+static size_t spectrum_send(const uint8_t * buffer, size_t len)
+{
+	return spectrum_file ? fwrite(buffer, 1, len, spectrum_file) : len;
+}
+#endif
+
+static uint64_t time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Emulate the ADC DMA by filling one half of the ADC buffer
+ * @param[in] offset The first sample of the half buffer
+ * @param[in] n The index of the first sample in the tone
+ * @param[in] w The tone frequency in rad/sample of the ADC rate
+ */
+static void adc_fill_half(uint16_t offset, uint32_t n, double w)
+{
+	for (int i=0; i<ADC_BLOCK_SIZE; i++) {
+		double x = TONE_AMPLITUDE * sin(w * (n + i));
+		io.adc_buffer[offset + i] = (uint16_t) lround(ADC_BIAS + x);
+#ifdef USE_STEREO
+		io.adc_buffer[offset + i] |= (uint32_t) lround(ADC_BIAS - x) << 16;
+#endif
+	}
+}
+
+/* Same as the DMA half/full transfer handler of the firmware */
+static inline void process_block(uint8_t half)
+{
+	PROFILER_START(t_irq);
+#ifdef USE_STEREO
+	filter_chain_process_stereo(&io.adc_buffer[half * ADC_BLOCK_SIZE],
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DSP_BLOCK_SIZE);
+#else
+	filter_chain_process(&io.adc_buffer[half * ADC_BLOCK_SIZE],
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DSP_BLOCK_SIZE);
+#endif
+#if defined(USE_SPECTRUM) || defined(USE_SIGNAL_STATS)
+	PROFILER_START(t);
+#endif
+#ifdef USE_SPECTRUM
+#ifdef USE_STEREO
+	spectrum_capture((uint16_t *) &io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 2);
+#else
+	spectrum_capture(&io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 1);
+#endif
+#endif
+#ifdef USE_SIGNAL_STATS
+#ifdef USE_STEREO
+	signal_stats_process((uint16_t *) &io.adc_buffer[half * ADC_BLOCK_SIZE], ADC_BLOCK_SIZE,
+			(uint16_t *) &io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 2);
+#else
+	signal_stats_process(&io.adc_buffer[half * ADC_BLOCK_SIZE], ADC_BLOCK_SIZE,
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 1);
+#endif
+#endif
+#if defined(USE_SPECTRUM) || defined(USE_SIGNAL_STATS)
+	PROFILER_MARK(PROFILER_MONITOR, t);
+#endif
+	PROFILER_MARK(PROFILER_IRQ, t_irq);
+}
+
+static double gain_db(double sum_sq, uint32_t n)
+{
+	double rms = sqrt(sum_sq / n);
+	return 20.0 * log10((rms + 1e-9) / (TONE_AMPLITUDE / M_SQRT2));
+}
+
+int main(int argc, char ** argv)
+{
+	double tone = (argc > 1) ? atof(argv[1]) : 7500.0;
+	double seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+	uint32_t num_of_blocks = (uint32_t) (seconds * SAMPLE_RATE / DSP_BLOCK_SIZE) & ~1UL;
+	/* with oversampling the tone can be above SAMPLE_RATE / 2 to check the
+	 * anti-alias filter */
+	double adc_rate = (double) SAMPLE_RATE * DSP_OVERSAMPLING;
+	double w = 2.0 * M_PI * tone / adc_rate;
+	double sum_sq[2] = {0, 0};
+	uint64_t elapsed = 0;
+
+	if (num_of_blocks < 4 || tone <= 0 || tone >= adc_rate / 2) {
+		fprintf(stderr, "Usage: %s [tone_hz] [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	filter_chain_init(SAMPLE_RATE);
+#ifdef USE_FIXED_CHAIN
+	filter_chain_load(filter_chain_fixed_params, filter_chain_fixed_coeffs,
+			FILTER_CHAIN_FIXED_NUM_OF_STAGES);
+#else
+	/* Set your filter here: */
+	filter_chain_add(FILTER_SO_BUTTERWORTH_HPF, 5000, 0, 0);
+	filter_chain_add(FILTER_SO_BUTTERWORTH_LPF, 10000, 0, 0);
+#endif
+	filter_chain_commit();
+#ifdef USE_FFT_CONV
+	for (int i=0; i<2; i++) {
+		if (fft_conv_init(&conv[i], DSP_BLOCK_SIZE, fft_conv_ir, FFT_CONV_IR_TAPS) < 0) {
+			fprintf(stderr, "Invalid FFT convolution size\n");
+			return 1;
+		}
+		filter_chain_set_conv(i, &conv[i]);
+	}
+#endif
+#ifdef USE_OVERSAMPLING
+#ifdef USE_OVERSAMPLED_DAC
+	oversampling_init(&os, DSP_OVERSAMPLING, 1);
+#else
+	oversampling_init(&os, DSP_OVERSAMPLING, 0);
+#endif
+	filter_chain_set_oversampling(&os);
+#endif
+#ifdef USE_DC_TRACKER
+	for (int i=0; i<2; i++) {
+		dc_tracker_init(&dc[i], DC_TRACKER_SHIFT, DC_TRACKER_STARTUP_BLOCKS);
+		filter_chain_set_dc_tracker(i, &dc[i]);
+	}
+#endif
+#ifdef USE_SPECTRUM
+	if (argc > 3 && !(spectrum_file = fopen(argv[3], "wb"))) {
+		perror(argv[3]);
+		return 1;
+	}
+	spectrum_init(DAC_RATE, &spectrum_send);
+#endif
+#ifdef USE_SIGNAL_STATS
+	signal_stats_init(SIGNAL_STATS_WINDOW_MS * (SAMPLE_RATE / 1000) / DSP_BLOCK_SIZE);
+#endif
+#ifdef USE_LOAD_MONITOR
+	/* the time of a block in ns */
+	load_monitor_init((uint32_t) (1e9 * DSP_BLOCK_SIZE / SAMPLE_RATE));
+#endif
+
+	for (uint32_t b=0; b<num_of_blocks; b++) {
+		uint8_t half = b & 1;
+		uint16_t offset = half * DAC_BLOCK_SIZE;
+
+		adc_fill_half(half * ADC_BLOCK_SIZE, b * ADC_BLOCK_SIZE, w);
+
+		uint64_t start = time_ns();
+		process_block(half);
+		uint64_t block_ns = time_ns() - start;
+		elapsed += block_ns;
+#ifdef USE_LOAD_MONITOR
+		load_monitor_block((uint32_t) block_ns, 0, 0);
+#endif
+#ifdef USE_SPECTRUM
+		/* the main loop and the publish timer of the firmware */
+		spectrum_update();
+		if ((b + 1) % (SPECTRUM_PUBLISH_MS * SAMPLE_RATE / 1000 / DSP_BLOCK_SIZE) == 0)
+			spectrum_publish(NULL);
+#endif
+
+		/* skip the first half of the run to let the filters settle */
+		if (b < num_of_blocks / 2)
+			continue;
+		for (int i=0; i<DAC_BLOCK_SIZE; i++) {
+			double y = (double) (io.dac_buffer[offset + i] & 0xFFFF) - ADC_MID_SCALE;
+			sum_sq[0] += y * y;
+#ifdef USE_STEREO
+			y = (double) (io.dac_buffer[offset + i] >> 16) - ADC_MID_SCALE;
+			sum_sq[1] += y * y;
+#endif
+		}
+	}
+
+	uint32_t num_of_samples = num_of_blocks * DSP_BLOCK_SIZE;
+	uint32_t num_of_measured = (num_of_blocks - num_of_blocks / 2) * DAC_BLOCK_SIZE;
+
+	printf("precision   : %s\n", filter_chain_get_precision());
+	printf("block size  : %d\n", DSP_BLOCK_SIZE);
+#ifdef USE_OVERSAMPLING
+	printf("oversampling: %d\n", DSP_OVERSAMPLING);
+#endif
+	printf("stages      : %d\n", filter_chain_get_num_of_stages());
+	printf("tone        : %.1f Hz\n", tone);
+	printf("gain        : %.2f dB\n", gain_db(sum_sq[0], num_of_measured));
+#ifdef USE_STEREO
+	printf("gain ch2    : %.2f dB\n", gain_db(sum_sq[1], num_of_measured));
+#endif
+	printf("ns/sample   : %.2f\n", (double) elapsed / num_of_samples);
+#ifdef USE_DC_TRACKER
+	printf("adc offset  : %.2f\n", dc[0].offset / 65536.0);
+#endif
+#ifdef USE_SIGNAL_STATS
+	struct signal_stats_result r;
+	if (signal_stats_get(&r)) {
+		/* rms, min, max, dc and clips in 12-bit steps */
+		printf("adc stats   : %d %d %d %d %d\n",
+				signal_stats_to_lsb(r.adc.rms), signal_stats_to_lsb(r.adc.min),
+				signal_stats_to_lsb(r.adc.max), signal_stats_to_lsb(r.adc.mean), r.adc.clips);
+		printf("dac stats   : %d %d %d %d %d\n",
+				signal_stats_to_lsb(r.dac.rms), signal_stats_to_lsb(r.dac.min),
+				signal_stats_to_lsb(r.dac.max), signal_stats_to_lsb(r.dac.mean), r.dac.clips);
+	}
+#endif
+#ifdef USE_LOAD_MONITOR
+	struct load_monitor_result load;
+	load_monitor_get(&load);
+	printf("load        : %.2f%% peak %.2f%%\n", load.load / 100.0, load.peak / 100.0);
+#endif
+#ifdef USE_PROFILER
+	/* the time of a block */
+	profiler_dump((uint32_t) (1e9 * DSP_BLOCK_SIZE / SAMPLE_RATE));
+#endif
+#ifdef USE_SPECTRUM
+	/* send the last frame */
+	spectrum_update();
+	if (spectrum_file)
+		fclose(spectrum_file);
+#endif
+
+	return 0;
+}
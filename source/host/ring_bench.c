@@ -0,0 +1,318 @@
+/*
+ * ring_bench.c
+ *
+ * Stress test and throughput benchmark of the SPSC ring of the
+ * stm32f3_dimtass_lib (spsc_ring.h).
+ *
+ * The stress test runs a producer and a consumer on small rings, so the
+ * indices wrap all the time, first with random steps in one thread and then
+ * in two threads. The producer writes a known byte sequence
+ * with spsc_ring_push(), spsc_ring_write() and spsc_ring_reserve()/commit()
+ * in random chunks and the consumer checks every byte that it gets with
+ * spsc_ring_pop(), spsc_ring_read() and spsc_ring_peek()/consume(). It exits
+ * with 1 if a byte was wrong.
+ *
+ * The benchmark runs in one thread and compares the byte push/pop of the
+ * ring with the modulo indexed ring that tp_comm_buffer used before, and
+ * measures the bulk copies.
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-ring-bench [MBytes]
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "spsc_ring.h"
+
+#define BENCH_RING_SIZE 256
+#define BENCH_BYTES (16 * 1024 * 1024)
+#define MAX_CHUNK 300
+/* Times that the indices of a stress run go around the ring, at most */
+#define STRESS_WRAPS 16384
+
+/* The state of the producer or the consumer */
+struct stress_side {
+	uint32_t seed;
+	uint64_t pos;
+	uint8_t chunk[MAX_CHUNK];
+};
+
+struct stress_ctx {
+	struct spsc_ring ring;
+	uint64_t total;
+	/* chunks up to twice the ring, so the spans start anywhere */
+	uint32_t max_chunk;
+	volatile uint32_t errors;
+	struct stress_side producer;
+	struct stress_side consumer;
+};
+
+/* The modulo ring of the old tp_comm_buffer, one byte is always free */
+struct mod_ring {
+	uint8_t * buffer;
+	size_t size;
+	volatile uint16_t ptr_in;
+	volatile uint16_t ptr_out;
+};
+
+static inline uint8_t stress_byte(uint64_t pos)
+{
+	return (uint8_t) ((pos * 2654435761u) >> 13);
+}
+
+static inline uint32_t rand_next(uint32_t * state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Let the other thread run when the ring is full or empty, also on
+ * 		a single CPU, where a yield doesn't always switch the thread
+ */
+static void stress_wait(void)
+{
+	struct timespec ts = {0, 1000};
+
+	nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Write the next random chunk of the sequence
+ * @return The number of bytes that fit in the ring
+ */
+static uint32_t stress_produce(struct stress_ctx * ctx)
+{
+	struct stress_side * p = &ctx->producer;
+	uint32_t mode = rand_next(&p->seed) % 3;
+	uint32_t len = 1 + rand_next(&p->seed) % ctx->max_chunk;
+	uint32_t n = 0;
+
+	if (len > ctx->total - p->pos)
+		len = ctx->total - p->pos;
+	if (mode == 0) {
+		while (n < len && !spsc_ring_push(&ctx->ring, stress_byte(p->pos + n)))
+			n++;
+	}
+	else if (mode == 1) {
+		for (uint32_t i=0; i<len; i++)
+			p->chunk[i] = stress_byte(p->pos + i);
+		n = spsc_ring_write(&ctx->ring, p->chunk, len);
+	}
+	else {
+		uint8_t * span;
+		n = spsc_ring_reserve(&ctx->ring, &span);
+		if (n > len)
+			n = len;
+		for (uint32_t i=0; i<n; i++)
+			span[i] = stress_byte(p->pos + i);
+		spsc_ring_commit(&ctx->ring, n);
+	}
+	p->pos += n;
+	return n;
+}
+
+/**
+ * @brief Read a random chunk and check it against the sequence
+ * @return The number of bytes that were read
+ */
+static uint32_t stress_consume(struct stress_ctx * ctx)
+{
+	struct stress_side * c = &ctx->consumer;
+	uint32_t mode = rand_next(&c->seed) % 3;
+	uint32_t len = 1 + rand_next(&c->seed) % ctx->max_chunk;
+	uint8_t * data = c->chunk;
+	uint32_t n = 0;
+
+	if (mode == 0) {
+		while (n < len && !spsc_ring_pop(&ctx->ring, &c->chunk[n]))
+			n++;
+	}
+	else if (mode == 1) {
+		n = spsc_ring_read(&ctx->ring, c->chunk, len);
+	}
+	else {
+		n = spsc_ring_peek(&ctx->ring, &data);
+		if (n > len)
+			n = len;
+	}
+	for (uint32_t i=0; i<n; i++) {
+		if (data[i] != stress_byte(c->pos + i)) {
+			fprintf(stderr, "Byte %llu: 0x%02x instead of 0x%02x\n",
+					(unsigned long long) (c->pos + i), data[i], stress_byte(c->pos + i));
+			ctx->errors++;
+			break;
+		}
+	}
+	if (mode == 2)
+		spsc_ring_consume(&ctx->ring, n);
+	c->pos += n;
+	return n;
+}
+
+static void * stress_producer(void * arg)
+{
+	struct stress_ctx * ctx = arg;
+
+	/* stops when the consumer found an error, the ring may stay full */
+	while (ctx->producer.pos < ctx->total && !ctx->errors)
+		if (!stress_produce(ctx))
+			stress_wait();
+	return NULL;
+}
+
+static void * stress_consumer(void * arg)
+{
+	struct stress_ctx * ctx = arg;
+
+	while (ctx->consumer.pos < ctx->total && !ctx->errors)
+		if (!stress_consume(ctx))
+			stress_wait();
+	return NULL;
+}
+
+/**
+ * @brief Run the producer and the consumer on a ring of the given size,
+ * 		in two threads, or in one thread with random steps of each side,
+ * 		which gives the same wraps on every run and any number of CPUs
+ * @return 0 if all the bytes arrived in order
+ */
+static int stress_run(uint32_t size, uint64_t total, int threads)
+{
+	struct stress_ctx ctx;
+	uint8_t * buffer = malloc(size);
+	double t;
+
+	memset(&ctx, 0, sizeof(ctx));
+	spsc_ring_init(&ctx.ring, buffer, size);
+	ctx.total = total;
+	ctx.max_chunk = (size * 2 < MAX_CHUNK) ? size * 2 : MAX_CHUNK;
+	ctx.producer.seed = 1;
+	ctx.consumer.seed = 2;
+
+	t = now_s();
+	if (threads) {
+		pthread_t producer, consumer;
+
+		pthread_create(&consumer, NULL, stress_consumer, &ctx);
+		pthread_create(&producer, NULL, stress_producer, &ctx);
+		pthread_join(producer, NULL);
+		pthread_join(consumer, NULL);
+	}
+	else {
+		uint32_t seed = 3;
+
+		while (ctx.consumer.pos < total && !ctx.errors) {
+			if ((rand_next(&seed) & 1) && ctx.producer.pos < total)
+				stress_produce(&ctx);
+			else
+				stress_consume(&ctx);
+		}
+	}
+	t = now_s() - t;
+
+	printf("stress: ring %5u bytes, %s, %llu bytes, %.1f MB/s, %s\n", size,
+			threads ? "2 threads" : "1 thread ", (unsigned long long) total,
+			total / t / 1e6, ctx.errors ? "FAILED" : "OK");
+	free(buffer);
+	return ctx.errors ? -1 : 0;
+}
+
+static inline int mod_ring_push(struct mod_ring * r, uint8_t byte)
+{
+	if ((r->ptr_in + 1) % r->size == r->ptr_out)
+		return -1;
+	r->buffer[r->ptr_in] = byte;
+	r->ptr_in = (r->ptr_in + 1) % r->size;
+	return 0;
+}
+
+static inline int mod_ring_pop(struct mod_ring * r, uint8_t * byte)
+{
+	if (r->ptr_out == r->ptr_in)
+		return -1;
+	*byte = r->buffer[r->ptr_out];
+	r->ptr_out = (r->ptr_out + 1) % r->size;
+	return 0;
+}
+
+/**
+ * @brief Fill and drain the rings a byte at a time and with the bulk copies
+ */
+static void bench_run(uint64_t total)
+{
+	static uint8_t buffer[BENCH_RING_SIZE];
+	static uint8_t chunk[BENCH_RING_SIZE];
+	/* the size is not a constant, like in tp_comm_buffer */
+	volatile size_t size = BENCH_RING_SIZE;
+	struct mod_ring mod = { buffer, size, 0, 0 };
+	struct spsc_ring ring;
+	uint32_t sum = 0;
+	uint8_t byte;
+	double t;
+
+	t = now_s();
+	for (uint64_t n=0; n<total; n+=size - 1) {
+		for (size_t i=0; i<size - 1; i++)
+			mod_ring_push(&mod, i);
+		while (!mod_ring_pop(&mod, &byte))
+			sum += byte;
+	}
+	t = now_s() - t;
+	printf("bench: modulo ring push/pop   %8.1f MB/s\n", total / t / 1e6);
+
+	spsc_ring_init(&ring, buffer, size);
+	t = now_s();
+	for (uint64_t n=0; n<total; n+=size) {
+		for (size_t i=0; i<size; i++)
+			spsc_ring_push(&ring, i);
+		while (!spsc_ring_pop(&ring, &byte))
+			sum += byte;
+	}
+	t = now_s() - t;
+	printf("bench: spsc ring push/pop     %8.1f MB/s\n", total / t / 1e6);
+
+	t = now_s();
+	for (uint64_t n=0; n<total; n+=size / 2) {
+		/* half of the ring, so the copies wrap */
+		spsc_ring_write(&ring, chunk, size / 2);
+		spsc_ring_read(&ring, chunk, size / 2);
+		sum += chunk[0];
+	}
+	t = now_s() - t;
+	printf("bench: spsc ring write/read   %8.1f MB/s\n", total / t / 1e6);
+
+	/* keeps the loops */
+	if (sum == 1)
+		printf("\n");
+}
+
+int main(int argc, char ** argv)
+{
+	uint64_t total = (argc > 1) ? (uint64_t) atoi(argv[1]) * 1024 * 1024 : BENCH_BYTES;
+	const uint32_t sizes[] = {2, 16, 256, 4096};
+	int ret = 0;
+
+	for (size_t i=0; i<sizeof(sizes) / sizeof(sizes[0]); i++) {
+		/* the small rings need a thread switch every few bytes */
+		uint64_t bytes = (uint64_t) sizes[i] * STRESS_WRAPS;
+		if (bytes > total / 4)
+			bytes = total / 4;
+		if (stress_run(sizes[i], bytes, 0) < 0 || stress_run(sizes[i], bytes, 1) < 0)
+			ret = 1;
+	}
+	bench_run(total);
+	return ret;
+}
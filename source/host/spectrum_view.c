@@ -0,0 +1,186 @@
+/*
+ * spectrum_view.c
+ *
+ * Decoder of the spectrum frames of USE_SPECTRUM (see src/inc/spectrum.h).
+ * It reads the frames from the serial port or from a file, drops the ones
+ * with a bad checksum and draws each frame as a text bar chart. With -c it
+ * prints every frame as a CSV line instead (frame, bin, Hz, dBFS), for
+ * plotting. Configure the serial port first, e.g.:
+ * 	stty -F /dev/ttyUSB0 115200 raw -echo
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-spectrum [-c] [/dev/ttyUSB0 | file]
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "spectrum.h"
+
+#define CHART_COLUMNS 64
+#define CHART_ROWS 16
+#define CHART_DB_PER_ROW 6
+
+/* The largest frame that the decoder accepts */
+#define MAX_NUM_OF_BINS 2048
+
+struct spectrum_frame {
+	uint16_t num_of_bins;
+	uint32_t fs;
+	uint16_t averages;
+	uint16_t dropped;
+	uint8_t bins[MAX_NUM_OF_BINS];
+};
+
+static inline uint16_t get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return get_u16(p) | ((uint32_t) get_u16(&p[2]) << 16);
+}
+
+static inline float bin_to_db(uint8_t bin)
+{
+	return SPECTRUM_DB_MIN + bin * SPECTRUM_DB_STEP;
+}
+
+/**
+ * @brief Read the next valid frame
+ * @param[in] fp The input stream
+ * @param[out] frame The decoded frame
+ * @return 0 on success or -1 at the end of the stream
+ */
+static int read_frame(FILE * fp, struct spectrum_frame * frame)
+{
+	uint8_t buf[SPECTRUM_FRAME_SIZE(MAX_NUM_OF_BINS)];
+	int c;
+
+	while ((c = getc(fp)) != EOF) {
+		uint8_t checksum = 0;
+		size_t len;
+
+		if (c != SPECTRUM_SYNC0)
+			continue;
+		if ((c = getc(fp)) != SPECTRUM_SYNC1) {
+			if (c == EOF)
+				break;
+			ungetc(c, fp);
+			continue;
+		}
+		/* type, number of bins, fs, averages and dropped samples */
+		if (fread(&buf[2], 1, SPECTRUM_HEADER_SIZE - 2, fp) != SPECTRUM_HEADER_SIZE - 2)
+			break;
+		frame->num_of_bins = get_u16(&buf[3]);
+		if (buf[2] != SPECTRUM_FRAME_TYPE || !frame->num_of_bins ||
+				frame->num_of_bins > MAX_NUM_OF_BINS)
+			continue;
+		/* the bins and the checksum */
+		len = SPECTRUM_FRAME_SIZE(frame->num_of_bins);
+		if (fread(&buf[SPECTRUM_HEADER_SIZE], 1, len - SPECTRUM_HEADER_SIZE, fp)
+				!= len - SPECTRUM_HEADER_SIZE)
+			break;
+		for (size_t i=2; i<len - 1; i++)
+			checksum ^= buf[i];
+		if (checksum != buf[len - 1]) {
+			fprintf(stderr, "Dropped a frame with bad checksum\n");
+			continue;
+		}
+		frame->fs = get_u32(&buf[5]);
+		frame->averages = get_u16(&buf[9]);
+		frame->dropped = get_u16(&buf[11]);
+		memcpy(frame->bins, &buf[SPECTRUM_HEADER_SIZE], frame->num_of_bins);
+		return 0;
+	}
+	return -1;
+}
+
+static void print_csv(const struct spectrum_frame * frame, uint32_t index)
+{
+	float bin_hz = (float) frame->fs / (2 * frame->num_of_bins);
+
+	for (int k=0; k<frame->num_of_bins; k++)
+		printf("%u,%d,%.1f,%.1f\n", index, k, k * bin_hz, bin_to_db(frame->bins[k]));
+}
+
+static void print_chart(const struct spectrum_frame * frame, int clear)
+{
+	float bin_hz = (float) frame->fs / (2 * frame->num_of_bins);
+	int columns = (frame->num_of_bins < CHART_COLUMNS) ? frame->num_of_bins : CHART_COLUMNS;
+	uint8_t level[CHART_COLUMNS];
+	int peak = 1;
+
+	/* skip the DC bin for the peak */
+	for (int k=2; k<frame->num_of_bins; k++)
+		if (frame->bins[k] > frame->bins[peak])
+			peak = k;
+
+	/* every column is the max of its bins */
+	for (int c=0; c<columns; c++) {
+		int first = c * frame->num_of_bins / columns;
+		int last = (c + 1) * frame->num_of_bins / columns;
+
+		level[c] = 0;
+		for (int k=first; k<last; k++)
+			if (frame->bins[k] > level[c])
+				level[c] = frame->bins[k];
+	}
+
+	if (clear)
+		printf("\033[H\033[2J");
+	printf("fs %u Hz, %d bins of %.1f Hz, %d averages, %d dropped\n",
+			frame->fs, frame->num_of_bins, bin_hz, frame->averages, frame->dropped);
+	printf("peak %.1f dBFS at %.1f Hz\n", bin_to_db(frame->bins[peak]), peak * bin_hz);
+	for (int r=0; r<CHART_ROWS; r++) {
+		float db = -(float) r * CHART_DB_PER_ROW;
+
+		printf("%4d |", (int) db);
+		for (int c=0; c<columns; c++)
+			putchar(bin_to_db(level[c]) >= db - CHART_DB_PER_ROW / 2.0f ? '#' : ' ');
+		putchar('\n');
+	}
+	printf("     +");
+	for (int c=0; c<columns; c++)
+		putchar('-');
+	printf("\n      0 Hz%*.0f Hz\n", columns - 7, frame->num_of_bins * bin_hz);
+	fflush(stdout);
+}
+
+int main(int argc, char ** argv)
+{
+	static struct spectrum_frame frame;
+	FILE * fp = stdin;
+	int csv = 0;
+	uint32_t index = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c")) != -1) {
+		if (opt != 'c') {
+			fprintf(stderr, "Usage: %s [-c] [/dev/ttyUSB0 | file]\n", argv[0]);
+			return 1;
+		}
+		csv = 1;
+	}
+	if (optind < argc && !(fp = fopen(argv[optind], "rb"))) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if (csv)
+		printf("frame,bin,hz,dbfs\n");
+	while (!read_frame(fp, &frame)) {
+		if (csv)
+			print_csv(&frame, index);
+		else
+			print_chart(&frame, isatty(STDOUT_FILENO));
+		index++;
+	}
+
+	if (fp != stdin)
+		fclose(fp);
+	return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * stlinky_reader.c
+ *
+ * Reader of the ring console of USE_STTERM_RING (see stlinky.h in the
+ * stm32f3_dimtass_lib). It finds the control block by its ID in a RAM
+ * image and prints the new bytes of a channel. The RAM is accessed only
+ * with mem_read() and mem_write(), which use a file as a stand-in for the
+ * target memory, e.g. a dump of the RAM after a crash:
+ * 	st-flash read ram.bin 0x20000000 0xa000
+ * With -f the file is read again every 100ms and only the new bytes are
+ * printed, and with -w the read offset is written back like a debugger
+ * would do, so the MCU sees the free space. With -i the text is written in
+ * the host to MCU channel.
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-stlinky [-c channel] [-f] [-w] [-i text] ram.bin
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "stlinky.h"
+
+#define POLL_US 100000
+
+struct ring_channel {
+	uint32_t addr;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t wr_off;
+	uint32_t rd_off;
+	uint32_t mode;
+	uint32_t dropped;
+};
+
+static FILE * m_mem;
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void put_u32(uint8_t * p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+/**
+ * @brief Read the target memory. The address is the offset in the file.
+ * @return 0 on success or -1
+ */
+static int mem_read(uint32_t addr, void * buf, size_t len)
+{
+	fflush(m_mem);
+	if (fseek(m_mem, addr, SEEK_SET) < 0 || fread(buf, 1, len, m_mem) != len)
+		return -1;
+	return 0;
+}
+
+static int mem_write(uint32_t addr, const void * buf, size_t len)
+{
+	if (fseek(m_mem, addr, SEEK_SET) < 0 || fwrite(buf, 1, len, m_mem) != len)
+		return -1;
+	fflush(m_mem);
+	return 0;
+}
+
+/**
+ * @brief Find the control block. It's 4-byte aligned.
+ * @return The address or -1 if it's not found
+ */
+static long find_block(void)
+{
+	uint8_t buf[4096 + STLINKY_RING_ID_SIZE];
+	uint32_t addr = 0;
+	size_t n;
+
+	fseek(m_mem, 0, SEEK_SET);
+	while ((n = fread(buf, 1, sizeof(buf), m_mem)) >= STLINKY_RING_ID_SIZE) {
+		for (size_t i=0; i + STLINKY_RING_ID_SIZE <= n; i+=4)
+			if (!memcmp(&buf[i], STLINKY_RING_ID, sizeof(STLINKY_RING_ID)))
+				return addr + i;
+		/* the next chunk overlaps, so the ID is found across two chunks */
+		addr += n - STLINKY_RING_ID_SIZE;
+		fseek(m_mem, addr, SEEK_SET);
+		if (n < sizeof(buf))
+			break;
+	}
+	return -1;
+}
+
+/**
+ * @brief Read the descriptor of a channel
+ * @param[in] block The address of the control block
+ * @param[in] down 1 for the host to MCU channel
+ * @return 0 on success or -1 if the channel is not valid
+ */
+static int read_channel(uint32_t block, uint8_t channel, int down, struct ring_channel * ch)
+{
+	uint8_t header[STLINKY_RING_HEADER_SIZE];
+	uint8_t desc[STLINKY_RING_CHANNEL_SIZE];
+	uint32_t num_of_up;
+
+	if (mem_read(block, header, sizeof(header)) < 0)
+		return -1;
+	num_of_up = get_u32(&header[16]);
+	if (channel >= (down ? get_u32(&header[20]) : num_of_up))
+		return -1;
+
+	ch->addr = block + STLINKY_RING_HEADER_SIZE +
+			((down ? num_of_up : 0) + channel) * STLINKY_RING_CHANNEL_SIZE;
+	if (mem_read(ch->addr, desc, sizeof(desc)) < 0)
+		return -1;
+	ch->offset = get_u32(&desc[0]);
+	ch->size = get_u32(&desc[4]);
+	ch->wr_off = get_u32(&desc[8]);
+	ch->rd_off = get_u32(&desc[12]);
+	ch->mode = get_u32(&desc[16]);
+	ch->dropped = get_u32(&desc[20]);
+	if (ch->size < 2 || ch->wr_off >= ch->size || ch->rd_off >= ch->size)
+		return -1;
+	return 0;
+}
+
+static int write_offset(const struct ring_channel * ch, int wr, uint32_t value)
+{
+	uint8_t buf[4];
+
+	put_u32(buf, value);
+	return mem_write(ch->addr + (wr ? 8 : 12), buf, sizeof(buf));
+}
+
+/**
+ * @brief Check that a read offset is still in the bytes of the ring, from
+ * 		rd_off to wr_off
+ */
+static int in_window(const struct ring_channel * ch, uint32_t rd)
+{
+	return (ch->wr_off + ch->size - rd) % ch->size <=
+			(ch->wr_off + ch->size - ch->rd_off) % ch->size;
+}
+
+/**
+ * @brief Copy the bytes from rd to wr of a channel
+ * @return Number of bytes or -1 on read error
+ */
+static int read_data(uint32_t block, const struct ring_channel * ch, uint32_t rd,
+		uint8_t * buf)
+{
+	uint32_t len = (ch->wr_off + ch->size - rd) % ch->size;
+	uint32_t n = ch->size - rd;
+
+	if (n > len)
+		n = len;
+	if (mem_read(block + ch->offset + rd, buf, n) < 0 ||
+			mem_read(block + ch->offset, &buf[n], len - n) < 0)
+		return -1;
+	return len;
+}
+
+/**
+ * @brief Write text in the host to MCU channel, as much as fits
+ */
+static int write_down(uint32_t block, const char * text)
+{
+	struct ring_channel ch;
+	uint32_t len = strlen(text);
+	uint32_t avail, wr, n;
+
+	if (read_channel(block, 0, 1, &ch) < 0)
+		return -1;
+	avail = (ch.rd_off > ch.wr_off) ? ch.rd_off - ch.wr_off - 1 :
+			ch.size - 1 - ch.wr_off + ch.rd_off;
+	if (len > avail) {
+		fprintf(stderr, "Only %u of %u bytes fit in the down channel\n", avail, len);
+		len = avail;
+	}
+	wr = ch.wr_off;
+	n = ch.size - wr;
+	if (n > len)
+		n = len;
+	if (mem_write(block + ch.offset + wr, text, n) < 0 ||
+			mem_write(block + ch.offset, &text[n], len - n) < 0)
+		return -1;
+	return write_offset(&ch, 1, (wr + len) % ch.size);
+}
+
+int main(int argc, char ** argv)
+{
+	struct ring_channel ch;
+	const char * input = NULL;
+	uint8_t * buf;
+	uint32_t rd, dropped;
+	uint8_t channel = 0;
+	int follow = 0;
+	int write_back = 0;
+	long block;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:fwi:")) != -1) {
+		if (opt == 'c') {
+			channel = atoi(optarg);
+		}
+		else if (opt == 'f') {
+			follow = 1;
+		}
+		else if (opt == 'w') {
+			write_back = 1;
+		}
+		else if (opt == 'i') {
+			input = optarg;
+		}
+		else {
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "Usage: %s [-c channel] [-f] [-w] [-i text] ram.bin\n", argv[0]);
+		return 1;
+	}
+	if (!(m_mem = fopen(argv[optind], (write_back || input) ? "r+b" : "rb"))) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if ((block = find_block()) < 0) {
+		fprintf(stderr, "No control block in %s\n", argv[optind]);
+		return 1;
+	}
+	if (read_channel(block, channel, 0, &ch) < 0) {
+		fprintf(stderr, "Channel %d is not valid\n", channel);
+		return 1;
+	}
+	fprintf(stderr, "Control block at 0x%lx, channel %d: %u bytes, %s, %u bytes dropped\n",
+			block, channel, ch.size, ch.mode == STLINKY_RING_OVERWRITE ? "overwrite" : "drop",
+			ch.dropped);
+	if (input && write_down(block, input) < 0) {
+		fprintf(stderr, "Failed to write the down channel\n");
+		return 1;
+	}
+
+	buf = malloc(ch.size);
+	rd = ch.rd_off;
+	dropped = ch.dropped;
+	while (1) {
+		struct ring_channel check;
+		int len;
+
+		if (read_channel(block, channel, 0, &ch) < 0)
+			break;
+		/* the MCU moved rd_off past the read offset when it overwrote the
+		 * oldest bytes */
+		if (!in_window(&ch, rd))
+			rd = ch.rd_off;
+		len = read_data(block, &ch, rd, buf);
+		if (len < 0 || read_channel(block, channel, 0, &check) < 0)
+			break;
+		/* overwritten while they were copied */
+		if (!in_window(&check, rd))
+			continue;
+
+		fwrite(buf, 1, len, stdout);
+		fflush(stdout);
+		rd = (rd + len) % ch.size;
+		if (write_back && len)
+			write_offset(&ch, 0, rd);
+		if (check.dropped != dropped) {
+			fprintf(stderr, "\n[%u bytes dropped]\n", check.dropped - dropped);
+			dropped = check.dropped;
+		}
+		if (!follow)
+			break;
+		usleep(POLL_US);
+	}
+
+	free(buf);
+	fclose(m_mem);
+	return 0;
+}
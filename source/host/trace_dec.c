@@ -0,0 +1,366 @@
+/*
+ * trace_dec.c
+ *
+ * Decoder of the deferred log of USE_TRACE_LOG (see trace_log.h in the
+ * stm32f3_dimtass_lib). It reads the format strings from the .trace_fmt
+ * section of the firmware ELF, then reads the frames from the serial port
+ * or from a file and prints every record like printf would. A %s argument
+ * is printed if it points to a constant in the ELF. The text of printf
+ * between the frames is printed as it arrives, as soon as its first bytes
+ * can't be the start of a frame. Configure the serial port first, e.g.:
+ * 	stty -F /dev/ttyUSB0 115200 raw -echo
+ *
+ * Usage:
+ * 	./stm32f303xc-adc-dac-dsp-trace firmware.elf [/dev/ttyUSB0 | file]
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include "trace_log.h"
+
+#define SHT_NOBITS 8
+#define SHF_ALLOC 0x2
+/* The longest frame without the delimiters, longer chunks are text */
+#define MAX_CHUNK_SIZE (TRACE_LOG_COBS_SIZE - 2)
+/* The bytes that may still be a frame are printed as text after this time
+ * without new bytes, a frame doesn't pause */
+#define TEXT_TIMEOUT_MS 100
+
+struct elf_section {
+	const char * name;
+	uint32_t type;
+	uint64_t flags;
+	uint64_t addr;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct elf_file {
+	uint8_t * data;
+	size_t size;
+	struct elf_section * sections;
+	int num_of_sections;
+	const struct elf_section * fmt;
+};
+
+static inline uint16_t get_u16(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return get_u16(p) | ((uint32_t) get_u16(&p[2]) << 16);
+}
+
+static inline uint64_t get_u64(const uint8_t * p)
+{
+	return get_u32(p) | ((uint64_t) get_u32(&p[4]) << 32);
+}
+
+/**
+ * @brief Load an ELF file and its section headers. The firmware is ELF32,
+ * 		ELF64 is for tests with host binaries.
+ * @return 0 on success or -1
+ */
+static int elf_load(const char * filename, struct elf_file * elf)
+{
+	FILE * fp = fopen(filename, "rb");
+	const uint8_t * h;
+	uint64_t shoff;
+	uint16_t shentsize, shstrndx;
+	int is64;
+
+	if (!fp) {
+		perror(filename);
+		return -1;
+	}
+	fseek(fp, 0, SEEK_END);
+	elf->size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	elf->data = malloc(elf->size);
+	if (fread(elf->data, 1, elf->size, fp) != elf->size) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	h = elf->data;
+	if (elf->size < 64 || memcmp(h, "\x7f" "ELF", 4) || h[5] != 1) {
+		fprintf(stderr, "%s is not a little endian ELF\n", filename);
+		return -1;
+	}
+	is64 = (h[4] == 2);
+	shoff = is64 ? get_u64(&h[0x28]) : get_u32(&h[0x20]);
+	shentsize = get_u16(&h[is64 ? 0x3A : 0x2E]);
+	elf->num_of_sections = get_u16(&h[is64 ? 0x3C : 0x30]);
+	shstrndx = get_u16(&h[is64 ? 0x3E : 0x32]);
+	if (shoff + (uint64_t) elf->num_of_sections * shentsize > elf->size ||
+			shstrndx >= elf->num_of_sections) {
+		fprintf(stderr, "%s has no valid section headers\n", filename);
+		return -1;
+	}
+
+	elf->sections = calloc(elf->num_of_sections, sizeof(struct elf_section));
+	for (int i=0; i<elf->num_of_sections; i++) {
+		const uint8_t * sh = &h[shoff + i * shentsize];
+		struct elf_section * s = &elf->sections[i];
+
+		s->name = (const char *) (uintptr_t) get_u32(sh);
+		s->type = get_u32(&sh[4]);
+		s->flags = is64 ? get_u64(&sh[8]) : get_u32(&sh[8]);
+		s->addr = is64 ? get_u64(&sh[0x10]) : get_u32(&sh[0x0C]);
+		s->offset = is64 ? get_u64(&sh[0x18]) : get_u32(&sh[0x10]);
+		s->size = is64 ? get_u64(&sh[0x20]) : get_u32(&sh[0x14]);
+		if (s->type != SHT_NOBITS && s->offset + s->size > elf->size)
+			s->size = 0;
+	}
+	/* the names are offsets in the string table */
+	for (int i=0; i<elf->num_of_sections; i++) {
+		struct elf_section * s = &elf->sections[i];
+		uint64_t name = elf->sections[shstrndx].offset + (uintptr_t) s->name;
+
+		s->name = (name < elf->size) ? (const char *) &elf->data[name] : "";
+		if (!strcmp(s->name, ".trace_fmt"))
+			elf->fmt = s;
+	}
+	if (!elf->fmt || !elf->fmt->size) {
+		fprintf(stderr, "%s has no .trace_fmt section, build it with USE_TRACE_LOG=ON\n",
+				filename);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Find a constant string in the loaded sections of the ELF
+ * @return The string or NULL
+ */
+static const char * elf_string(const struct elf_file * elf, uint32_t addr)
+{
+	for (int i=0; i<elf->num_of_sections; i++) {
+		const struct elf_section * s = &elf->sections[i];
+
+		if (!(s->flags & SHF_ALLOC) || s->type == SHT_NOBITS ||
+				addr < s->addr || addr >= s->addr + s->size)
+			continue;
+		const char * str = (const char *) &elf->data[s->offset + addr - s->addr];
+		/* it must end in the section */
+		if (memchr(str, 0, s->addr + s->size - addr))
+			return str;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Print a record like printf, with the 32-bit arguments
+ */
+static void print_record(const struct elf_file * elf, uint32_t id, const uint32_t * args,
+		int num_of_args)
+{
+	const char * fmt;
+	const char * end;
+	int arg = 0;
+
+	if (id == TRACE_LOG_ID_DROPPED) {
+		fprintf(stderr, "[%u records dropped since boot]\n", num_of_args ? args[0] : 0);
+		return;
+	}
+	if (id < elf->fmt->addr || id >= elf->fmt->addr + elf->fmt->size) {
+		fprintf(stderr, "[unknown message 0x%x, is the ELF of the firmware?]\n", id);
+		return;
+	}
+	fmt = (const char *) &elf->data[elf->fmt->offset + id - elf->fmt->addr];
+	end = (const char *) &elf->data[elf->fmt->offset + elf->fmt->size];
+
+	while (fmt < end && *fmt) {
+		char spec[32];
+		size_t n = 0;
+
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+		spec[n++] = *fmt++;
+		while (fmt < end && *fmt && strchr("-+ #0123456789.hlzjt", *fmt)) {
+			char c = *fmt++;
+			/* the flags, the width and the precision, the length is dropped
+			 * because the arguments are 32-bit */
+			if (!strchr("hlzjt", c) && n < sizeof(spec) - 2)
+				spec[n++] = c;
+		}
+		if (fmt >= end || !*fmt)
+			break;
+		char conv = *fmt++;
+
+		if (conv == '%') {
+			putchar('%');
+			continue;
+		}
+		if (arg >= num_of_args) {
+			printf("<?>");
+			continue;
+		}
+		uint32_t value = args[arg++];
+		switch (conv) {
+		case 'd':
+		case 'i':
+			spec[n++] = 'd';
+			spec[n] = 0;
+			printf(spec, (int32_t) value);
+			break;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			spec[n++] = conv;
+			spec[n] = 0;
+			printf(spec, value);
+			break;
+		case 'c':
+			spec[n++] = 'c';
+			spec[n] = 0;
+			printf(spec, (int) (value & 0xFF));
+			break;
+		case 's': {
+			const char * str = elf_string(elf, value);
+			if (str) {
+				spec[n++] = 's';
+				spec[n] = 0;
+				printf(spec, str);
+			}
+			else {
+				printf("<0x%08x>", value);
+			}
+			break;
+		}
+		case 'p':
+			printf("0x%08x", value);
+			break;
+		default:
+			/* e.g. a float, that was cast to an integer */
+			printf("<%%%c 0x%08x>", conv, value);
+			break;
+		}
+	}
+	fflush(stdout);
+}
+
+/**
+ * @brief Check if the bytes after a delimiter can't be the start of a frame.
+ * 		A frame starts with the COBS code of the type, which is not 0x00,
+ * 		and the type.
+ */
+static int chunk_is_text(const uint8_t * chunk, size_t len)
+{
+	return len > MAX_CHUNK_SIZE || chunk[0] < 2 ||
+			(len > 1 && chunk[1] != TRACE_LOG_FRAME_TYPE);
+}
+
+/**
+ * @brief Print the bytes between two delimiters that look like a frame, a
+ * 		record or text
+ * @return 1 for a record, 0 for text and -1 for a frame with bad CRC
+ */
+static int handle_chunk(const struct elf_file * elf, const uint8_t * chunk, size_t len)
+{
+	uint8_t frame[MAX_CHUNK_SIZE];
+	uint32_t args[TRACE_LOG_MAX_ARGS];
+	int size = cobs_frame_decode(chunk, len, frame);
+
+	if (size >= TRACE_LOG_FRAME_SIZE(0) && frame[0] == TRACE_LOG_FRAME_TYPE) {
+		uint32_t header = get_u32(&frame[1]);
+		int num_of_args = header >> TRACE_LOG_NUM_OF_ARGS_SHIFT;
+
+		if (num_of_args <= TRACE_LOG_MAX_ARGS && size == TRACE_LOG_FRAME_SIZE(num_of_args)) {
+			if (cobs_frame_crc16(frame, size - 2) != get_u16(&frame[size - 2]))
+				return -1;
+			for (int i=0; i<num_of_args; i++)
+				args[i] = get_u32(&frame[5 + i * 4]);
+			print_record(elf, header & TRACE_LOG_ID_MASK, args, num_of_args);
+			return 1;
+		}
+	}
+	fwrite(chunk, 1, len, stdout);
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	static uint8_t chunk[MAX_CHUNK_SIZE + 1];
+	struct elf_file elf;
+	uint32_t records = 0;
+	uint32_t bad = 0;
+	size_t len = 0;
+	/* the bytes since the last delimiter are text */
+	int text = 0;
+
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s firmware.elf [/dev/ttyUSB0 | file]\n", argv[0]);
+		return 1;
+	}
+	memset(&elf, 0, sizeof(elf));
+	if (elf_load(argv[1], &elf) < 0)
+		return 1;
+	if (argc == 3 && !freopen(argv[2], "rb", stdin)) {
+		perror(argv[2]);
+		return 1;
+	}
+
+	while (1) {
+		struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+		uint8_t buf[512];
+		ssize_t n;
+
+		if (poll(&pfd, 1, TEXT_TIMEOUT_MS) == 0) {
+			/* e.g. a prompt without a newline */
+			if (len) {
+				fwrite(chunk, 1, len, stdout);
+				fflush(stdout);
+				len = 0;
+				text = 1;
+			}
+			continue;
+		}
+		n = read(STDIN_FILENO, buf, sizeof(buf));
+		if (n <= 0)
+			break;
+		for (ssize_t i=0; i<n; i++) {
+			if (!buf[i]) {
+				if (len) {
+					int ret = handle_chunk(&elf, chunk, len);
+					if (ret > 0)
+						records++;
+					else if (ret < 0)
+						bad++;
+				}
+				len = 0;
+				text = 0;
+			}
+			else if (text) {
+				putchar(buf[i]);
+			}
+			else {
+				chunk[len++] = buf[i];
+				if (chunk_is_text(chunk, len)) {
+					fwrite(chunk, 1, len, stdout);
+					len = 0;
+					text = 1;
+				}
+			}
+		}
+		fflush(stdout);
+	}
+	if (len)
+		handle_chunk(&elf, chunk, len);
+
+	fprintf(stderr, "%u records, %u frames with bad CRC\n", records, bad);
+	free(elf.sections);
+	free(elf.data);
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * cobs_frame.h
+ *
+ * Copyright 2018 Dimitris Tassopoulos
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Framing of the binary streams on the debug UART. A frame is the payload
+ * and a CRC-16/CCITT-FALSE, COBS encoded between two 0x00 delimiters. The
+ * encoded frame has no other 0x00, so a reader finds the next frame after
+ * any lost byte, and the text that is printed between two frames is a
+ * chunk of its own. It's only inline functions, so the host tools use the
+ * same code as the firmware.
+ *
+ * Usage:
+ * 	// firmware, raw has the payload and two more bytes
+ * 	uint16_t crc = cobs_frame_crc16(raw, len);
+ * 	raw[len++] = crc & 0xFF;
+ * 	raw[len++] = crc >> 8;
+ * 	send(frame, cobs_frame_encode(raw, len, frame));
+ * 	// host, for every chunk between two delimiters
+ * 	int size = cobs_frame_decode(chunk, chunk_len, buffer);
+ */
+
+#ifndef COBS_FRAME_H_
+#define COBS_FRAME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The largest encoded frame of LEN bytes, with the COBS overhead and both
+ * delimiters */
+#define COBS_FRAME_ENCODED_SIZE(LEN) ((LEN) + (LEN) / 254 + 3)
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ */
+static inline uint16_t cobs_frame_crc16(const uint8_t * buffer, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (size_t i=0; i<len; i++) {
+		crc ^= (uint16_t) buffer[i] << 8;
+		for (int b=0; b<8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+/**
+ * @brief COBS encode a buffer between two 0x00 delimiters
+ * @param[in] src The frame
+ * @param[in] len The length of the frame
+ * @param[out] dst The encoded frame, COBS_FRAME_ENCODED_SIZE(len) bytes
+ * @return The encoded length
+ */
+static inline size_t cobs_frame_encode(const uint8_t * src, size_t len, uint8_t * dst)
+{
+	uint8_t * code = &dst[1];
+	uint8_t * p = &dst[2];
+	uint8_t n = 1;
+
+	dst[0] = 0;
+	for (size_t i=0; i<len; i++) {
+		if (src[i]) {
+			*p++ = src[i];
+			n++;
+		}
+		if (!src[i] || n == 0xFF) {
+			*code = n;
+			code = p++;
+			n = 1;
+		}
+	}
+	*code = n;
+	*p++ = 0;
+	return p - dst;
+}
+
+/**
+ * @brief Decode the bytes between two delimiters. The decoded frame is
+ * 		never longer, so src and dst can be the same buffer.
+ * @param[in] src The encoded bytes, without the delimiters
+ * @param[in] len The number of encoded bytes
+ * @param[out] dst The decoded frame, len bytes
+ * @return The decoded length or -1 if the bytes are not a COBS frame
+ */
+static inline int cobs_frame_decode(const uint8_t * src, size_t len, uint8_t * dst)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < len) {
+		uint8_t code = src[in++];
+
+		if (!code || in + code - 1 > len)
+			return -1;
+		for (int i=1; i<code; i++)
+			dst[out++] = src[in++];
+		if (code < 0xFF && in < len)
+			dst[out++] = 0;
+	}
+	return (int) out;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COBS_FRAME_H_ */
@@ -31,19 +31,19 @@ extern "C" {
 
 #include <stddef.h>
 #include <stdint.h>
+#include "spsc_ring.h"
 
 /**
- * @brief This is a struct that is used for UART comms
+ * @brief This is a struct that is used for UART comms. The TX bytes go
+ * 		through tx_ring, which uses tx_buffer, so tx_buffer_size must be a
+ * 		power of two.
  */
 struct tp_comm_buffer {
 	/* tx vars */
 	uint8_t 	*tx_buffer;
 	size_t		tx_buffer_size;
 	uint8_t 	tx_ready;
-	uint16_t 	tx_ptr_in;
-	uint16_t 	tx_ptr_out;
-	uint16_t 	tx_length;
-	uint8_t  	tx_int_en;
+	struct spsc_ring tx_ring;
 	/* rx vars */
 	uint8_t 	*rx_buffer;
 	size_t		rx_buffer_size;
@@ -60,6 +60,7 @@ struct tp_comm_buffer {
 	volatile struct tp_comm_buffer NAME = { \
 		.tx_buffer = comm_tx_buffer_##NAME, \
 		.tx_buffer_size = TX_SIZE, \
+		.tx_ring = { comm_tx_buffer_##NAME, (TX_SIZE) - 1, 0, 0 }, \
 		.rx_buffer = comm_rx_buffer_##NAME, \
 		.rx_buffer_size = RX_SIZE \
 	}
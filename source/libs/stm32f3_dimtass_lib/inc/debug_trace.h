@@ -32,7 +32,13 @@
 
 #ifdef DEBUG_TRACE
 #define TRACE(X) TRACEL(TRACE_LEVEL_DEFAULT, X)
+#ifdef USE_TRACE_LOG
+/* Deferred binary log, the format is done by the host (see trace_log.h) */
+#include "trace_log.h"
+#define TRACEL(TRACE_LEVEL, X) do { if (trace_levels & TRACE_LEVEL) TRACE_LOG X;} while(0)
+#else
 #define TRACEL(TRACE_LEVEL, X) do { if (trace_levels & TRACE_LEVEL) printf X;} while(0)
+#endif
 #else
 #define TRACE(X)
 #define TRACEL(X,Y)
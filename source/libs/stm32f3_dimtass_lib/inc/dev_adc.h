@@ -20,27 +20,35 @@
  * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  * 
- * This is a custom library for the ADCs of the stm32f103c8
- * 
+ * This is a custom library for the ADC1 of the stm32f303. The added channels
+ * are converted in one regular sequence (scan) on every trigger, or
+ * continuously without a trigger. The DMA writes the results in a circular
+ * buffer, one scan after the other, so the samples of the channels are
+ * interleaved in the order that they were added. With adc_enable_irq() the
+ * DMA half and full transfer interrupts are enabled and the application
+ * processes the half buffers in DMA1_Channel1_IRQHandler().
+ *
  * Created on: 14 May 2018
  * Author: Dimitris Tassopoulos <dimtass@gmail.com>
- * 
+ *
  * Usage:
- * // Decalre callback
- * void adc_cbk(struct adc_channel * adc, uint16_t value);
- * // Declare channel
- * DECLARE_ADC_CH(adc_temp, ADC_Channel_0, GPIOA, GPIO_Pin_0);
- * 
- * // Initialize adc in main:
- * 	adc_module_init();
- *	ADC_TempSensorVrefintCmd(ENABLE);
+ * // Declare channels
+ * DECLARE_ADC_CH(adc_in1, ADC_Channel_1, GPIOA, GPIO_Pin_0);
+ * DECLARE_ADC_CH(adc_temp, ADC_Channel_TempSensor, NULL, 0);
+ *
+ * // Initialize adc in main, with 2 * 32 scans per TIM1 TRGO
+ *	static uint16_t buffer[2 * 32 * 2];
+ *	adc_module_init(buffer, 2 * 32, ADC_ExternalTrigConvEvent_9);
+ *	adc_set_sample_time(ADC_SampleTime_19Cycles5);
+ *	adc_add_channel(&adc_in1);
  *	adc_add_channel(&adc_temp);
+ *	adc_enable_irq(0);
  *	adc_start();
  *
- * // callback example
- * void adc_cbk(struct adc_channel * adc, uint16_t value)
- * {
- * }
+ * // or a single scan in continuous mode
+ *	adc_module_init(NULL, 1, ADC_TRIGGER_NONE);
+ *	...
+ *	uint16_t value = adc_get_value(adc_temp.index);
  */
 
 #ifndef DEV_ADC_H_
@@ -54,7 +62,11 @@
 
 struct adc_channel;
 
-#define ADC_CH(OWNER, CHANNEL, ENABLE) { OWNER, CHANNEL, ENABLE, 0, 0 }
+/* The max length of the regular sequence */
+#define ADC_CH_NUM	16
+
+/* No external trigger, the ADC converts continuously */
+#define ADC_TRIGGER_NONE	0xFFFFFFFF
 
 #define DECLARE_ADC_CH(NAME, CHANNEL, PORT, PIN) \
 	struct adc_channel NAME = { \
@@ -66,19 +78,20 @@ struct adc_channel;
 
 struct adc_channel {
 	uint8_t	channel;			/* the ADC channel */
-	uint8_t index;				/* this is the index in the ADC DMA buffer */
-	volatile uint16_t value;
+	uint8_t index;				/* the rank in the sequence, 0 if not added */
 
-    GPIO_TypeDef *      port;   /* ADC channel port */
+    GPIO_TypeDef *      port;   /* ADC channel port or NULL for the internal channels */
     uint16_t            pin;    /* ADC channel pin */
 };
 
-void adc_module_init(void);
+void adc_module_init(uint16_t * buffer, uint16_t num_of_scans, uint32_t trigger);
+void adc_set_sample_time(uint8_t sample_time);
+void adc_enable_irq(uint8_t priority);
 void adc_start(void);
 void adc_stop(void);
 void adc_add_channel(struct adc_channel * channel);
 void adc_del_channel(struct adc_channel * channel);
-uint16_t adc_get_value(uint8_t channel);
+uint16_t adc_get_value(uint8_t index);
 uint8_t adc_get_num_of_channels(void);
 
 #endif /* DEV_ADC_H_ */
@@ -21,7 +21,7 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *
  * Usage:
- * // Declare uart
+ * // Declare uart, the buffer size is a power of two (see spsc_ring.h)
  * DECLARE_UART_DEV(dbg_uart, USART1, 115200, 256, 10, 1);
  * // setup uart port
  * dev_uart_add(&dbg_uart);
@@ -38,6 +38,18 @@
  * 		debug_uart_rx_poll()
  * Add this function in the interrupt handler of the used UART port
  * 		debug_uart_irq()
+ *
+ * DMA mode (needs USE_DBGUART_DMA):
+ * DECLARE_UART_DEV_DMA(dbg_uart, USART1, 2000000, 256, 10, 1);
+ * The TX ring is sent with DMA, one contiguous span of the ring per transfer
+ * (spsc_ring_peek()), and the next span is started from the transfer complete
+ * interrupt. The RX
+ * DMA writes in a circular buffer all the time, also while the port is
+ * transmitting. dev_uart_update() calls the callback with the new bytes when
+ * the RX line goes idle, or when half of the buffer is filled. If more than
+ * a full buffer arrives between two calls, the bytes are dropped and the
+ * overrun is counted in rx_dma_overruns and printed. The DMA channels are
+ * DMA1 Ch4/Ch5 for USART1 and DMA1 Ch7/Ch6 for USART2.
  */
 
 #ifndef DEV_UART_H_
@@ -53,7 +65,7 @@ extern "C" {
 #include "stm32f30x.h"
 #include "comm_buffer.h"
 
-#define DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG) \
+#define __DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG, DMA) \
 	struct dev_uart NAME = { \
 		.port = PORT, \
 		.config = { \
@@ -66,6 +78,7 @@ extern "C" {
 		}, \
 		.debug = DEBUG, \
 		.timeout_ms = TIMEOUT_MS, \
+		.dma = DMA, \
 		.uart_buff = { \
 			.tx_buffer_size = BUFFER_SIZE, \
 			.rx_buffer_size = BUFFER_SIZE, \
@@ -73,6 +86,14 @@ extern "C" {
 		.fp_dev_uart_cb = NULL, \
 	}
 
+#define DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG) \
+	__DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG, 0)
+
+#ifdef USE_DBGUART_DMA
+#define DECLARE_UART_DEV_DMA(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG) \
+	__DECLARE_UART_DEV(NAME, PORT, BAUDRATE, BUFFER_SIZE, TIMEOUT_MS, DEBUG, 1)
+#endif
+
 /**
  * @brief Callback function definition for reception
  * @param[in] buffer Pointer to the RX buffer
@@ -87,7 +108,19 @@ struct dev_uart {
 	uint8_t				debug;
 	uint8_t				timeout_ms;
 	uint8_t				available;
+	uint8_t				dma;
 	volatile struct tp_comm_buffer uart_buff;
+	/* DMA mode: the channels, the circular RX buffer of the DMA and its
+	 * read index, the half buffer marks that the RX DMA passed and are not
+	 * read yet, the RX overruns, and the length of the running TX transfer
+	 * (0 when idle) */
+	DMA_Channel_TypeDef*	dma_tx;
+	DMA_Channel_TypeDef*	dma_rx;
+	uint8_t*			rx_dma_buffer;
+	uint16_t			rx_dma_ptr_out;
+	volatile int32_t	rx_dma_halves;
+	uint32_t			rx_dma_overruns;
+	volatile uint16_t	tx_dma_len;
 	/**
 	* @brief Callback function definition for reception
 	* @param[in] buffer Pointer to the RX buffer
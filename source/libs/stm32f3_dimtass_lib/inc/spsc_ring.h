@@ -0,0 +1,255 @@
+/*
+ * spsc_ring.h
+ *
+ * Copyright 2018 Dimitris Tassopoulos
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Lock-free single producer, single consumer byte ring. The size is a power
+ * of two and the head and the tail are free running counters, so an index
+ * is a mask and not a division, the count is head - tail and the ring can
+ * use all of its bytes. Only the producer writes the head and only the
+ * consumer writes the tail, so e.g. the main loop can write while the
+ * interrupt reads without disabling the interrupts. A barrier orders the
+ * data and the counters, so it also works between two threads on the host.
+ *
+ * Besides the byte and bulk copies, spsc_ring_peek() and spsc_ring_reserve()
+ * return the contiguous span at the tail or the head, e.g. for a DMA
+ * transfer, and spsc_ring_consume() and spsc_ring_commit() release it.
+ *
+ * Usage:
+ * 	uint8_t buffer[256];
+ * 	struct spsc_ring ring;
+ * 	spsc_ring_init(&ring, buffer, sizeof(buffer));
+ * 	// producer
+ * 	spsc_ring_write(&ring, data, len);
+ * 	// consumer
+ * 	uint8_t * span;
+ * 	uint32_t n = spsc_ring_peek(&ring, &span);
+ * 	send(span, n);
+ * 	spsc_ring_consume(&ring, n);
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#define SPSC_RING_IS_POW2(N) ((N) && !((N) & ((N) - 1)))
+
+/* Orders the loads and the stores before it with the ones after it, except
+ * a store before a load, which the ring doesn't need. It's a dmb on the
+ * Cortex-M and only a compiler barrier on x86. */
+#define SPSC_RING_BARRIER() __atomic_thread_fence(__ATOMIC_ACQ_REL)
+
+struct spsc_ring {
+	uint8_t *			buffer;
+	uint32_t			mask;
+	/* free running, only the producer writes the head and only the
+	 * consumer writes the tail */
+	volatile uint32_t	head;
+	volatile uint32_t	tail;
+};
+
+/**
+ * @brief Initialize an empty ring
+ * @param[in] r The ring
+ * @param[in] buffer The memory of the ring
+ * @param[in] size The size of the buffer, a power of two
+ * @return 0 on success or -1 if the size is not a power of two
+ */
+static inline int spsc_ring_init(volatile struct spsc_ring * r, uint8_t * buffer, uint32_t size)
+{
+	if (!SPSC_RING_IS_POW2(size))
+		return -1;
+	r->buffer = buffer;
+	r->mask = size - 1;
+	r->head = 0;
+	r->tail = 0;
+	return 0;
+}
+
+static inline uint32_t spsc_ring_size(const volatile struct spsc_ring * r)
+{
+	return r->mask + 1;
+}
+
+/**
+ * @brief Number of bytes in the ring. For the consumer this is the minimum
+ * 		and for the producer the maximum, since the other side can move.
+ */
+static inline uint32_t spsc_ring_count(const volatile struct spsc_ring * r)
+{
+	return r->head - r->tail;
+}
+
+static inline uint32_t spsc_ring_free(const volatile struct spsc_ring * r)
+{
+	return r->mask + 1 - (r->head - r->tail);
+}
+
+/* Producer */
+
+/**
+ * @brief Add a byte
+ * @return 0 on success or -1 if the ring is full
+ */
+static inline int spsc_ring_push(volatile struct spsc_ring * r, uint8_t byte)
+{
+	uint32_t head = r->head;
+
+	if (head - r->tail > r->mask)
+		return -1;
+	/* the consumer read the byte before it moved the tail */
+	SPSC_RING_BARRIER();
+	r->buffer[head & r->mask] = byte;
+	SPSC_RING_BARRIER();
+	r->head = head + 1;
+	return 0;
+}
+
+/**
+ * @brief Get the contiguous free span at the head, up to the end of the
+ * 		buffer
+ * @param[out] span The start of the span
+ * @return The length of the span, 0 if the ring is full
+ */
+static inline uint32_t spsc_ring_reserve(volatile struct spsc_ring * r, uint8_t ** span)
+{
+	uint32_t head = r->head;
+	uint32_t index = head & r->mask;
+	uint32_t free = r->mask + 1 - (head - r->tail);
+	uint32_t end = r->mask + 1 - index;
+
+	SPSC_RING_BARRIER();
+	*span = &r->buffer[index];
+	return (free < end) ? free : end;
+}
+
+/**
+ * @brief Publish the bytes that were written in the reserved span
+ * @param[in] len Number of bytes, up to the length of the span
+ */
+static inline void spsc_ring_commit(volatile struct spsc_ring * r, uint32_t len)
+{
+	SPSC_RING_BARRIER();
+	r->head += len;
+}
+
+/**
+ * @brief Copy bytes in the ring, as many as fit
+ * @return The number of bytes that were copied
+ */
+static inline uint32_t spsc_ring_write(volatile struct spsc_ring * r, const uint8_t * data,
+		uint32_t len)
+{
+	uint32_t done = 0;
+
+	/* up to the end of the buffer, then from the start */
+	for (int i=0; i<2 && done < len; i++) {
+		uint8_t * span;
+		uint32_t n = spsc_ring_reserve(r, &span);
+
+		if (n > len - done)
+			n = len - done;
+		memcpy(span, &data[done], n);
+		spsc_ring_commit(r, n);
+		done += n;
+	}
+	return done;
+}
+
+/* Consumer */
+
+/**
+ * @brief Remove a byte
+ * @return 0 on success or -1 if the ring is empty
+ */
+static inline int spsc_ring_pop(volatile struct spsc_ring * r, uint8_t * byte)
+{
+	uint32_t tail = r->tail;
+
+	if (r->head == tail)
+		return -1;
+	SPSC_RING_BARRIER();
+	*byte = r->buffer[tail & r->mask];
+	SPSC_RING_BARRIER();
+	r->tail = tail + 1;
+	return 0;
+}
+
+/**
+ * @brief Get the contiguous span of bytes at the tail, up to the end of the
+ * 		buffer
+ * @param[out] span The start of the span
+ * @return The length of the span, 0 if the ring is empty
+ */
+static inline uint32_t spsc_ring_peek(volatile struct spsc_ring * r, uint8_t ** span)
+{
+	uint32_t tail = r->tail;
+	uint32_t index = tail & r->mask;
+	uint32_t count = r->head - tail;
+	uint32_t end = r->mask + 1 - index;
+
+	/* the bytes are read after the head */
+	SPSC_RING_BARRIER();
+	*span = &r->buffer[index];
+	return (count < end) ? count : end;
+}
+
+/**
+ * @brief Release the bytes at the tail after they were read
+ * @param[in] len Number of bytes, up to the length of the span
+ */
+static inline void spsc_ring_consume(volatile struct spsc_ring * r, uint32_t len)
+{
+	SPSC_RING_BARRIER();
+	r->tail += len;
+}
+
+/**
+ * @brief Copy bytes out of the ring, as many as there are
+ * @return The number of bytes that were copied
+ */
+static inline uint32_t spsc_ring_read(volatile struct spsc_ring * r, uint8_t * data, uint32_t len)
+{
+	uint32_t done = 0;
+
+	for (int i=0; i<2 && done < len; i++) {
+		uint8_t * span;
+		uint32_t n = spsc_ring_peek(r, &span);
+
+		if (n > len - done)
+			n = len - done;
+		memcpy(&data[done], span, n);
+		spsc_ring_consume(r, n);
+		done += n;
+	}
+	return done;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPSC_RING_H_ */
@@ -5,6 +5,7 @@
 #ifndef STLINKY_H
 #define STLINKY_H
 
+#include <stdint.h>
 
 #define STLINKY_MAGIC 0xDEADF00D
 
@@ -38,5 +39,85 @@ int stlinky_default_getchar(void);
 
 void stlinky_wait_for_terminal(volatile struct stlinky* st);
 
+/* Ring mode (USE_STTERM_RING)
+ *
+ * stlinky_tx() waits until the debugger has read the previous buffer, so a
+ * printf can block the main loop for as long as the debugger takes to poll.
+ * In the ring mode the console is a control block in RAM, stlinky_ring_cb,
+ * with STLINKY_RING_UP_CHANNELS channels from the MCU to the host and one
+ * channel from the host to the MCU. Every channel is a lock-free single
+ * producer, single consumer ring: the writer only moves wr_off and the
+ * reader only moves rd_off, so the host can read the rings through the
+ * debugger while the code runs, or from a RAM dump after a crash. A write
+ * never waits. If there's no room, the channel mode selects what happens:
+ * - STLINKY_RING_DROP: the whole write is dropped
+ * - STLINKY_RING_OVERWRITE: the oldest bytes are overwritten and the MCU
+ *   moves rd_off too. A host that reads at the same time must check that
+ *   rd_off didn't move while it was copying.
+ * The dropped or overwritten bytes are counted in the channel. Each channel
+ * must have one writer, e.g. printf uses channel 0 from the main loop and an
+ * interrupt can use channel 1.
+ *
+ * The data of the channels are in the control block, at offset from its
+ * start, so the host only needs the address of the block. It's found by
+ * the symbol in the ELF or by searching STLINKY_RING_ID in the RAM. All the
+ * fields are 32-bit little endian.
+ *
+ * Usage:
+ * 	stlinky_ring_init();
+ * 	stlinky_ring_set_mode(1, STLINKY_RING_OVERWRITE);
+ * 	printf("on channel 0\n");
+ * 	stlinky_ring_write(1, buffer, len);
+ * 	len = stlinky_ring_read(buffer, sizeof(buffer));
+ */
+#define STLINKY_RING_ID "STLINKY RING"
+#define STLINKY_RING_ID_SIZE 16
+
+#ifndef STLINKY_RING_UP_CHANNELS
+#define STLINKY_RING_UP_CHANNELS 2
+#endif
+
+/* Bytes per channel. A ring holds one byte less. */
+#ifndef STLINKY_RING_UP_SIZE
+#define STLINKY_RING_UP_SIZE 512
+#endif
+
+#ifndef STLINKY_RING_DOWN_SIZE
+#define STLINKY_RING_DOWN_SIZE 32
+#endif
+
+enum stlinky_ring_mode {
+	STLINKY_RING_DROP = 0,
+	STLINKY_RING_OVERWRITE,
+};
+
+struct stlinky_ring_channel {
+	/* offset of the data from the start of the control block */
+	uint32_t offset;
+	uint32_t size;
+	volatile uint32_t wr_off;
+	volatile uint32_t rd_off;
+	uint32_t mode;
+	volatile uint32_t dropped;
+};
+
+struct stlinky_ring {
+	char id[STLINKY_RING_ID_SIZE];
+	uint32_t num_of_up;
+	uint32_t num_of_down;
+	struct stlinky_ring_channel up[STLINKY_RING_UP_CHANNELS];
+	struct stlinky_ring_channel down[1];
+	char up_buf[STLINKY_RING_UP_CHANNELS][STLINKY_RING_UP_SIZE];
+	char down_buf[STLINKY_RING_DOWN_SIZE];
+};
+
+#define STLINKY_RING_HEADER_SIZE 24
+#define STLINKY_RING_CHANNEL_SIZE 24
+
+void stlinky_ring_init(void);
+int stlinky_ring_set_mode(uint8_t channel, enum stlinky_ring_mode mode);
+int stlinky_ring_write(uint8_t channel, const char * buf, int len);
+int stlinky_ring_read(char * buf, int len);
+
 #endif
 
@@ -0,0 +1,140 @@
+/*
+ * trace_log.h
+ *
+ * Copyright 2018 Dimitris Tassopoulos
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Deferred binary log. TRACE_LOG() doesn't format anything on the MCU. The
+ * format string is placed in the .trace_fmt section, which the linker script
+ * keeps in the ELF but not in the flash, and its address in the section is
+ * the ID of the message. A call only copies the ID and the arguments as
+ * 32-bit words in a ring, with the interrupts disabled for the copy, so it
+ * can be used in the interrupts too. trace_log_update() sends the records
+ * from the main loop and the host formats them with the strings of the ELF.
+ * With USE_TRACE_LOG the TRACE() and TRACEL() macros of debug_trace.h use
+ * TRACE_LOG() instead of printf.
+ *
+ * The arguments are the conversions of tiny_printf (cdisuxX). Up to
+ * TRACE_LOG_MAX_ARGS arguments are cast to uint32_t, so a float is truncated
+ * and a 64-bit integer loses the upper word. A %s argument is only the
+ * pointer, the host prints the string if it's a constant in the ELF.
+ *
+ * When the ring is full the record is dropped and counted, and the count is
+ * sent as a record with the ID TRACE_LOG_ID_DROPPED.
+ *
+ * Every record is sent as a COBS encoded frame with a 0x00 delimiter before
+ * and after it (see cobs_frame.h), so the text of printf between the frames
+ * is kept as text.
+ * The decoded frame is (little endian):
+ * 	u8 type         TRACE_LOG_FRAME_TYPE
+ * 	u32 header      ID, and the number of arguments in the upper 4 bits
+ * 	u32 args[]      the arguments
+ * 	u16 crc         CRC-16/CCITT-FALSE of all the bytes before
+ *
+ * Usage:
+ * 	// the callback takes the whole frame or nothing
+ * 	trace_log_init(&send_cbk);
+ * 	// anywhere, also in an interrupt
+ * 	TRACE_LOG("ADC overrun %d\n", count);
+ * 	// in the main loop
+ * 	trace_log_update();
+ */
+
+#ifndef TRACE_LOG_H_
+#define TRACE_LOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cobs_frame.h"
+
+/* The ring of the records in bytes, a power of two */
+#ifndef TRACE_LOG_BUFFER_SIZE
+#define TRACE_LOG_BUFFER_SIZE 1024
+#endif
+
+#define TRACE_LOG_MAX_ARGS 8
+#define TRACE_LOG_FRAME_TYPE 0x03
+#define TRACE_LOG_NUM_OF_ARGS_SHIFT 28
+#define TRACE_LOG_ID_MASK ((1 << TRACE_LOG_NUM_OF_ARGS_SHIFT) - 1)
+#define TRACE_LOG_ID_DROPPED TRACE_LOG_ID_MASK
+#define TRACE_LOG_FRAME_SIZE(ARGS) (1 + 4 + (ARGS) * 4 + 2)
+/* The largest encoded frame, with the COBS overhead and both delimiters */
+#define TRACE_LOG_COBS_SIZE COBS_FRAME_ENCODED_SIZE(TRACE_LOG_FRAME_SIZE(TRACE_LOG_MAX_ARGS))
+
+#define TRACE_LOG_ARG(X) (uint32_t) (uintptr_t) (X)
+#define TRACE_LOG_ARGS1(A) TRACE_LOG_ARG(A)
+#define TRACE_LOG_ARGS2(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS1(__VA_ARGS__)
+#define TRACE_LOG_ARGS3(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS2(__VA_ARGS__)
+#define TRACE_LOG_ARGS4(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS3(__VA_ARGS__)
+#define TRACE_LOG_ARGS5(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS4(__VA_ARGS__)
+#define TRACE_LOG_ARGS6(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS5(__VA_ARGS__)
+#define TRACE_LOG_ARGS7(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS6(__VA_ARGS__)
+#define TRACE_LOG_ARGS8(A, ...) TRACE_LOG_ARG(A), TRACE_LOG_ARGS7(__VA_ARGS__)
+
+#define TRACE_LOG_FMT(FMT) \
+	static const char trace_log_fmt[] __attribute__((section(".trace_fmt"), used)) = FMT
+
+#define TRACE_LOG_0(FMT) do { \
+	TRACE_LOG_FMT(FMT); \
+	trace_log_write(trace_log_fmt, NULL, 0); \
+} while (0)
+
+#define TRACE_LOG_N(N, FMT, ...) do { \
+	TRACE_LOG_FMT(FMT); \
+	const uint32_t trace_log_args[] = { TRACE_LOG_ARGS##N(__VA_ARGS__) }; \
+	trace_log_write(trace_log_fmt, trace_log_args, N); \
+} while (0)
+
+#define TRACE_LOG_1(FMT, ...) TRACE_LOG_N(1, FMT, __VA_ARGS__)
+#define TRACE_LOG_2(FMT, ...) TRACE_LOG_N(2, FMT, __VA_ARGS__)
+#define TRACE_LOG_3(FMT, ...) TRACE_LOG_N(3, FMT, __VA_ARGS__)
+#define TRACE_LOG_4(FMT, ...) TRACE_LOG_N(4, FMT, __VA_ARGS__)
+#define TRACE_LOG_5(FMT, ...) TRACE_LOG_N(5, FMT, __VA_ARGS__)
+#define TRACE_LOG_6(FMT, ...) TRACE_LOG_N(6, FMT, __VA_ARGS__)
+#define TRACE_LOG_7(FMT, ...) TRACE_LOG_N(7, FMT, __VA_ARGS__)
+#define TRACE_LOG_8(FMT, ...) TRACE_LOG_N(8, FMT, __VA_ARGS__)
+#define TRACE_LOG_SELECT(_0, _1, _2, _3, _4, _5, _6, _7, _8, NAME, ...) NAME
+
+/**
+ * @brief Log a message. The format must be a string literal and more than
+ * 		TRACE_LOG_MAX_ARGS arguments don't compile.
+ */
+#define TRACE_LOG(...) TRACE_LOG_SELECT(__VA_ARGS__, TRACE_LOG_8, TRACE_LOG_7, \
+		TRACE_LOG_6, TRACE_LOG_5, TRACE_LOG_4, TRACE_LOG_3, TRACE_LOG_2, \
+		TRACE_LOG_1, TRACE_LOG_0, 0)(__VA_ARGS__)
+
+/**
+ * @brief Send callback. It returns len if it took the frame, or 0.
+ */
+typedef size_t (*trace_log_send_t)(const uint8_t * buffer, size_t len);
+
+void trace_log_init(trace_log_send_t fp_send);
+void trace_log_write(const char * fmt, const uint32_t * args, uint8_t num_of_args);
+void trace_log_update(void);
+uint32_t trace_log_get_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_LOG_H_ */
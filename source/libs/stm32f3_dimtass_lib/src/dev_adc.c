@@ -6,33 +6,72 @@
  */
 
 #include "dev_adc.h"
-
-#define ADC1_DR_Address    ((uint32_t)0x4001244C)
-#define ADC2_DR_Address    ((uint32_t)0x4001284C)
-//#define ADC3_DR_Address    ((uint32_t)0x40013C4C)
+#include "cortexm_delay.h"
 
 static DMA_InitTypeDef 	_dma_conf = {0};
 static ADC_InitTypeDef	_adc_conf = {0};
 static uint8_t _adc_channels = 0;
+static struct adc_channel * _channels[ADC_CH_NUM];
+static uint8_t _sample_time = ADC_SampleTime_181Cycles5;
+static uint16_t _num_of_scans = 1;
+static uint8_t _dma_irq = 0;
+
+/* The buffer of a single scan, if the application doesn't give one */
+static uint16_t adc_buffer[ADC_CH_NUM];
+static uint16_t * _buffer = adc_buffer;
 
-#define ADC_CH_NUM	18
-uint16_t adc_buffer[ADC_CH_NUM];
+/**
+ * @brief Re-initialize the DMA for the current number of channels. DMA_Init()
+ * 		clears the interrupt enable bits, so they are set again.
+ */
+static void adc_dma_update(void)
+{
+	DMA_Cmd(DMA1_Channel1, DISABLE);
+	_dma_conf.DMA_BufferSize = _num_of_scans * _adc_channels;
+	DMA_Init(DMA1_Channel1, &_dma_conf);
+	if (_dma_irq)
+		DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+}
 
 /**
- * @brief  Initialize ADC module. This module is common for all channels
+ * @brief Set the length of the sequence and the rank of every channel
  */
-void adc_module_init(void)
+static void adc_sequence_update(void)
 {
-	RCC_ADCCLKConfig(RCC_PCLK2_Div6);
-	/* Enable ADCx and GPIOA clock */
-	RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
+	ADC_RegularChannelSequencerLengthConfig(ADC1, _adc_channels ? _adc_channels : 1);
+	for (int i=0; i<_adc_channels; i++) {
+		_channels[i]->index = i + 1;
+		ADC_RegularChannelConfig(ADC1, _channels[i]->channel, i + 1, _sample_time);
+	}
+	adc_dma_update();
+}
 
-    /* Enable ADC1 and GPIOA clock */
-	RCC_AHBPeriphClockCmd (RCC_AHBPeriph_DMA1, ENABLE);
-	_dma_conf.DMA_BufferSize = _adc_channels;
+/**
+ * @brief  Initialize ADC module. This module is common for all channels. The
+ * 		ADC clock is HCLK.
+ * @param[in] buffer The DMA buffer with num_of_scans * ADC_CH_NUM samples, or
+ * 		at least num_of_scans * the number of the added channels. With NULL
+ * 		an internal buffer of a single scan is used.
+ * @param[in] num_of_scans Number of scans in the buffer
+ * @param[in] trigger An ADC_ExternalTrigConvEvent_x on the rising edge, or
+ * 		ADC_TRIGGER_NONE for continuous conversions
+ */
+void adc_module_init(uint16_t * buffer, uint16_t num_of_scans, uint32_t trigger)
+{
+	ADC_CommonInitTypeDef adc_common_conf;
+
+	_buffer = buffer ? buffer : adc_buffer;
+	_num_of_scans = buffer ? num_of_scans : 1;
+
+	RCC_ADCCLKConfig(RCC_ADC12PLLCLK_Div2);
+	/* Enable ADC1/2 and DMA1 clock */
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_ADC12, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+	_dma_conf.DMA_BufferSize = 0;
 	_dma_conf.DMA_DIR = DMA_DIR_PeripheralSRC;
 	_dma_conf.DMA_M2M = DMA_M2M_Disable;
-	_dma_conf.DMA_MemoryBaseAddr = (uint32_t)adc_buffer;
+	_dma_conf.DMA_MemoryBaseAddr = (uint32_t)_buffer;
 	_dma_conf.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
 	_dma_conf.DMA_MemoryInc = DMA_MemoryInc_Enable;
 	_dma_conf.DMA_Mode = DMA_Mode_Circular;
@@ -40,103 +79,169 @@ void adc_module_init(void)
 	_dma_conf.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
 	_dma_conf.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
 	_dma_conf.DMA_Priority = DMA_Priority_High;
-	DMA_Init(DMA1_Channel1, &_dma_conf);
-
-	DMA_Cmd (DMA1_Channel1, ENABLE) ;
+	DMA_DeInit(DMA1_Channel1);
 
-	_adc_conf.ADC_ContinuousConvMode = ENABLE;
+	/* Calibration procedure, the regulator needs 10us */
+	ADC_VoltageRegulatorCmd(ADC1, ENABLE);
+	delay_us(10);
+	ADC_SelectCalibrationMode(ADC1, ADC_CalibrationMode_Single);
+	ADC_StartCalibration(ADC1);
+	while(ADC_GetCalibrationStatus(ADC1) != RESET);
+
+	ADC_CommonStructInit(&adc_common_conf);
+	adc_common_conf.ADC_Mode = ADC_Mode_Independent;
+	adc_common_conf.ADC_Clock = ADC_Clock_SynClkModeDiv1;
+	adc_common_conf.ADC_DMAAccessMode = ADC_DMAAccessMode_1;
+	adc_common_conf.ADC_DMAMode = ADC_DMAMode_OneShot;
+	adc_common_conf.ADC_TwoSamplingDelay = 0;
+	ADC_CommonInit(ADC1, &adc_common_conf);
+
+	ADC_StructInit(&_adc_conf);
+	if (trigger == ADC_TRIGGER_NONE) {
+		_adc_conf.ADC_ContinuousConvMode = ADC_ContinuousConvMode_Enable;
+		_adc_conf.ADC_ExternalTrigEventEdge = ADC_ExternalTrigEventEdge_None;
+	}
+	else {
+		_adc_conf.ADC_ContinuousConvMode = ADC_ContinuousConvMode_Disable;
+		_adc_conf.ADC_ExternalTrigConvEvent = trigger;
+		_adc_conf.ADC_ExternalTrigEventEdge = ADC_ExternalTrigEventEdge_RisingEdge;
+	}
+	_adc_conf.ADC_Resolution = ADC_Resolution_12b;
 	_adc_conf.ADC_DataAlign = ADC_DataAlign_Right;
-	_adc_conf.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
-	_adc_conf.ADC_Mode = ADC_Mode_Independent;
-	_adc_conf.ADC_NbrOfChannel = 0;
-	_adc_conf.ADC_ScanConvMode = ENABLE;
+	_adc_conf.ADC_OverrunMode = ADC_OverrunMode_Disable;
+	_adc_conf.ADC_AutoInjMode = ADC_AutoInjec_Disable;
+	_adc_conf.ADC_NbrOfRegChannel = 1;
 	ADC_Init(ADC1, &_adc_conf);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_0, 1, ADC_SampleTime_239Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_TempSensor, 2, ADC_SampleTime_239Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_0, 1, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 2, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_2, 3, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_3, 4, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_4, 5, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_5, 6, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_6, 7, ADC_SampleTime_7Cycles5);
-	// ADC_RegularChannelConfig(ADC1, ADC_Channel_7, 8, ADC_SampleTime_7Cycles5);
-	ADC_Cmd(ADC1 ,ENABLE );
-	ADC_DMACmd(ADC1, ENABLE );
-	ADC_ResetCalibration(ADC1);
-	while(ADC_GetResetCalibrationStatus(ADC1));
-	ADC_StartCalibration(ADC1);
-	while(ADC_GetCalibrationStatus(ADC1));
-	ADC_SoftwareStartConvCmd(ADC1, ENABLE) ;
+
+	ADC_Cmd(ADC1, ENABLE);
+	while(!ADC_GetFlagStatus(ADC1, ADC_FLAG_RDY));
+	ADC_DMACmd(ADC1, ENABLE);
+	ADC_DMAConfig(ADC1, ADC_DMAMode_Circular);
+}
+
+/**
+ * @brief Set the sample time of all the channels. Call it while the ADC is
+ * 		stopped.
+ * @param[in] sample_time One of ADC_SampleTime_xCycles5
+ */
+void adc_set_sample_time(uint8_t sample_time)
+{
+	_sample_time = sample_time;
+	for (int i=0; i<_adc_channels; i++)
+		ADC_RegularChannelConfig(ADC1, _channels[i]->channel, i + 1, _sample_time);
 }
 
+/**
+ * @brief Enable the DMA half and full transfer interrupts. The application
+ * 		handles them in DMA1_Channel1_IRQHandler().
+ * @param[in] priority The preemption priority
+ */
+void adc_enable_irq(uint8_t priority)
+{
+	NVIC_InitTypeDef NVIC_InitStructure;
+
+	_dma_irq = 1;
+	DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
+
+	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = priority;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+}
 
 /**
- * @brief Start ADC module
+ * @brief Start ADC module. The DMA starts from the beginning of the buffer.
  */
 void adc_start(void)
 {
-	ADC_Cmd(ADC1 ,ENABLE );
-	ADC_DMACmd(ADC1, ENABLE );
-	ADC_ResetCalibration(ADC1);
-	while(ADC_GetResetCalibrationStatus(ADC1));
-	ADC_StartCalibration(ADC1);
-	while(ADC_GetCalibrationStatus(ADC1));
-	ADC_SoftwareStartConvCmd(ADC1, ENABLE) ;
+	if (!_adc_channels)
+		return;
+	DMA_Cmd(DMA1_Channel1, DISABLE);
+	DMA_SetCurrDataCounter(DMA1_Channel1, _num_of_scans * _adc_channels);
+	DMA_Cmd(DMA1_Channel1, ENABLE);
+	ADC_StartConversion(ADC1);
 }
 
 /**
- * @brief Stop ADC module
+ * @brief Stop ADC module. A pending DMA interrupt is cleared, but not a
+ * 		pending IRQ in the NVIC.
  */
 void adc_stop(void)
 {
-	ADC_Cmd(ADC1 ,DISABLE);
-	ADC_DMACmd(ADC1, DISABLE);
-	ADC_SoftwareStartConvCmd(ADC1, DISABLE) ;
+	ADC_StopConversion(ADC1);
+	while (ADC_GetStartConversionStatus(ADC1) != RESET);
+	/* a conversion that ended after the stop is not read by the DMA */
+	ADC_ClearFlag(ADC1, ADC_FLAG_EOC | ADC_FLAG_OVR);
+	DMA_Cmd(DMA1_Channel1, DISABLE);
+	DMA_ClearITPendingBit(DMA1_IT_GL1);
 }
 
 
 /**
- * @brief Add ADC channel to module
+ * @brief Add ADC channel to module. The channel is added at the end of the
+ * 		sequence. Call it while the ADC is stopped.
  * @param[in] ch Channel to add to module
  */
 void adc_add_channel(struct adc_channel * ch)
 {
+	if (_adc_channels >= ADC_CH_NUM)
+		return;
+
 	/* Check if pins are needed to setup */
 	if (ch->port) {
 		GPIO_InitTypeDef GPIO_InitStructure;
-		RCC_APB2PeriphClockCmd ( RCC_APB2Periph_GPIOA | RCC_APB2Periph_AFIO, ENABLE ) ;
+		/* the GPIOx clock bits follow the GPIOx base addresses */
+		RCC_AHBPeriphClockCmd(RCC_AHBPeriph_GPIOA <<
+				(((uint32_t) ch->port - GPIOA_BASE) / (GPIOB_BASE - GPIOA_BASE)), ENABLE);
 		GPIO_InitStructure.GPIO_Pin = ch->pin;
-		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;
-		GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+		GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+		GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
 		GPIO_Init(ch->port, &GPIO_InitStructure);
 	}
-	/* increment index and channels */
-	ch->index = ++_adc_channels;
-
-	DMA_Cmd (DMA1_Channel1, DISABLE);
-	_dma_conf.DMA_BufferSize = _adc_channels;
-	DMA_Init(DMA1_Channel1, &_dma_conf);
-	DMA_Cmd (DMA1_Channel1, ENABLE);
-
-	_adc_conf.ADC_NbrOfChannel = _adc_channels;
-	ADC_Init(ADC1, &_adc_conf);
-
-	ADC_RegularChannelConfig(ADC1, ch->channel, ch->index, ADC_SampleTime_239Cycles5);
+	else if (ch->channel == ADC_Channel_TempSensor)
+		ADC_TempSensorCmd(ADC1, ENABLE);
+	else if (ch->channel == ADC_Channel_Vrefint)
+		ADC_VrefintCmd(ADC1, ENABLE);
+	else if (ch->channel == ADC_Channel_Vbat)
+		ADC_VbatCmd(ADC1, ENABLE);
+
+	_channels[_adc_channels++] = ch;
+	adc_sequence_update();
 	TRACEL(TRACE_LEVEL_ADC, ("ADC:add->%d-%d\n", ch->channel, ch->index));
+}
 
+/**
+ * @brief Remove ADC channel from module. The next channels move one rank
+ * 		up, so their index changes. Call it while the ADC is stopped.
+ * @param[in] ch Channel to remove from module
+ */
+void adc_del_channel(struct adc_channel * ch)
+{
+	if (!ch->index || ch->index > _adc_channels || _channels[ch->index - 1] != ch)
+		return;
+
+	TRACEL(TRACE_LEVEL_ADC, ("ADC:del->%d-%d\n", ch->channel, ch->index));
+	for (int i=ch->index; i<_adc_channels; i++)
+		_channels[i - 1] = _channels[i];
+	_adc_channels--;
+	ch->index = 0;
+	adc_sequence_update();
 }
 
 /**
- * @brief Get the value of the ADC channel index
+ * @brief Get the value of the ADC channel index from the last complete scan
  * @param[in] index The index of the channel
  */
 inline uint16_t adc_get_value(uint8_t index)
 {
-	if (!index || (index > ADC_CH_NUM))
+	if (!index || (index > _adc_channels))
 		return 0;
-	else
-		return adc_buffer[index - 1];
+
+	uint32_t pos = _num_of_scans * _adc_channels - DMA_GetCurrDataCounter(DMA1_Channel1);
+	uint32_t scan = pos / _adc_channels;
+	scan = scan ? scan - 1 : _num_of_scans - 1;
+	return _buffer[scan * _adc_channels + index - 1];
 }
 
 /**
@@ -145,4 +250,4 @@ inline uint16_t adc_get_value(uint8_t index)
 inline uint8_t adc_get_num_of_channels(void)
 {
 	return _adc_channels;
-}
\ No newline at end of file
+}
@@ -31,6 +31,226 @@
 static struct dev_uart * dev_uart1 = NULL;
 static struct dev_uart * dev_uart2 = NULL;
 
+#ifdef USE_DBGUART_DMA
+/**
+ * @brief Set up the RX DMA in circular mode and the TX DMA, which is started
+ * 		by dev_uart_dma_tx_start(). The RX half/full transfer interrupts
+ * 		count the passes of the DMA, to detect a full wrap of the buffer
+ * 		between two reads. The DMA interrupts are preempted by the audio DMA.
+ * @param[in] uart A pointer to the UART device
+ */
+static void dev_uart_dma_init(struct dev_uart * uart)
+{
+	DMA_InitTypeDef DMA_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+	uint8_t rx_irq;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	if (uart->port == USART1) {
+		uart->dma_tx = DMA1_Channel4;
+		uart->dma_rx = DMA1_Channel5;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+		rx_irq = DMA1_Channel5_IRQn;
+	}
+	else {
+		uart->dma_tx = DMA1_Channel7;
+		uart->dma_rx = DMA1_Channel6;
+		NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel7_IRQn;
+		rx_irq = DMA1_Channel6_IRQn;
+	}
+	uart->rx_dma_ptr_out = 0;
+	uart->rx_dma_halves = 0;
+	uart->rx_dma_overruns = 0;
+	uart->tx_dma_len = 0;
+
+	DMA_StructInit(&DMA_InitStructure);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &uart->port->RDR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) uart->rx_dma_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = uart->uart_buff.rx_buffer_size;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_Low;
+	DMA_DeInit(uart->dma_rx);
+	DMA_Init(uart->dma_rx, &DMA_InitStructure);
+	DMA_ITConfig(uart->dma_rx, DMA_IT_HT | DMA_IT_TC, ENABLE);
+	DMA_Cmd(uart->dma_rx, ENABLE);
+
+	/* the address and the length are set for every transfer */
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &uart->port->TDR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) uart->uart_buff.tx_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_DeInit(uart->dma_tx);
+	DMA_Init(uart->dma_tx, &DMA_InitStructure);
+	DMA_ITConfig(uart->dma_tx, DMA_IT_TC, ENABLE);
+
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	NVIC_InitStructure.NVIC_IRQChannel = rx_irq;
+	NVIC_Init(&NVIC_InitStructure);
+
+	/* an overrun would stop the RX DMA, a lost byte is better */
+	USART_OverrunDetectionConfig(uart->port, USART_OVRDetection_Disable);
+	USART_DMACmd(uart->port, USART_DMAReq_Rx | USART_DMAReq_Tx, ENABLE);
+	/* the end of a burst is the idle line */
+	USART_ITConfig(uart->port, USART_IT_IDLE, ENABLE);
+}
+
+/**
+ * @brief Start the transfer of the contiguous span at the tail of the TX
+ * 		ring, if the TX DMA is idle. Call it from the TX complete interrupt
+ * 		or with the interrupts disabled.
+ * @param[in] uart A pointer to the UART device
+ */
+static void dev_uart_dma_tx_start(struct dev_uart * uart)
+{
+	uint8_t * span;
+	uint32_t len;
+
+	if (uart->tx_dma_len || !(len = spsc_ring_peek(&uart->uart_buff.tx_ring, &span)))
+		return;
+
+	uart->tx_dma_len = len;
+	uart->dma_tx->CCR &= ~DMA_CCR_EN;
+	uart->dma_tx->CMAR = (uint32_t) span;
+	uart->dma_tx->CNDTR = len;
+	uart->dma_tx->CCR |= DMA_CCR_EN;
+}
+
+/**
+ * @brief Start a TX transfer from the main loop, if the DMA is idle
+ * @param[in] uart A pointer to the UART device
+ */
+static void dev_uart_dma_tx_kick(struct dev_uart * uart)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	dev_uart_dma_tx_start(uart);
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief TX complete: free the sent span and send the next one
+ * @param[in] uart A pointer to the UART device
+ */
+static void dev_uart_dma_tx_irq(struct dev_uart * uart)
+{
+	spsc_ring_consume(&uart->uart_buff.tx_ring, uart->tx_dma_len);
+	uart->tx_dma_len = 0;
+	dev_uart_dma_tx_start(uart);
+}
+
+/**
+ * @brief Copy the new bytes of the circular RX buffer to rx_buffer and call
+ * 		the callback, when the line is idle or half of the buffer is filled.
+ * 		If the DMA passed more half buffer marks than the ones between the
+ * 		read index and the DMA position, it wrapped over unread bytes: the
+ * 		buffer is dropped and the overrun is counted and reported.
+ * @param[in] uart A pointer to the UART device
+ */
+static void dev_uart_dma_rx_update(struct dev_uart * uart)
+{
+	uint16_t size = uart->uart_buff.rx_buffer_size;
+	uint16_t half = size / 2;
+	uint16_t out = uart->rx_dma_ptr_out;
+	uint8_t idle = uart->uart_buff.rx_ready;
+	uint32_t primask;
+	int32_t halves, extra;
+
+	/* cleared before the DMA position is read, so the idle line after
+	 * a byte that is not in this chunk is not lost */
+	if (idle)
+		uart->uart_buff.rx_ready = 0;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	uint16_t pos = (size - uart->dma_rx->CNDTR) % size;
+	halves = uart->rx_dma_halves;
+	__set_PRIMASK(primask);
+	uint16_t len = (pos + size - out) % size;
+	/* the half buffer marks (0 and size/2) in (out, out + len] */
+	int32_t marks = (out + len) / half - out / half;
+
+	/* The counter lags by one at most, when the DMA has just passed a mark
+	 * and its interrupt is pending. A full wrap adds two marks. */
+	extra = halves - marks;
+	if (extra > 0) {
+		extra += extra & 1;
+		__disable_irq();
+		uart->rx_dma_halves -= marks + extra;
+		__set_PRIMASK(primask);
+		uart->rx_dma_ptr_out = pos;
+		uart->rx_dma_overruns++;
+		printf("uart: RX DMA overrun, %d bytes lost\n", (int) (extra / 2 * size + len));
+		return;
+	}
+	if (!len)
+		return;
+	if (!idle && len < size / 2)
+		return;
+	if (out + len <= size) {
+		memcpy(uart->uart_buff.rx_buffer, &uart->rx_dma_buffer[out], len);
+	}
+	else {
+		memcpy(uart->uart_buff.rx_buffer, &uart->rx_dma_buffer[out], size - out);
+		memcpy(&uart->uart_buff.rx_buffer[size - out], uart->rx_dma_buffer, pos);
+	}
+	__disable_irq();
+	uart->rx_dma_halves -= marks;
+	__set_PRIMASK(primask);
+	uart->rx_dma_ptr_out = pos;
+	uart->available = 1;
+	if (uart->fp_dev_uart_cb) {
+		uart->fp_dev_uart_cb(uart->uart_buff.rx_buffer, len, 0);
+	}
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_TC4) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC4);
+		if (dev_uart1) dev_uart_dma_tx_irq(dev_uart1);
+	}
+}
+
+void DMA1_Channel7_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_TC7) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC7);
+		if (dev_uart2) dev_uart_dma_tx_irq(dev_uart2);
+	}
+}
+
+/* RX half and full transfer: the DMA passed a half buffer mark */
+void DMA1_Channel5_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_HT5) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_HT5);
+		if (dev_uart1) dev_uart1->rx_dma_halves++;
+	}
+	if (DMA_GetITStatus(DMA1_IT_TC5) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC5);
+		if (dev_uart1) dev_uart1->rx_dma_halves++;
+	}
+}
+
+void DMA1_Channel6_IRQHandler(void)
+{
+	if (DMA_GetITStatus(DMA1_IT_HT6) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_HT6);
+		if (dev_uart2) dev_uart2->rx_dma_halves++;
+	}
+	if (DMA_GetITStatus(DMA1_IT_TC6) != RESET) {
+		DMA_ClearITPendingBit(DMA1_IT_TC6);
+		if (dev_uart2) dev_uart2->rx_dma_halves++;
+	}
+}
+#endif
+
 /**
  * @brief Initialize the debugging UART interface
  * @param[in] dev_uart A pointer to the UART device
@@ -39,15 +259,20 @@ void dev_uart_add(struct dev_uart * uart)
 {
 	if (!uart || !uart->port || !uart->uart_buff.rx_buffer_size || !uart->uart_buff.tx_buffer_size) return;
 
+	/* the TX ring needs a power of two */
+	if (!SPSC_RING_IS_POW2(uart->uart_buff.tx_buffer_size)) return;
+
 	/* Create buffers */
 	uart->uart_buff.rx_buffer = (uint8_t*)malloc(uart->uart_buff.rx_buffer_size);
 	uart->uart_buff.tx_buffer = (uint8_t*)malloc(uart->uart_buff.tx_buffer_size);
+#ifdef USE_DBGUART_DMA
+	if (uart->dma)
+		uart->rx_dma_buffer = (uint8_t*)malloc(uart->uart_buff.rx_buffer_size);
+#endif
 
 	/* reset TX */
-	uart->uart_buff.tx_int_en = 0;
-	uart->uart_buff.tx_length = 0;
-	uart->uart_buff.tx_ptr_in = 0;
-	uart->uart_buff.tx_ptr_out = 0;
+	spsc_ring_init(&uart->uart_buff.tx_ring, uart->uart_buff.tx_buffer,
+			uart->uart_buff.tx_buffer_size);
 	uart->uart_buff.tx_ready = 0;
 	/* reset RX */
 	uart->uart_buff.rx_ready = 0;
@@ -91,13 +316,20 @@ void dev_uart_add(struct dev_uart * uart)
 	/* USART configuration */
 	USART_Init(uart->port, &uart->config);
 
+	/* before any NVIC_Init(), which uses the group to encode the priorities */
+	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
+
 	/*
 	 Jump to the USART1_IRQHandler() function
 	 if the USART1 receive interrupt occurs
 	 */
+#ifdef USE_DBGUART_DMA
+	if (uart->dma)
+		dev_uart_dma_init(uart);
+	else
+#endif
 	USART_ITConfig(uart->port, USART_IT_RXNE, ENABLE); // enable the USART receive interrupt
 
-	NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
 	if (uart->port == USART1) {
 		uart->nvic.NVIC_IRQChannel = USART1_IRQn;	// we want to configure the USART1 interrupts
 		uart->nvic.NVIC_IRQChannelSubPriority = 5;	// this sets the sub-priority inside the group
@@ -141,6 +373,21 @@ void dev_uart_set_baud_rate(struct dev_uart * uart, uint32_t baudrate)
 void dev_uart_remove(struct dev_uart * uart)
 {
 	if (uart) {
+#ifdef USE_DBGUART_DMA
+		if (uart->dma) {
+			USART_ITConfig(uart->port, USART_IT_IDLE, DISABLE);
+			USART_DMACmd(uart->port, USART_DMAReq_Rx | USART_DMAReq_Tx, DISABLE);
+			DMA_ITConfig(uart->dma_tx, DMA_IT_TC, DISABLE);
+			DMA_ITConfig(uart->dma_rx, DMA_IT_HT | DMA_IT_TC, DISABLE);
+			DMA_Cmd(uart->dma_tx, DISABLE);
+			DMA_Cmd(uart->dma_rx, DISABLE);
+			uart->tx_dma_len = 0;
+			if (uart->rx_dma_buffer) {
+				free(uart->rx_dma_buffer);
+				uart->rx_dma_buffer = NULL;
+			}
+		}
+#endif
 		/* Remove buffers */
 		if (uart->uart_buff.rx_buffer) {
 			memset(uart->uart_buff.rx_buffer, 0, uart->uart_buff.rx_buffer_size);
@@ -169,20 +416,19 @@ void dev_uart_remove(struct dev_uart * uart)
  */
 int dev_uart_send(struct dev_uart * uart, int ch)
 {
-	if ((uart->uart_buff.tx_ptr_in + 1)%uart->uart_buff.tx_buffer_size == uart->uart_buff.tx_ptr_out) {
+	if (spsc_ring_push(&uart->uart_buff.tx_ring, ch) < 0) {
 		return -1;
 	}
 
-	uart->uart_buff.tx_length++;
-	uart->uart_buff.tx_buffer[uart->uart_buff.tx_ptr_in] = ch;
-	uart->uart_buff.tx_ptr_in = (uart->uart_buff.tx_ptr_in + 1)%uart->uart_buff.tx_buffer_size;
-
-	/* If INT is disabled then enable it */
-	if (!uart->uart_buff.tx_int_en) {
-		uart->uart_buff.tx_int_en = 1;
-		USART_ITConfig(uart->port, USART_IT_TXE, ENABLE); 	// enable the USART1 receive interrupt
-		USART_ITConfig(uart->port, USART_IT_RXNE, DISABLE);
+#ifdef USE_DBGUART_DMA
+	if (uart->dma) {
+		dev_uart_dma_tx_kick(uart);
+		return ch;
 	}
+#endif
+	/* Always enable the INT, the ISR may have just disabled it after it
+	 * found the ring empty */
+	USART_ITConfig(uart->port, USART_IT_TXE, ENABLE);
 
 	return ch;
 }
@@ -196,10 +442,17 @@ int dev_uart_send(struct dev_uart * uart, int ch)
  */
 size_t dev_uart_send_buffer(struct dev_uart * uart, uint8_t * buffer, size_t buffer_len)
 {
-	size_t i = 0;
-	for (i=0; i<buffer_len; i++) {
-		if (dev_uart_send(uart, buffer[i]) < 0) break;
+	size_t i = spsc_ring_write(&uart->uart_buff.tx_ring, buffer, buffer_len);
+
+	if (!i)
+		return 0;
+#ifdef USE_DBGUART_DMA
+	if (uart->dma) {
+		dev_uart_dma_tx_kick(uart);
+		return i;
 	}
+#endif
+	USART_ITConfig(uart->port, USART_IT_TXE, ENABLE);
 	return i;
 }
 
@@ -221,6 +474,12 @@ void USART2_IRQHandler(void)
  */
 void dev_uart_update(struct dev_uart * uart)
 {
+#ifdef USE_DBGUART_DMA
+	if (uart->dma) {
+		dev_uart_dma_rx_update(uart);
+		return;
+	}
+#endif
 	if (uart->uart_buff.rx_ready) {
 		if ((uart->uart_buff.rx_ready_tmr++) >= uart->timeout_ms) {
 			uart->uart_buff.rx_ready = 0;
@@ -241,6 +500,20 @@ void dev_uart_update(struct dev_uart * uart)
  */
 void dev_uart_irq(struct dev_uart * uart)
 {
+	/* An overrun keeps the IRQ pending until the flag is cleared */
+	if (USART_GetFlagStatus(uart->port, USART_FLAG_ORE) != RESET)
+		USART_ClearFlag(uart->port, USART_FLAG_ORE);
+
+#ifdef USE_DBGUART_DMA
+	if (uart->dma) {
+		if (USART_GetITStatus(uart->port, USART_IT_IDLE) != RESET) {
+			USART_ClearITPendingBit(uart->port, USART_IT_IDLE);
+			uart->uart_buff.rx_ready = 1;
+		}
+		return;
+	}
+#endif
+
 	if (USART_GetITStatus(uart->port, USART_IT_RXNE) != RESET) {
 		/* Read one byte from the receive data register */
 		if (uart->uart_buff.rx_ptr_in == uart->uart_buff.rx_buffer_size) {
@@ -258,20 +531,13 @@ void dev_uart_irq(struct dev_uart * uart)
 	}
 
 	if (USART_GetITStatus(uart->port, USART_IT_TXE) != RESET) {
-		if (uart->uart_buff.tx_ptr_out != uart->uart_buff.tx_ptr_in) {
-			uart->port->TDR = uart->uart_buff.tx_buffer[uart->uart_buff.tx_ptr_out];
-			uart->uart_buff.tx_ptr_out = (uart->uart_buff.tx_ptr_out + 1)%uart->uart_buff.tx_buffer_size;
-			uart->uart_buff.tx_length--;
+		uint8_t ch;
+		if (spsc_ring_pop(&uart->uart_buff.tx_ring, &ch) == 0) {
+			uart->port->TDR = ch;
 		}
 		else {
 			/* Disable the USARTy Transmit interrupt */
 			USART_ITConfig(uart->port, USART_IT_TXE, DISABLE);
-			USART_ITConfig(uart->port, USART_IT_RXNE, ENABLE);
-			uart->uart_buff.tx_int_en = 0;
-			/* Rest uart buffer */
-			uart->uart_buff.tx_ptr_in = 0;
-			uart->uart_buff.tx_ptr_out = 0;
-			uart->uart_buff.tx_length = 0;
 		}
 //		uart->port->SR &= ~USART_FLAG_TXE;	          // clear interrupt
 	}
@@ -8,6 +8,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "stlinky.h"
+#ifdef USE_STTERM_RING
+#include "stm32f30x.h"
+#endif
 
 #define min_t(type, a, b) ((a<b) ? a : b)
 
@@ -81,4 +84,141 @@ int _read(int file, char *ptr, int len) {
     file=file; // fix unused warning
 	return stlinky_rx(&MY_STERM, ptr, len);
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef USE_STTERM_RING
+/* The control block, global so the host can find it in the ELF */
+volatile struct stlinky_ring stlinky_ring_cb;
+
+static void stlinky_ring_channel_init(volatile struct stlinky_ring_channel * ch,
+		volatile char * buf, uint32_t size)
+{
+	ch->offset = (uint32_t) ((volatile char *) buf - (volatile char *) &stlinky_ring_cb);
+	ch->size = size;
+	ch->wr_off = 0;
+	ch->rd_off = 0;
+	ch->mode = STLINKY_RING_DROP;
+	ch->dropped = 0;
+}
+
+/**
+ * @brief Initialize the control block. The ID is written last, so the host
+ * 		never finds a half initialized block.
+ */
+void stlinky_ring_init(void)
+{
+	volatile struct stlinky_ring * cb = &stlinky_ring_cb;
+
+	memset((void *) cb->id, 0, STLINKY_RING_ID_SIZE);
+	cb->num_of_up = STLINKY_RING_UP_CHANNELS;
+	cb->num_of_down = 1;
+	for (int i=0; i<STLINKY_RING_UP_CHANNELS; i++)
+		stlinky_ring_channel_init(&cb->up[i], cb->up_buf[i], STLINKY_RING_UP_SIZE);
+	stlinky_ring_channel_init(&cb->down[0], cb->down_buf, STLINKY_RING_DOWN_SIZE);
+	__DMB();
+	memcpy((void *) cb->id, STLINKY_RING_ID, sizeof(STLINKY_RING_ID));
+}
+
+/**
+ * @brief Set what a write does when the channel is full
+ * @param[in] channel The MCU to host channel
+ * @param[in] mode The mode
+ * @return 0 on success or -1 on invalid channel
+ */
+int stlinky_ring_set_mode(uint8_t channel, enum stlinky_ring_mode mode)
+{
+	if (channel >= STLINKY_RING_UP_CHANNELS)
+		return -1;
+	stlinky_ring_cb.up[channel].mode = mode;
+	return 0;
+}
+
+/**
+ * @brief Write in a MCU to host channel. It never waits for the host.
+ * @param[in] channel The channel
+ * @param[in] buf The bytes to write
+ * @param[in] len Number of bytes
+ * @return The number of bytes that were written, 0 if they were dropped,
+ * 		or -1 on invalid channel
+ */
+int stlinky_ring_write(uint8_t channel, const char * buf, int len)
+{
+	volatile struct stlinky_ring_channel * ch;
+	volatile char * data;
+	uint32_t size, wr, rd, avail, n;
+
+	if (channel >= STLINKY_RING_UP_CHANNELS || len < 0)
+		return -1;
+	ch = &stlinky_ring_cb.up[channel];
+	data = stlinky_ring_cb.up_buf[channel];
+	size = ch->size;
+	wr = ch->wr_off;
+	rd = ch->rd_off;
+	avail = (rd > wr) ? rd - wr - 1 : size - 1 - wr + rd;
+
+	if ((uint32_t) len > avail) {
+		if (ch->mode != STLINKY_RING_OVERWRITE) {
+			ch->dropped += len;
+			return 0;
+		}
+		/* keep the newest bytes and move the read offset past the
+		 * overwritten ones before they are written */
+		if ((uint32_t) len > size - 1) {
+			ch->dropped += len - (size - 1);
+			buf += len - (size - 1);
+			len = size - 1;
+		}
+		n = len - avail;
+		ch->rd_off = (rd + n) % size;
+		ch->dropped += n;
+	}
+
+	/* up to the end of the ring, then from the start */
+	n = size - wr;
+	if (n > (uint32_t) len)
+		n = len;
+	memcpy((char *) &data[wr], buf, n);
+	memcpy((char *) data, &buf[n], len - n);
+	/* the data must be in the ring before the host sees the offset */
+	__DMB();
+	ch->wr_off = (wr + len) % size;
+	return len;
+}
+
+/**
+ * @brief Read the bytes that the host wrote in the down channel. It never
+ * 		waits.
+ * @param[out] buf The buffer
+ * @param[in] len Size of the buffer
+ * @return Number of bytes read
+ */
+int stlinky_ring_read(char * buf, int len)
+{
+	volatile struct stlinky_ring_channel * ch = &stlinky_ring_cb.down[0];
+	uint32_t size = ch->size;
+	uint32_t rd = ch->rd_off;
+	uint32_t wr = ch->wr_off;
+	int n = 0;
+
+	/* the data after the offset that the host wrote */
+	__DMB();
+	while (rd != wr && n < len) {
+		buf[n++] = stlinky_ring_cb.down_buf[rd];
+		rd = (rd + 1) % size;
+	}
+	ch->rd_off = rd;
+	return n;
+}
+
+int _write(int file, char *ptr, int len) {
+	file=file; // fix unused warning
+	/* the bytes are either written or counted as dropped */
+	stlinky_ring_write(0, ptr, len);
+	return len;
+}
+
+int _read(int file, char *ptr, int len) {
+	file=file; // fix unused warning
+	return stlinky_ring_read(ptr, len);
+}
+#endif
@@ -88,7 +88,7 @@ void _exit (int status)
 	while (1) {}		/* Make sure we hang here */
 }
 
-#ifndef USE_STTERM
+#if !defined(USE_STTERM) && !defined(USE_STTERM_RING)
 int _read (int file, char *ptr, int len)
 {
 	int DataIdx;
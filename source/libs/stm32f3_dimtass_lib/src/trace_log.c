@@ -0,0 +1,153 @@
+/*
+ * trace_log.c
+ *
+ * Copyright 2018 Dimitris Tassopoulos
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished to do
+ * so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+ * PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "stm32f30x.h"
+#include "spsc_ring.h"
+#include "trace_log.h"
+
+#if !SPSC_RING_IS_POW2(TRACE_LOG_BUFFER_SIZE)
+#error "TRACE_LOG_BUFFER_SIZE must be a power of two"
+#endif
+
+struct tp_trace_log {
+	/* the writers disable the interrupts, so there's one producer at a
+	 * time, and the main loop is the consumer */
+	struct spsc_ring ring;
+	volatile uint32_t dropped;
+	uint32_t dropped_sent;
+	uint8_t frame[TRACE_LOG_COBS_SIZE];
+	uint16_t frame_len;
+	trace_log_send_t fp_send;
+};
+
+static uint8_t m_buffer[TRACE_LOG_BUFFER_SIZE];
+
+/* Ready before trace_log_init(), so the messages of the boot are kept */
+static struct tp_trace_log m_trace = {
+	.ring = { m_buffer, TRACE_LOG_BUFFER_SIZE - 1, 0, 0 },
+};
+
+/**
+ * @brief Set the callback that sends the frames
+ * @param[in] fp_send The callback, it takes the whole frame or nothing
+ */
+void trace_log_init(trace_log_send_t fp_send)
+{
+	m_trace.frame_len = 0;
+	m_trace.fp_send = fp_send;
+}
+
+/**
+ * @brief Copy a record in the ring. This is called by TRACE_LOG().
+ * @param[in] fmt The format string in the .trace_fmt section
+ * @param[in] args The arguments
+ * @param[in] num_of_args Number of arguments, up to TRACE_LOG_MAX_ARGS
+ */
+void trace_log_write(const char * fmt, const uint32_t * args, uint8_t num_of_args)
+{
+	uint32_t header = ((uint32_t) (uintptr_t) fmt & TRACE_LOG_ID_MASK) |
+			((uint32_t) num_of_args << TRACE_LOG_NUM_OF_ARGS_SHIFT);
+	uint32_t len = sizeof(header) + num_of_args * sizeof(uint32_t);
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (spsc_ring_free(&m_trace.ring) < len) {
+		m_trace.dropped++;
+	}
+	else {
+		spsc_ring_write(&m_trace.ring, (const uint8_t *) &header, sizeof(header));
+		spsc_ring_write(&m_trace.ring, (const uint8_t *) args, num_of_args * sizeof(uint32_t));
+	}
+	__set_PRIMASK(primask);
+}
+
+static inline uint8_t * trace_log_put_u32(uint8_t * p, uint32_t value)
+{
+	*p++ = value & 0xFF;
+	*p++ = (value >> 8) & 0xFF;
+	*p++ = (value >> 16) & 0xFF;
+	*p++ = value >> 24;
+	return p;
+}
+
+/**
+ * @brief Encode the next record, or the dropped records
+ * @return 1 if there's a frame to send
+ */
+static int trace_log_encode(void)
+{
+	uint8_t raw[TRACE_LOG_FRAME_SIZE(TRACE_LOG_MAX_ARGS)];
+	uint32_t args[TRACE_LOG_MAX_ARGS];
+	uint32_t dropped = m_trace.dropped;
+	uint32_t header;
+	uint8_t num_of_args;
+	uint8_t * p = raw;
+
+	if (dropped != m_trace.dropped_sent) {
+		header = TRACE_LOG_ID_DROPPED | (1 << TRACE_LOG_NUM_OF_ARGS_SHIFT);
+		args[0] = dropped;
+		m_trace.dropped_sent = dropped;
+	}
+	else if (spsc_ring_read(&m_trace.ring, (uint8_t *) &header, sizeof(header))) {
+		/* the writer copies the whole record with the interrupts disabled */
+		num_of_args = header >> TRACE_LOG_NUM_OF_ARGS_SHIFT;
+		spsc_ring_read(&m_trace.ring, (uint8_t *) args, num_of_args * sizeof(uint32_t));
+	}
+	else {
+		return 0;
+	}
+
+	num_of_args = header >> TRACE_LOG_NUM_OF_ARGS_SHIFT;
+	*p++ = TRACE_LOG_FRAME_TYPE;
+	p = trace_log_put_u32(p, header);
+	for (int i=0; i<num_of_args; i++)
+		p = trace_log_put_u32(p, args[i]);
+	uint16_t crc = cobs_frame_crc16(raw, p - raw);
+	*p++ = crc & 0xFF;
+	*p++ = crc >> 8;
+	m_trace.frame_len = cobs_frame_encode(raw, p - raw, m_trace.frame);
+	return 1;
+}
+
+/**
+ * @brief Send the records, until the callback doesn't take a frame. This
+ * 		is called from the main loop.
+ */
+void trace_log_update(void)
+{
+	if (!m_trace.fp_send)
+		return;
+
+	while (m_trace.frame_len || trace_log_encode()) {
+		if (!m_trace.fp_send(m_trace.frame, m_trace.frame_len))
+			return;
+		m_trace.frame_len = 0;
+	}
+}
+
+/**
+ * @brief Get the records that were dropped because the ring was full
+ */
+uint32_t trace_log_get_dropped(void)
+{
+	return m_trace.dropped;
+}
@@ -0,0 +1,262 @@
+/*
+ * biquad_design.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <math.h>
+#include "biquad_design.h"
+
+#define SQRT2 1.41421356f
+
+static const char * const m_type_names[FILTER_NUM_OF_TYPES] = {
+	[FILTER_FO_APF] = "fo_apf",
+	[FILTER_FO_HPF] = "fo_hpf",
+	[FILTER_FO_LPF] = "fo_lpf",
+	[FILTER_FO_SHELVING_HIGH] = "fo_shelving_high",
+	[FILTER_FO_SHELVING_LOW] = "fo_shelving_low",
+	[FILTER_SO_APF] = "so_apf",
+	[FILTER_SO_BPF] = "so_bpf",
+	[FILTER_SO_BSF] = "so_bsf",
+	[FILTER_SO_BUTTERWORTH_BPF] = "so_butterworth_bpf",
+	[FILTER_SO_BUTTERWORTH_BSF] = "so_butterworth_bsf",
+	[FILTER_SO_BUTTERWORTH_HPF] = "so_butterworth_hpf",
+	[FILTER_SO_BUTTERWORTH_LPF] = "so_butterworth_lpf",
+	[FILTER_SO_HPF] = "so_hpf",
+	[FILTER_SO_LINKWITZ_RILEY_HPF] = "so_linkwitz_riley_hpf",
+	[FILTER_SO_LINKWITZ_RILEY_LPF] = "so_linkwitz_riley_lpf",
+	[FILTER_SO_LPF] = "so_lpf",
+	[FILTER_SO_PARAMETRIC_CQ_BOOST] = "so_parametric_cq_boost",
+	[FILTER_SO_PARAMETRIC_CQ_CUT] = "so_parametric_cq_cut",
+	[FILTER_SO_PARAMETRIC_NCQ] = "so_parametric_ncq",
+};
+
+/**
+ * @brief Get the filters_lib name of a filter type
+ * @param[in] type The filter type
+ * @return The name or NULL for an invalid type
+ */
+const char * biquad_type_name(enum biquad_type type)
+{
+	if ((unsigned) type >= FILTER_NUM_OF_TYPES)
+		return NULL;
+	return m_type_names[type];
+}
+
+/**
+ * @brief Calculate the coefficients of a biquad stage
+ * @param[in] params The filter parameters
+ * @param[in] fs The sample rate in Hz
+ * @param[out] coeffs BIQUAD_NUM_COEFFS coefficients in CMSIS order
+ * @return 0 on success, -1 on invalid parameters
+ */
+int biquad_design(const struct biquad_params * params, uint32_t fs,
+		float32_t * coeffs)
+{
+	/* Pirkle's notation: y = a0*x + a1*x1 + a2*x2 - b1*y1 - b2*y2,
+	 * output = d0*x + c0*y */
+	float a0, a1 = 0, a2 = 0, b1 = 0, b2 = 0;
+	float c0 = 1, d0 = 0;
+	float fc = params->fc;
+	float q = params->q;
+
+	if (!fs || (fc <= 0) || (fc >= (float) fs / 2))
+		return -1;
+	if (q <= 0)
+		q = 0.7071f;
+
+	float theta = 2.0f * PI * fc / fs;
+	float k = tanf(PI * fc / fs);
+	float bw = fc / q;
+
+	switch (params->type) {
+	case FILTER_FO_APF: {
+		float alpha = (k - 1.0f) / (k + 1.0f);
+		a0 = alpha;
+		a1 = 1.0f;
+		b1 = alpha;
+		break;
+	}
+	case FILTER_FO_HPF: {
+		float gamma = cosf(theta) / (1.0f + sinf(theta));
+		a0 = (1.0f + gamma) / 2.0f;
+		a1 = -a0;
+		b1 = -gamma;
+		break;
+	}
+	case FILTER_FO_LPF: {
+		float gamma = cosf(theta) / (1.0f + sinf(theta));
+		a0 = (1.0f - gamma) / 2.0f;
+		a1 = a0;
+		b1 = -gamma;
+		break;
+	}
+	case FILTER_FO_SHELVING_HIGH:
+	case FILTER_FO_SHELVING_LOW: {
+		float mu = powf(10.0f, params->gain_db / 20.0f);
+		float beta = (params->type == FILTER_FO_SHELVING_LOW) ?
+				4.0f / (1.0f + mu) : (1.0f + mu) / 4.0f;
+		float delta = beta * tanf(theta / 2.0f);
+		float gamma = (1.0f - delta) / (1.0f + delta);
+		if (params->type == FILTER_FO_SHELVING_LOW) {
+			a0 = (1.0f - gamma) / 2.0f;
+			a1 = a0;
+		}
+		else {
+			a0 = (1.0f + gamma) / 2.0f;
+			a1 = -a0;
+		}
+		b1 = -gamma;
+		c0 = mu - 1.0f;
+		d0 = 1.0f;
+		break;
+	}
+	case FILTER_SO_APF: {
+		float t = tanf(PI * bw / fs);
+		float alpha = (t - 1.0f) / (t + 1.0f);
+		float beta = -cosf(theta);
+		a0 = -alpha;
+		a1 = beta * (1.0f - alpha);
+		a2 = 1.0f;
+		b1 = a1;
+		b2 = -alpha;
+		break;
+	}
+	case FILTER_SO_BPF:
+	case FILTER_SO_BSF: {
+		float delta = k * k * q + k + q;
+		if (params->type == FILTER_SO_BPF) {
+			a0 = k / delta;
+			a2 = -a0;
+		}
+		else {
+			a0 = q * (k * k + 1.0f) / delta;
+			a1 = 2.0f * q * (k * k - 1.0f) / delta;
+			a2 = a0;
+		}
+		b1 = 2.0f * q * (k * k - 1.0f) / delta;
+		b2 = (k * k * q - k + q) / delta;
+		break;
+	}
+	case FILTER_SO_BUTTERWORTH_BPF: {
+		float c = 1.0f / tanf(PI * bw / fs);
+		float d = 2.0f * cosf(theta);
+		a0 = 1.0f / (1.0f + c);
+		a2 = -a0;
+		b1 = -a0 * c * d;
+		b2 = a0 * (c - 1.0f);
+		break;
+	}
+	case FILTER_SO_BUTTERWORTH_BSF: {
+		float c = tanf(PI * bw / fs);
+		float d = 2.0f * cosf(theta);
+		a0 = 1.0f / (1.0f + c);
+		a1 = -a0 * d;
+		a2 = a0;
+		b1 = -a0 * d;
+		b2 = a0 * (1.0f - c);
+		break;
+	}
+	case FILTER_SO_BUTTERWORTH_HPF: {
+		float c = k;
+		a0 = 1.0f / (1.0f + SQRT2 * c + c * c);
+		a1 = -2.0f * a0;
+		a2 = a0;
+		b1 = 2.0f * a0 * (c * c - 1.0f);
+		b2 = a0 * (1.0f - SQRT2 * c + c * c);
+		break;
+	}
+	case FILTER_SO_BUTTERWORTH_LPF: {
+		float c = 1.0f / k;
+		a0 = 1.0f / (1.0f + SQRT2 * c + c * c);
+		a1 = 2.0f * a0;
+		a2 = a0;
+		b1 = 2.0f * a0 * (1.0f - c * c);
+		b2 = a0 * (1.0f - SQRT2 * c + c * c);
+		break;
+	}
+	case FILTER_SO_HPF:
+	case FILTER_SO_LPF: {
+		float d = 1.0f / q;
+		float beta = 0.5f * (1.0f - (d / 2.0f) * sinf(theta)) /
+				(1.0f + (d / 2.0f) * sinf(theta));
+		float gamma = (0.5f + beta) * cosf(theta);
+		if (params->type == FILTER_SO_LPF) {
+			a0 = (0.5f + beta - gamma) / 2.0f;
+			a1 = 0.5f + beta - gamma;
+		}
+		else {
+			a0 = (0.5f + beta + gamma) / 2.0f;
+			a1 = -(0.5f + beta + gamma);
+		}
+		a2 = a0;
+		b1 = -2.0f * gamma;
+		b2 = 2.0f * beta;
+		break;
+	}
+	case FILTER_SO_LINKWITZ_RILEY_HPF:
+	case FILTER_SO_LINKWITZ_RILEY_LPF: {
+		float omega = PI * fc;
+		float kappa = omega / k;
+		float delta = kappa * kappa + omega * omega + 2.0f * kappa * omega;
+		if (params->type == FILTER_SO_LINKWITZ_RILEY_LPF) {
+			a0 = omega * omega / delta;
+			a1 = 2.0f * a0;
+		}
+		else {
+			a0 = kappa * kappa / delta;
+			a1 = -2.0f * a0;
+		}
+		a2 = a0;
+		b1 = (-2.0f * kappa * kappa + 2.0f * omega * omega) / delta;
+		b2 = (-2.0f * kappa * omega + kappa * kappa + omega * omega) / delta;
+		break;
+	}
+	case FILTER_SO_PARAMETRIC_CQ_BOOST:
+	case FILTER_SO_PARAMETRIC_CQ_CUT: {
+		float v0 = powf(10.0f, fabsf(params->gain_db) / 20.0f);
+		float e0;
+		if (params->type == FILTER_SO_PARAMETRIC_CQ_BOOST) {
+			e0 = 1.0f + k / q + k * k;
+			a0 = (1.0f + v0 * k / q + k * k) / e0;
+			a2 = (1.0f - v0 * k / q + k * k) / e0;
+			b2 = (1.0f - k / q + k * k) / e0;
+		}
+		else {
+			v0 = 1.0f / v0;
+			e0 = 1.0f + k / (v0 * q) + k * k;
+			a0 = (1.0f + k / q + k * k) / e0;
+			a2 = (1.0f - k / q + k * k) / e0;
+			b2 = (1.0f - k / (v0 * q) + k * k) / e0;
+		}
+		a1 = 2.0f * (k * k - 1.0f) / e0;
+		b1 = a1;
+		break;
+	}
+	case FILTER_SO_PARAMETRIC_NCQ: {
+		float mu = powf(10.0f, params->gain_db / 20.0f);
+		float zeta = 4.0f / (1.0f + mu);
+		float t = zeta * tanf(theta / (2.0f * q));
+		float beta = 0.5f * (1.0f - t) / (1.0f + t);
+		float gamma = (0.5f + beta) * cosf(theta);
+		a0 = 0.5f - beta;
+		a2 = -a0;
+		b1 = -2.0f * gamma;
+		b2 = 2.0f * beta;
+		c0 = mu - 1.0f;
+		d0 = 1.0f;
+		break;
+	}
+	default:
+		return -1;
+	}
+
+	/* fold the dry path in the numerator: d0 + c0*N/D = (d0*D + c0*N)/D */
+	coeffs[0] = c0 * a0 + d0;
+	coeffs[1] = c0 * a1 + d0 * b1;
+	coeffs[2] = c0 * a2 + d0 * b2;
+	/* CMSIS adds the feedback terms */
+	coeffs[3] = -b1;
+	coeffs[4] = -b2;
+
+	return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * capture.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include "arm_math.h"
+#include "capture.h"
+
+#if (CAPTURE_NUM_OF_FRAMES & (CAPTURE_NUM_OF_FRAMES - 1))
+#error "CAPTURE_NUM_OF_FRAMES must be a power of two"
+#endif
+
+#define CAPTURE_RING_MASK (CAPTURE_NUM_OF_FRAMES - 1)
+#define CAPTURE_MAX_SAMPLES (CAPTURE_FRAME_SAMPLES * CAPTURE_MAX_CHANNELS)
+#define CAPTURE_MAX_FRAME_SIZE CAPTURE_FRAME_SIZE(CAPTURE_MAX_SAMPLES)
+
+struct capture_frame {
+	uint32_t seq;
+	uint16_t samples[CAPTURE_MAX_SAMPLES];
+};
+
+struct capture_ring {
+	struct capture_frame frames[CAPTURE_NUM_OF_FRAMES];
+	/* only the interrupt writes the head and only the main loop writes the
+	 * tail, so there's no lock */
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t dropped;
+	/* the state of the interrupt */
+	uint32_t seq;
+	uint16_t fill;
+	uint8_t skip;
+	uint8_t phase;
+	uint32_t fs;
+};
+
+struct tp_capture {
+	struct capture_ring streams[CAPTURE_NUM_OF_STREAMS];
+	uint8_t channels;
+	/* the stream that is sent next, so both streams get the UART */
+	uint8_t next;
+	uint8_t raw[CAPTURE_MAX_FRAME_SIZE];
+	uint8_t frame[CAPTURE_COBS_SIZE(CAPTURE_MAX_FRAME_SIZE)];
+	uint16_t frame_len;
+	uint16_t frame_pos;
+	capture_send_t fp_send;
+};
+
+static struct tp_capture m_capture;
+
+/**
+ * @brief Initialize the capture. Don't call it while the interrupt is
+ * 		running.
+ * @param[in] adc_fs The sample rate of the ADC samples
+ * @param[in] dac_fs The sample rate of the DAC samples
+ * @param[in] channels Interleaved channels of both streams, 1 or 2
+ * @param[in] fp_send The callback that sends the frames
+ */
+void capture_init(uint32_t adc_fs, uint32_t dac_fs, uint8_t channels, capture_send_t fp_send)
+{
+	memset(&m_capture, 0, sizeof(m_capture));
+	m_capture.streams[CAPTURE_ADC].fs = adc_fs / CAPTURE_DECIMATION;
+	m_capture.streams[CAPTURE_DAC].fs = dac_fs / CAPTURE_DECIMATION;
+	m_capture.channels = (channels > CAPTURE_MAX_CHANNELS) ? CAPTURE_MAX_CHANNELS : channels;
+	m_capture.fp_send = fp_send;
+}
+
+/**
+ * @brief Copy every CAPTURE_DECIMATION-th sample of a block in the frame of
+ * 		a stream. This is called from the interrupt. A full frame is handed
+ * 		to the main loop, and a frame that starts while the ring is full is
+ * 		dropped as a whole.
+ * @param[in] stream The stream
+ * @param[in] samples The 12-bit samples, with the channels interleaved
+ * @param[in] len Number of samples per channel
+ */
+void capture_process(enum capture_stream stream, const uint16_t * samples, size_t len)
+{
+	struct capture_ring * s = &m_capture.streams[stream];
+	uint8_t channels = m_capture.channels;
+	size_t i;
+
+	/* the decimation phase goes on from the previous block */
+	for (i=s->phase; i<len; i+=CAPTURE_DECIMATION) {
+		uint32_t head = s->head;
+
+		if (!s->fill)
+			s->skip = (head - s->tail) >= CAPTURE_NUM_OF_FRAMES;
+		if (!s->skip) {
+			uint16_t * dst = &s->frames[head & CAPTURE_RING_MASK].samples[s->fill * channels];
+			for (int c=0; c<channels; c++)
+				dst[c] = samples[i * channels + c];
+		}
+		if (++s->fill < CAPTURE_FRAME_SAMPLES)
+			continue;
+
+		s->fill = 0;
+		if (s->skip) {
+			s->dropped++;
+		}
+		else {
+			s->frames[head & CAPTURE_RING_MASK].seq = s->seq;
+			/* the frame must be in the ring before the main loop sees the head */
+			__DMB();
+			s->head = head + 1;
+		}
+		s->seq++;
+	}
+	s->phase = i - len;
+}
+
+static inline uint8_t * capture_put_u16(uint8_t * p, uint16_t value)
+{
+	*p++ = value & 0xFF;
+	*p++ = value >> 8;
+	return p;
+}
+
+static inline uint8_t * capture_put_u32(uint8_t * p, uint32_t value)
+{
+	p = capture_put_u16(p, value & 0xFFFF);
+	return capture_put_u16(p, value >> 16);
+}
+
+/**
+ * @brief Encode the oldest frame of a stream and free its place in the ring
+ */
+static void capture_encode(enum capture_stream stream)
+{
+	struct capture_ring * s = &m_capture.streams[stream];
+	uint32_t tail = s->tail;
+	const struct capture_frame * frame = &s->frames[tail & CAPTURE_RING_MASK];
+	uint16_t num_of_samples = CAPTURE_FRAME_SAMPLES * m_capture.channels;
+	uint8_t * p = m_capture.raw;
+
+	*p++ = CAPTURE_FRAME_TYPE;
+	*p++ = (uint8_t) stream;
+	*p++ = m_capture.channels;
+	*p++ = CAPTURE_DECIMATION;
+	p = capture_put_u32(p, frame->seq);
+	p = capture_put_u32(p, s->fs);
+	p = capture_put_u32(p, s->dropped);
+	p = capture_put_u16(p, CAPTURE_FRAME_SAMPLES);
+	for (int i=0; i<num_of_samples; i++)
+		p = capture_put_u16(p, frame->samples[i]);
+	/* the samples are read before the interrupt can overwrite them */
+	__DMB();
+	s->tail = tail + 1;
+
+	p = capture_put_u16(p, cobs_frame_crc16(m_capture.raw, p - m_capture.raw));
+	m_capture.frame_len = cobs_frame_encode(m_capture.raw, p - m_capture.raw, m_capture.frame);
+	m_capture.frame_pos = 0;
+}
+
+/**
+ * @brief Send the pending frame bytes and encode the next frame when the
+ * 		previous one is sent. This is called from the main loop.
+ */
+void capture_update(void)
+{
+	if (m_capture.frame_pos == m_capture.frame_len) {
+		for (int n=0; n<CAPTURE_NUM_OF_STREAMS; n++) {
+			enum capture_stream stream = (m_capture.next + n) % CAPTURE_NUM_OF_STREAMS;
+			struct capture_ring * s = &m_capture.streams[stream];
+
+			if (s->head != s->tail) {
+				capture_encode(stream);
+				m_capture.next = (stream + 1) % CAPTURE_NUM_OF_STREAMS;
+				break;
+			}
+		}
+	}
+	if (m_capture.frame_pos < m_capture.frame_len)
+		m_capture.frame_pos += m_capture.fp_send(&m_capture.frame[m_capture.frame_pos],
+				m_capture.frame_len - m_capture.frame_pos);
+}
+
+/**
+ * @brief Get the dropped frames of a stream since capture_init()
+ */
+uint32_t capture_get_dropped(enum capture_stream stream)
+{
+	return m_capture.streams[stream].dropped;
+}
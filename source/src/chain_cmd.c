@@ -0,0 +1,323 @@
+/*
+ * chain_cmd.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include "chain_cmd.h"
+#include "filter_chain.h"
+#include "sample_rate.h"
+
+/* The stage in a payload: u8 type, f32 fc, q, gain_db */
+#define STAGE_SIZE 13
+
+static chain_cmd_send_t m_send;
+static chain_cmd_stats_t m_stats;
+/* the responses that are not sent yet */
+static uint8_t m_tx[CHAIN_CMD_TX_SIZE];
+static size_t m_tx_len;
+static size_t m_tx_pos;
+
+static inline uint32_t get_u32(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint8_t * put_u16(uint8_t * p, uint16_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	return &p[2];
+}
+
+static inline uint8_t * put_u32(uint8_t * p, uint32_t value)
+{
+	put_u16(p, value);
+	return put_u16(&p[2], value >> 16);
+}
+
+/**
+ * @brief Decode a stage. NaN and infinity are not valid, because
+ * 		biquad_design() doesn't catch them.
+ * @return 0 on success or -1 on invalid parameters
+ */
+static int get_stage(const uint8_t * p, struct biquad_params * stage)
+{
+	uint32_t raw[3];
+
+	if (p[0] >= FILTER_NUM_OF_TYPES)
+		return -1;
+	for (int i=0; i<3; i++) {
+		raw[i] = get_u32(&p[1 + i * 4]);
+		if ((raw[i] & 0x7F800000) == 0x7F800000)
+			return -1;
+	}
+	stage->type = (enum biquad_type) p[0];
+	memcpy(&stage->fc, &raw[0], sizeof(float));
+	memcpy(&stage->q, &raw[1], sizeof(float));
+	memcpy(&stage->gain_db, &raw[2], sizeof(float));
+	return 0;
+}
+
+static uint8_t * put_stage(uint8_t * p, const struct biquad_params * stage)
+{
+	uint32_t raw[3];
+
+	memcpy(&raw[0], &stage->fc, sizeof(float));
+	memcpy(&raw[1], &stage->q, sizeof(float));
+	memcpy(&raw[2], &stage->gain_db, sizeof(float));
+	*p++ = (uint8_t) stage->type;
+	for (int i=0; i<3; i++)
+		p = put_u32(p, raw[i]);
+	return p;
+}
+
+/**
+ * @brief Encode the stats in the order of struct chain_cmd_stats
+ */
+static uint8_t * put_stats(uint8_t * p, const struct chain_cmd_stats * s)
+{
+	p = put_u32(p, s->fs);
+	p = put_u32(p, s->samples);
+	p = put_u32(p, s->cycles);
+	*p++ = s->flags;
+	p = put_u16(p, s->load);
+	p = put_u16(p, s->peak);
+	p = put_u32(p, s->late_blocks);
+	p = put_u32(p, s->overruns);
+	for (int i=0; i<4; i++)
+		p = put_u16(p, (uint16_t) s->adc[i]);
+	p = put_u32(p, s->adc_clips);
+	for (int i=0; i<4; i++)
+		p = put_u16(p, (uint16_t) s->dac[i]);
+	return put_u32(p, s->dac_clips);
+}
+
+/**
+ * @brief Queue a response frame. If there is no room, the response is
+ * 		dropped and the host times out.
+ */
+static void chain_cmd_respond(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	size_t size = CHAIN_CMD_FRAME_SIZE(len);
+	uint8_t checksum;
+
+	if (m_tx_pos) {
+		memmove(m_tx, &m_tx[m_tx_pos], m_tx_len - m_tx_pos);
+		m_tx_len -= m_tx_pos;
+		m_tx_pos = 0;
+	}
+	if (m_tx_len + size > sizeof(m_tx))
+		return;
+
+	uint8_t * p = &m_tx[m_tx_len];
+	p[0] = CHAIN_CMD_SYNC0;
+	p[1] = CHAIN_CMD_SYNC1;
+	p[2] = type | CHAIN_CMD_RESPONSE;
+	p[3] = len;
+	memcpy(&p[CHAIN_CMD_HEADER_SIZE], payload, len);
+	checksum = 0;
+	for (size_t i=2; i<size - 1; i++)
+		checksum ^= p[i];
+	p[size - 1] = checksum;
+	m_tx_len += size;
+
+	chain_cmd_update();
+}
+
+/**
+ * @brief Run an edit command. The edit is committed at once.
+ * @param[in] type The command
+ * @param[in] payload The payload, with a valid length for the command
+ * @param[out] index The index of an inserted stage
+ * @return The status
+ */
+static enum chain_cmd_status chain_cmd_edit(uint8_t type, const uint8_t * payload,
+		uint8_t * index)
+{
+	struct biquad_params stage;
+	int ret = -1;
+
+	if (filter_chain_busy())
+		return CHAIN_CMD_ERR_BUSY;
+
+	switch (type) {
+	case CHAIN_CMD_INSERT:
+		if (get_stage(&payload[1], &stage) < 0)
+			return CHAIN_CMD_ERR_PARAM;
+		ret = filter_chain_insert(payload[0], stage.type, stage.fc, stage.q, stage.gain_db);
+		if (ret >= 0)
+			*index = (uint8_t) ret;
+		break;
+	case CHAIN_CMD_REMOVE:
+		ret = filter_chain_remove(payload[0]);
+		break;
+	case CHAIN_CMD_SET:
+		if (get_stage(&payload[1], &stage) < 0)
+			return CHAIN_CMD_ERR_PARAM;
+		ret = filter_chain_set_stage(payload[0], stage.type, stage.fc, stage.q, stage.gain_db);
+		break;
+	case CHAIN_CMD_BYPASS:
+		ret = filter_chain_set_bypass(payload[0], payload[1]);
+		break;
+	}
+	if (ret < 0)
+		return CHAIN_CMD_ERR_PARAM;
+	return (filter_chain_commit() < 0) ? CHAIN_CMD_ERR_BUSY : CHAIN_CMD_OK;
+}
+
+/**
+ * @brief Run a command and queue its response
+ */
+static void chain_cmd_handle(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	uint8_t resp[CHAIN_CMD_MAX_PAYLOAD];
+	uint8_t * p = &resp[1];
+	struct biquad_params stage;
+	uint8_t expected;
+
+	switch (type) {
+	case CHAIN_CMD_LIST:
+	case CHAIN_CMD_STATS:
+		expected = 0;
+		break;
+	case CHAIN_CMD_GET:
+	case CHAIN_CMD_REMOVE:
+		expected = 1;
+		break;
+	case CHAIN_CMD_BYPASS:
+		expected = 2;
+		break;
+	case CHAIN_CMD_RATE:
+		expected = 4;
+		break;
+	case CHAIN_CMD_INSERT:
+	case CHAIN_CMD_SET:
+		expected = 1 + STAGE_SIZE;
+		break;
+	default:
+		resp[0] = CHAIN_CMD_ERR_UNKNOWN;
+		chain_cmd_respond(type, resp, 1);
+		return;
+	}
+	if (len != expected) {
+		resp[0] = CHAIN_CMD_ERR_LENGTH;
+		chain_cmd_respond(type, resp, 1);
+		return;
+	}
+
+	resp[0] = CHAIN_CMD_OK;
+	switch (type) {
+	case CHAIN_CMD_LIST:
+		p = put_u32(p, sample_rate_get());
+		*p++ = filter_chain_get_num_of_stages();
+		*p++ = FILTER_CHAIN_MAX_STAGES;
+		break;
+	case CHAIN_CMD_GET: {
+		uint8_t bypass;
+		if (filter_chain_get_stage(payload[0], &stage, &bypass) < 0) {
+			resp[0] = CHAIN_CMD_ERR_PARAM;
+			break;
+		}
+		*p++ = payload[0];
+		*p++ = bypass;
+		p = put_stage(p, &stage);
+		break;
+	}
+	case CHAIN_CMD_STATS: {
+		struct chain_cmd_stats stats;
+		memset(&stats, 0, sizeof(stats));
+		stats.fs = sample_rate_get();
+		if (m_stats)
+			m_stats(&stats);
+		p = put_stats(p, &stats);
+		break;
+	}
+	case CHAIN_CMD_RATE: {
+		uint32_t fs;
+		/* the stages are redesigned, so not during a swap */
+		if (filter_chain_busy()) {
+			resp[0] = CHAIN_CMD_ERR_BUSY;
+			break;
+		}
+		if (!(fs = sample_rate_set(get_u32(payload)))) {
+			resp[0] = CHAIN_CMD_ERR_PARAM;
+			break;
+		}
+		p = put_u32(p, fs);
+		break;
+	}
+	default: {
+		uint8_t index = 0;
+		resp[0] = chain_cmd_edit(type, payload, &index);
+		if (type == CHAIN_CMD_INSERT && resp[0] == CHAIN_CMD_OK)
+			*p++ = index;
+		break;
+	}
+	}
+	chain_cmd_respond(type, resp, (uint8_t) (p - resp));
+}
+
+/**
+ * @brief Initialize the protocol
+ * @param[in] fp_send The send callback of the responses
+ * @param[in] fp_stats The callback of the CHAIN_CMD_STATS command, can be
+ * 		NULL. The fs is already filled.
+ */
+void chain_cmd_init(chain_cmd_send_t fp_send, chain_cmd_stats_t fp_stats)
+{
+	m_send = fp_send;
+	m_stats = fp_stats;
+	m_tx_len = 0;
+	m_tx_pos = 0;
+}
+
+/**
+ * @brief Parse the frames of a received chunk and run the commands. The
+ * 		bytes outside of the frames and the frames with a bad checksum are
+ * 		skipped. Call it from the main loop.
+ * @param[in] buffer The received bytes
+ * @param[in] len Number of bytes
+ */
+void chain_cmd_parse(const uint8_t * buffer, size_t len)
+{
+	size_t i = 0;
+
+	while (i + CHAIN_CMD_FRAME_SIZE(0) <= len) {
+		const uint8_t * frame = &buffer[i];
+		uint8_t checksum = 0;
+
+		if (frame[0] != CHAIN_CMD_SYNC0 || frame[1] != CHAIN_CMD_SYNC1) {
+			i++;
+			continue;
+		}
+		size_t size = CHAIN_CMD_FRAME_SIZE(frame[3]);
+		if (frame[3] > CHAIN_CMD_MAX_PAYLOAD || i + size > len) {
+			i++;
+			continue;
+		}
+		for (size_t k=2; k<size - 1; k++)
+			checksum ^= frame[k];
+		if (checksum != frame[size - 1] || (frame[2] & CHAIN_CMD_RESPONSE)) {
+			i++;
+			continue;
+		}
+		chain_cmd_handle(frame[2], &frame[CHAIN_CMD_HEADER_SIZE], frame[3]);
+		i += size;
+	}
+}
+
+/**
+ * @brief Send what the send callback couldn't take before. Call it from
+ * 		the main loop.
+ */
+void chain_cmd_update(void)
+{
+	if (m_tx_pos == m_tx_len || !m_send)
+		return;
+	m_tx_pos += m_send(&m_tx[m_tx_pos], m_tx_len - m_tx_pos);
+	if (m_tx_pos == m_tx_len) {
+		m_tx_len = 0;
+		m_tx_pos = 0;
+	}
+}
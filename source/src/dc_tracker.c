@@ -0,0 +1,54 @@
+/*
+ * dc_tracker.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include "dc_tracker.h"
+
+/**
+ * @brief Initialize a tracker. The offset starts at the mid-scale and the
+ * 		first update replaces it with the mean of the first block.
+ * @param[in] dc The tracker instance
+ * @param[in] shift The time constant is 2^shift blocks
+ * @param[in] startup_blocks Number of blocks of the startup average
+ */
+void dc_tracker_init(struct dc_tracker * dc, uint8_t shift, uint16_t startup_blocks)
+{
+	dc->offset = DC_TRACKER_MID_SCALE;
+	dc->startup_blocks = startup_blocks;
+	dc->count = 0;
+	dc->shift = shift;
+}
+
+/**
+ * @brief Update the offset with a block of ADC samples. This is called
+ * 		from the interrupt, before the samples are converted.
+ * @param[in] dc The tracker instance
+ * @param[in] src The 12-bit ADC samples
+ * @param[in] len Number of samples, up to 2^20 / 2^8 = 4096
+ * @param[in] stride The distance of two samples in the buffer, e.g. 2 for
+ * 		one channel of the packed stereo samples
+ * @return The new offset in Q16
+ */
+int32_t dc_tracker_update(struct dc_tracker * dc, const uint16_t * src, size_t len,
+		size_t stride)
+{
+	uint32_t sum = 0;
+	int32_t offset = dc->offset;
+	int32_t mean;
+
+	for (size_t i=0; i<len; i++)
+		sum += src[i * stride];
+	/* the 12-bit sum has room for 8 fractional bits before the division */
+	mean = (int32_t) (((sum << 8) / len) << 8);
+
+	if (dc->count < dc->startup_blocks) {
+		/* running average of the block means */
+		dc->count++;
+		offset += (mean - offset) / dc->count;
+	}
+	else
+		offset += (mean - offset) >> dc->shift;
+	dc->offset = offset;
+	return offset;
+}
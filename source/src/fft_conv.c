@@ -0,0 +1,123 @@
+/*
+ * fft_conv.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include "fft_conv.h"
+
+/**
+ * @brief Prepare a convolution with an impulse response. This also clears
+ * 		the delay line, so detach the instance from the filter chain first.
+ * @param[in] conv The convolution instance
+ * @param[in] partition_size The partition size and latency in samples
+ * @param[in] ir The impulse response
+ * @param[in] ir_len Number of IR samples
+ * @return 0 on success or -1 on invalid sizes
+ */
+int fft_conv_init(struct fft_conv * conv, uint16_t partition_size,
+		const float32_t * ir, uint16_t ir_len)
+{
+	uint16_t fft_len = 2 * partition_size;
+
+	if (!ir_len || ir_len > FFT_CONV_MAX_TAPS ||
+			partition_size > FFT_CONV_MAX_PARTITION_SIZE ||
+			(partition_size & (partition_size - 1)))
+		return -1;
+	memset(conv, 0, sizeof(*conv));
+	if (arm_rfft_fast_init_f32(&conv->rfft, fft_len) != ARM_MATH_SUCCESS)
+		return -1;
+
+	conv->partition_size = partition_size;
+	conv->num_of_partitions = (ir_len + partition_size - 1) / partition_size;
+
+	/* zero padded partitions, so the second half of each circular
+	 * convolution is the linear one */
+	for (int p=0; p<conv->num_of_partitions; p++) {
+		uint16_t offset = p * partition_size;
+		uint16_t n = ir_len - offset;
+
+		if (n > partition_size)
+			n = partition_size;
+		arm_fill_f32(0, conv->tmp, fft_len);
+		arm_copy_f32((float32_t *) &ir[offset], conv->tmp, n);
+		arm_rfft_fast_f32(&conv->rfft, conv->tmp, &conv->h[p * fft_len], 0);
+	}
+	return 0;
+}
+
+/**
+ * @brief Multiply two spectra in the arm_rfft_fast_f32 format
+ */
+static inline void fft_conv_mult(const float32_t * x, const float32_t * h,
+		float32_t * dst, uint16_t fft_len)
+{
+	arm_cmplx_mult_cmplx_f32((float32_t *) x, (float32_t *) h, dst, fft_len / 2);
+	/* the first pair are the real DC and Nyquist bins */
+	dst[0] = x[0] * h[0];
+	dst[1] = x[1] * h[1];
+}
+
+/**
+ * @brief Convolve the completed input block with the IR
+ */
+static void fft_conv_partition(struct fft_conv * conv)
+{
+	uint16_t size = conv->partition_size;
+	uint16_t fft_len = 2 * size;
+	uint16_t k = conv->fdl_pos;
+
+	/* arm_rfft_fast_f32 uses its input as scratch */
+	arm_copy_f32(conv->in, conv->tmp, fft_len);
+	arm_rfft_fast_f32(&conv->rfft, conv->tmp, &conv->fdl[k * fft_len], 0);
+	arm_copy_f32(&conv->in[size], conv->in, size);
+
+	/* Y = sum(X[n - p] * H[p]) */
+	fft_conv_mult(&conv->fdl[k * fft_len], conv->h, conv->acc, fft_len);
+	for (int p=1; p<conv->num_of_partitions; p++) {
+		k = k ? k - 1 : conv->num_of_partitions - 1;
+		fft_conv_mult(&conv->fdl[k * fft_len], &conv->h[p * fft_len], conv->tmp, fft_len);
+		arm_add_f32(conv->acc, conv->tmp, conv->acc, fft_len);
+	}
+
+	arm_rfft_fast_f32(&conv->rfft, conv->acc, conv->tmp, 1);
+	arm_copy_f32(&conv->tmp[size], conv->out, size);
+
+	if (++conv->fdl_pos >= conv->num_of_partitions)
+		conv->fdl_pos = 0;
+}
+
+/**
+ * @brief Convolve a buffer in-place. The output is delayed by the partition size.
+ * @param[in] conv The convolution instance
+ * @param[in,out] buf The samples
+ * @param[in] len Number of samples
+ * @param[in] stride The distance of two samples in the buffer, e.g. 2 for
+ * 		one channel of interleaved stereo
+ */
+void fft_conv_process(struct fft_conv * conv, float32_t * buf, size_t len,
+		size_t stride)
+{
+	uint16_t size = conv->partition_size;
+
+	while (len) {
+		size_t n = size - conv->pos;
+		float32_t * in = &conv->in[size + conv->pos];
+		float32_t * out = &conv->out[conv->pos];
+
+		if (n > len)
+			n = len;
+		for (size_t i=0; i<n; i++) {
+			in[i] = buf[i * stride];
+			buf[i * stride] = out[i];
+		}
+		buf += n * stride;
+		len -= n;
+
+		conv->pos += n;
+		if (conv->pos == size) {
+			fft_conv_partition(conv);
+			conv->pos = 0;
+		}
+	}
+}
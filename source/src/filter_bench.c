@@ -0,0 +1,207 @@
+/*
+ * filter_bench.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include "filter_bench.h"
+#include "filter_chain.h"
+#ifdef USE_FFT_CONV
+#include "fft_conv_ir.h"
+#endif
+
+#ifdef USE_HOST
+#include <time.h>
+#else
+#include "stm32f30x.h"
+#endif
+
+/* The two core clocks of the stage budget */
+#define BENCH_CLOCK_DEFAULT 72000000
+#define BENCH_CLOCK_OVERCLOCK 128000000
+
+static uint16_t m_buffer[FILTER_BENCH_SAMPLES];
+#ifdef USE_FFT_CONV
+static struct fft_conv m_conv;
+#endif
+#ifdef USE_OVERSAMPLING
+static struct oversampling m_os;
+#endif
+#ifdef USE_DC_TRACKER
+static struct dc_tracker m_dc;
+#endif
+
+/**
+ * @brief Get the benchmark time. Cycles on the target, ns on the host
+ */
+static inline uint32_t filter_bench_ticks(void)
+{
+#ifdef USE_HOST
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#else
+	return DWT->CYCCNT;
+#endif
+}
+
+/**
+ * @brief Fill the buffer with a full scale 12-bit sawtooth
+ */
+static void filter_bench_fill(void)
+{
+	for (int i=0; i<FILTER_BENCH_SAMPLES; i++)
+		m_buffer[i] = (uint16_t) ((i * 37) & DAC_MAX_VALUE);
+}
+
+/**
+ * @brief Run the current chain over the buffer
+ * @param[in] len Number of samples at the sample rate of the chain. With
+ * 		oversampling the buffer has len * M samples.
+ * @return The time in hundredths of a tick per sample
+ */
+static uint32_t filter_bench_process(uint32_t repeats, uint32_t len)
+{
+	uint64_t ticks = 0;
+
+	for (uint32_t r=0; r<repeats; r++) {
+		filter_bench_fill();
+		/* every pass is timed alone, so the 32-bit counter can't wrap */
+		uint32_t start = filter_bench_ticks();
+		filter_chain_process(m_buffer, m_buffer, len);
+		ticks += filter_bench_ticks() - start;
+	}
+	return (uint32_t) (ticks * 100 / ((uint64_t) repeats * len));
+}
+
+/**
+ * @brief Get the average time of the coefficient calculation in ticks
+ */
+static uint32_t filter_bench_design(const struct biquad_params * params, uint32_t fs)
+{
+	float32_t coeffs[BIQUAD_NUM_COEFFS];
+	uint32_t start = filter_bench_ticks();
+
+	for (int i=0; i<FILTER_BENCH_DESIGN_RUNS; i++)
+		biquad_design(params, fs, coeffs);
+	return (filter_bench_ticks() - start) / FILTER_BENCH_DESIGN_RUNS;
+}
+
+#ifndef USE_HOST
+/**
+ * @brief Number of stages that fit in a sample period
+ * @param[in] clock The core clock
+ * @param[in] fs The sample rate
+ * @param[in] pass The passthrough cost in hundredths of cycle per sample
+ * @param[in] cps The filter cost in hundredths of cycle per sample
+ */
+static uint32_t filter_bench_stages(uint32_t clock, uint32_t fs, uint32_t pass,
+		uint32_t cps)
+{
+	uint32_t budget = clock / fs * 100;
+
+	if (cps <= pass || budget <= pass)
+		return 0;
+	return (budget - pass) / (cps - pass);
+}
+#endif
+
+static void filter_bench_print(const char * name, uint32_t design, uint32_t tps,
+		uint32_t fs, uint32_t pass)
+{
+	printf("%s,%s,%d,%d,%d.%02d,", name, filter_chain_get_precision(),
+			DSP_BLOCK_SIZE, (int) design, (int) (tps / 100), (int) (tps % 100));
+#ifdef USE_HOST
+	printf("%d\n", tps ? (int) (100000000000ULL / tps) : 0);
+#else
+	printf("%d,%d\n",
+			(int) filter_bench_stages(BENCH_CLOCK_DEFAULT, fs, pass, tps),
+			(int) filter_bench_stages(BENCH_CLOCK_OVERCLOCK, fs, pass, tps));
+#endif
+}
+
+/**
+ * @brief Benchmark all the filter types and print the results as CSV.
+ * 		This re-initializes the filter chain.
+ * @param[in] fs The sample rate that is used for the coefficients
+ * @param[in] repeats The number of passes over the benchmark buffer
+ */
+void filter_bench_run(uint32_t fs, uint32_t repeats)
+{
+	struct biquad_params params = {
+		.fc = (float) fs / 8,
+		.q = 0,
+		.gain_db = 6.0f,
+	};
+
+	if (!repeats)
+		repeats = 1;
+
+#ifdef USE_HOST
+	printf("filter,precision,block_size,design_ns,ns_per_sample,samples_per_sec\n");
+#else
+	printf("filter,precision,block_size,design_cycles,cycles_per_sample,stages_72mhz,stages_128mhz\n");
+#endif
+
+	filter_chain_init(fs);
+	uint32_t pass = filter_bench_process(repeats, FILTER_BENCH_SAMPLES);
+	filter_bench_print("passthrough", 0, pass, fs, pass);
+
+	for (int type=0; type<FILTER_NUM_OF_TYPES; type++) {
+		params.type = (enum biquad_type) type;
+
+		filter_chain_clear();
+		filter_chain_add(params.type, params.fc, params.q, params.gain_db);
+		filter_chain_commit();
+
+		uint32_t design = filter_bench_design(&params, fs);
+		uint32_t tps = filter_bench_process(repeats, FILTER_BENCH_SAMPLES);
+		filter_bench_print(biquad_type_name(params.type), design, tps, fs, pass);
+	}
+	filter_chain_clear();
+	filter_chain_commit();
+
+#ifdef USE_FFT_CONV
+	/* the IR convolution alone, with the partition size of the firmware */
+	char name[24];
+	uint32_t start = filter_bench_ticks();
+	if (fft_conv_init(&m_conv, DSP_BLOCK_SIZE, fft_conv_ir, FFT_CONV_IR_TAPS) == 0) {
+		uint32_t design = filter_bench_ticks() - start;
+		filter_chain_set_conv(0, &m_conv);
+		uint32_t tps = filter_bench_process(repeats, FILTER_BENCH_SAMPLES);
+		filter_chain_set_conv(0, NULL);
+		snprintf(name, sizeof(name), "fft_conv_%d", FFT_CONV_IR_TAPS);
+		filter_bench_print(name, design, tps, fs, pass);
+	}
+#endif
+
+#ifdef USE_DC_TRACKER
+	/* the offset tracking alone */
+	dc_tracker_init(&m_dc, DC_TRACKER_SHIFT, DC_TRACKER_STARTUP_BLOCKS);
+	filter_chain_set_dc_tracker(0, &m_dc);
+	uint32_t tps_dc = filter_bench_process(repeats, FILTER_BENCH_SAMPLES);
+	filter_chain_set_dc_tracker(0, NULL);
+	filter_bench_print("dc_tracker", 0, tps_dc, fs, pass);
+#endif
+
+#ifdef USE_OVERSAMPLING
+	/* the decimation (and interpolation) alone, for every factor */
+	for (uint8_t factor=2; factor<=OVERSAMPLING_MAX_FACTOR; factor++) {
+		char name[24];
+#ifdef USE_OVERSAMPLED_DAC
+		uint8_t interpolate = 1;
+#else
+		uint8_t interpolate = 0;
+#endif
+		uint32_t start = filter_bench_ticks();
+		oversampling_init(&m_os, factor, interpolate);
+		uint32_t design = filter_bench_ticks() - start;
+
+		filter_chain_set_oversampling(&m_os);
+		uint32_t tps = filter_bench_process(repeats, FILTER_BENCH_SAMPLES / factor);
+		filter_chain_set_oversampling(NULL);
+		snprintf(name, sizeof(name), "oversampling_x%d", factor);
+		filter_bench_print(name, design, tps, fs, pass);
+	}
+#endif
+}
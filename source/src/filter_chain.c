@@ -0,0 +1,889 @@
+/*
+ * filter_chain.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include "filter_chain.h"
+#include "profiler.h"
+
+#if defined(USE_FPU)
+#define ADC_TO_F32 (1.0f / ADC_MID_SCALE)
+typedef float32_t chain_sample_t;
+typedef arm_biquad_cascade_df2T_instance_f32 chain_inst_t;
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+/* 12-bit to Q15 */
+#define ADC_Q_SHIFT 4
+typedef q15_t chain_sample_t;
+typedef arm_biquad_casd_df1_inst_q15 chain_inst_t;
+#elif defined(DSP_Q_FORMAT_Q31)
+/* 12-bit to Q31 */
+#define ADC_Q_SHIFT 20
+typedef q31_t chain_sample_t;
+typedef arm_biquad_casd_df1_inst_q31 chain_inst_t;
+#else
+#define ADC_Q_SHIFT 20
+typedef q31_t chain_sample_t;
+typedef arm_biquad_cas_df1_32x64_ins_q31 chain_inst_t;
+#endif
+
+#ifdef USE_STEREO
+#define CHAIN_NUM_OF_CHANNELS 2
+#else
+#define CHAIN_NUM_OF_CHANNELS 1
+#endif
+
+/* The coefficients that the cascade kernel uses from a bank */
+#ifdef USE_FPU
+#define BANK_COEFFS(bank) ((bank)->coeffs)
+#define BANK_POST_SHIFT(bank) 0
+#else
+#define BANK_COEFFS(bank) ((bank)->coeffs_q)
+#define BANK_POST_SHIFT(bank) ((bank)->post_shift)
+#endif
+
+/* Clear the state of the stages from `from` and up */
+#define CLEAR_STATE(state, from) \
+	memset(&(state)[(from) * (sizeof(state) / sizeof((state)[0]) / FILTER_CHAIN_MAX_STAGES)], 0, \
+			(FILTER_CHAIN_MAX_STAGES - (from)) * (sizeof(state) / FILTER_CHAIN_MAX_STAGES))
+
+static struct filter_chain m_chain;
+static chain_sample_t m_work[CHAIN_NUM_OF_CHANNELS * DSP_BLOCK_SIZE];
+
+#ifndef USE_FPU
+/**
+ * @brief Find the post-shift that brings all the coefficients of a bank
+ * 		in the [-1, 1) range
+ */
+static uint8_t filter_chain_get_post_shift(const struct filter_chain_bank * bank)
+{
+	float32_t max = 0;
+	uint8_t shift = 0;
+
+	for (int i=0; i<bank->num_of_stages * BIQUAD_NUM_COEFFS; i++) {
+		float32_t c = bank->coeffs[i];
+		if (c < 0) c = -c;
+		if (c > max) max = c;
+	}
+	while (max >= (float32_t) (1 << shift))
+		shift++;
+	return shift;
+}
+
+/**
+ * @brief Convert a float to a Q format with `bits` fractional bits, with
+ * 		rounding and saturation
+ */
+static int32_t filter_chain_quantize(float32_t value, uint8_t bits)
+{
+	float32_t max = (float32_t) (1UL << bits);
+	float32_t x = value * max;
+
+	if (x >= max) return (int32_t) ((1UL << bits) - 1);
+	if (x <= -max) return -(int32_t) ((1UL << bits) - 1) - 1;
+	return (int32_t) (x + ((x >= 0) ? 0.5f : -0.5f));
+}
+
+/**
+ * @brief Quantize the float coefficients of a bank to the kernel format
+ */
+static void filter_chain_quantize_bank(struct filter_chain_bank * bank)
+{
+	uint8_t shift = filter_chain_get_post_shift(bank);
+	float32_t scale = 1.0f / (float32_t) (1 << shift);
+
+	for (int s=0; s<bank->num_of_stages; s++) {
+		float32_t * c = &bank->coeffs[s * BIQUAD_NUM_COEFFS];
+		filter_chain_coeff_t * q = &bank->coeffs_q[s * FILTER_CHAIN_STAGE_COEFFS];
+#if defined(DSP_Q_FORMAT_FAST_Q15)
+		q[0] = (q15_t) filter_chain_quantize(c[0] * scale, 15);
+		q[1] = 0;
+		q[2] = (q15_t) filter_chain_quantize(c[1] * scale, 15);
+		q[3] = (q15_t) filter_chain_quantize(c[2] * scale, 15);
+		q[4] = (q15_t) filter_chain_quantize(c[3] * scale, 15);
+		q[5] = (q15_t) filter_chain_quantize(c[4] * scale, 15);
+#else
+		for (int i=0; i<BIQUAD_NUM_COEFFS; i++)
+			q[i] = filter_chain_quantize(c[i] * scale, 31);
+#endif
+	}
+	bank->post_shift = shift;
+}
+#endif
+
+/**
+ * @brief Design a stage of a bank, or the unity coefficients if it's
+ * 		bypassed
+ * @return 0 on success or -1 if the stage is not valid at fs
+ */
+static int filter_chain_design_stage(const struct filter_chain_bank * bank, uint8_t index,
+		uint32_t fs, float32_t * coeffs)
+{
+	if (bank->bypass[index]) {
+		memset(coeffs, 0, BIQUAD_NUM_COEFFS * sizeof(float32_t));
+		coeffs[0] = 1.0f;
+		return 0;
+	}
+	return biquad_design(&bank->stages[index], fs, coeffs);
+}
+
+/**
+ * @brief Point all the cascade instances to a coefficient set. This doesn't
+ * 		touch the filter state, so it's safe between two blocks.
+ */
+static inline void filter_chain_use_coeffs(filter_chain_coeff_t * coeffs,
+		uint8_t num_of_stages, uint8_t shift)
+{
+	m_chain.inst.numStages = num_of_stages;
+	m_chain.inst.pCoeffs = coeffs;
+#ifndef USE_FPU
+	m_chain.inst.postShift = shift;
+#endif
+#if defined(USE_STEREO) && defined(USE_FPU)
+	m_chain.inst_stereo.numStages = num_of_stages;
+	m_chain.inst_stereo.pCoeffs = coeffs;
+#elif defined(USE_STEREO)
+	/* the second channel shares the coefficients */
+	m_chain.inst_ch2.numStages = num_of_stages;
+	m_chain.inst_ch2.pCoeffs = coeffs;
+	m_chain.inst_ch2.postShift = shift;
+#endif
+}
+
+/**
+ * @brief Clear the filter state of the stages from `from` and up
+ */
+static void filter_chain_clear_state(uint8_t from)
+{
+	CLEAR_STATE(m_chain.state, from);
+#if defined(USE_STEREO) && defined(USE_FPU)
+	CLEAR_STATE(m_chain.state_stereo, from);
+#elif defined(USE_STEREO)
+	CLEAR_STATE(m_chain.state_ch2, from);
+#endif
+}
+
+/**
+ * @brief Get the bank that the main loop edits
+ * @param[in] copy Start from a copy of the active bank
+ * @return The bank or NULL while a swap is in progress
+ */
+static struct filter_chain_bank * filter_chain_get_edit_bank(uint8_t copy)
+{
+	if (m_chain.swap != FILTER_CHAIN_SWAP_IDLE)
+		return NULL;
+
+	struct filter_chain_bank * bank = &m_chain.banks[m_chain.active ^ 1];
+	if (!m_chain.edit_ready) {
+		if (copy)
+			memcpy(bank, &m_chain.banks[m_chain.active], sizeof(*bank));
+		m_chain.edit_ready = 1;
+	}
+	return bank;
+}
+
+/**
+ * @brief Initialize an empty chain. This also resets the filter state and
+ * 		the ramp, so don't call it while the interrupt is running.
+ * @param[in] fs The sample rate that is used for the coefficients
+ */
+void filter_chain_init(uint32_t fs)
+{
+	memset(&m_chain, 0, sizeof(m_chain));
+	m_chain.fs = fs;
+
+#if defined(USE_FPU)
+	arm_biquad_cascade_df2T_init_f32(&m_chain.inst, 0, m_chain.banks[0].coeffs, m_chain.state);
+#ifdef USE_STEREO
+	arm_biquad_cascade_stereo_df2T_init_f32(&m_chain.inst_stereo, 0,
+			m_chain.banks[0].coeffs, m_chain.state_stereo);
+#endif
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+	arm_biquad_cascade_df1_init_q15(&m_chain.inst, 0, m_chain.banks[0].coeffs_q, m_chain.state, 0);
+#ifdef USE_STEREO
+	arm_biquad_cascade_df1_init_q15(&m_chain.inst_ch2, 0, m_chain.banks[0].coeffs_q, m_chain.state_ch2, 0);
+#endif
+#elif defined(DSP_Q_FORMAT_Q31)
+	arm_biquad_cascade_df1_init_q31(&m_chain.inst, 0, m_chain.banks[0].coeffs_q, m_chain.state, 0);
+#ifdef USE_STEREO
+	arm_biquad_cascade_df1_init_q31(&m_chain.inst_ch2, 0, m_chain.banks[0].coeffs_q, m_chain.state_ch2, 0);
+#endif
+#else
+	arm_biquad_cas_df1_32x64_init_q31(&m_chain.inst, 0, m_chain.banks[0].coeffs_q, m_chain.state, 0);
+#ifdef USE_STEREO
+	arm_biquad_cas_df1_32x64_init_q31(&m_chain.inst_ch2, 0, m_chain.banks[0].coeffs_q, m_chain.state_ch2, 0);
+#endif
+#endif
+}
+
+/**
+ * @brief Set how the coefficients change on the next swaps
+ * @param[in] ramp The ramp type
+ * @param[in] len The ramp duration in samples
+ * @return 0 on success or -1 while a swap is in progress
+ */
+int filter_chain_set_ramp(enum filter_chain_ramp ramp, uint16_t len)
+{
+	if (m_chain.swap != FILTER_CHAIN_SWAP_IDLE)
+		return -1;
+
+	m_chain.ramp = len ? ramp : FILTER_CHAIN_RAMP_NONE;
+	m_chain.ramp_len = len;
+	if (ramp == FILTER_CHAIN_RAMP_EXP && len) {
+		/* the time constant is 1/5 of the ramp, so it's at 99.3% at the end */
+		float32_t k = 1.0f - expf(-5.0f * FILTER_CHAIN_RAMP_STEP / len);
+#ifdef USE_FPU
+		m_chain.ramp_k = k;
+#else
+		m_chain.ramp_k = filter_chain_quantize(k, 31);
+#endif
+	}
+	return 0;
+}
+
+/**
+ * @brief Remove all the filters from the edited bank
+ * @return 0 on success or -1 while a swap is in progress
+ */
+int filter_chain_clear(void)
+{
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(0);
+	if (!bank)
+		return -1;
+
+	bank->num_of_stages = 0;
+	return 0;
+}
+
+/**
+ * @brief Append a biquad stage at the end of the edited bank
+ * @param[in] type The filter type
+ * @param[in] fc The corner/center frequency in Hz
+ * @param[in] q The quality factor (0 for the default 0.7071)
+ * @param[in] gain_db The gain in dB for the shelving/parametric filters
+ * @return The stage index or -1 on error
+ */
+int filter_chain_add(enum biquad_type type, float fc, float q, float gain_db)
+{
+	return filter_chain_insert(FILTER_CHAIN_MAX_STAGES, type, fc, q, gain_db);
+}
+
+/**
+ * @brief Insert a biquad stage in the edited bank. The stages from index
+ * 		and up move one position down.
+ * @param[in] index The position of the new stage, an index after the last
+ * 		stage appends it
+ * @param[in] type The filter type
+ * @param[in] fc The corner/center frequency in Hz
+ * @param[in] q The quality factor (0 for the default 0.7071)
+ * @param[in] gain_db The gain in dB for the shelving/parametric filters
+ * @return The stage index or -1 on error
+ */
+int filter_chain_insert(uint8_t index, enum biquad_type type, float fc, float q,
+		float gain_db)
+{
+	struct biquad_params p = { .type = type, .fc = fc, .q = q, .gain_db = gain_db };
+	float32_t coeffs[BIQUAD_NUM_COEFFS];
+
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(1);
+	if (!bank || bank->num_of_stages >= FILTER_CHAIN_MAX_STAGES)
+		return -1;
+	if (biquad_design(&p, m_chain.fs, coeffs) < 0)
+		return -1;
+
+	if (index > bank->num_of_stages)
+		index = bank->num_of_stages;
+	uint8_t n = bank->num_of_stages - index;
+	memmove(&bank->stages[index + 1], &bank->stages[index], n * sizeof(struct biquad_params));
+	memmove(&bank->coeffs[(index + 1) * BIQUAD_NUM_COEFFS], &bank->coeffs[index * BIQUAD_NUM_COEFFS],
+			n * BIQUAD_NUM_COEFFS * sizeof(float32_t));
+	memmove(&bank->bypass[index + 1], &bank->bypass[index], n);
+
+	bank->stages[index] = p;
+	memcpy(&bank->coeffs[index * BIQUAD_NUM_COEFFS], coeffs, sizeof(coeffs));
+	bank->bypass[index] = 0;
+	bank->num_of_stages++;
+	return index;
+}
+
+/**
+ * @brief Remove a stage from the edited bank. The next stages move one
+ * 		position up.
+ * @param[in] index The stage index
+ * @return 0 on success or -1 on error
+ */
+int filter_chain_remove(uint8_t index)
+{
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(1);
+	if (!bank || index >= bank->num_of_stages)
+		return -1;
+
+	uint8_t n = bank->num_of_stages - index - 1;
+	memmove(&bank->stages[index], &bank->stages[index + 1], n * sizeof(struct biquad_params));
+	memmove(&bank->coeffs[index * BIQUAD_NUM_COEFFS], &bank->coeffs[(index + 1) * BIQUAD_NUM_COEFFS],
+			n * BIQUAD_NUM_COEFFS * sizeof(float32_t));
+	memmove(&bank->bypass[index], &bank->bypass[index + 1], n);
+	bank->num_of_stages--;
+	return 0;
+}
+
+/**
+ * @brief Change the parameters of a stage of the edited bank. A bypassed
+ * 		stage stays bypassed, but the new parameters are checked.
+ * @param[in] index The stage index
+ * @param[in] type The filter type
+ * @param[in] fc The corner/center frequency in Hz
+ * @param[in] q The quality factor (0 for the default 0.7071)
+ * @param[in] gain_db The gain in dB for the shelving/parametric filters
+ * @return 0 on success or -1 on error. Then the stage is not changed.
+ */
+int filter_chain_set_stage(uint8_t index, enum biquad_type type, float fc, float q,
+		float gain_db)
+{
+	struct biquad_params p = { .type = type, .fc = fc, .q = q, .gain_db = gain_db };
+	float32_t coeffs[BIQUAD_NUM_COEFFS];
+
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(1);
+	if (!bank || index >= bank->num_of_stages)
+		return -1;
+	if (biquad_design(&p, m_chain.fs, coeffs) < 0)
+		return -1;
+
+	bank->stages[index] = p;
+	if (!bank->bypass[index])
+		memcpy(&bank->coeffs[index * BIQUAD_NUM_COEFFS], coeffs, sizeof(coeffs));
+	return 0;
+}
+
+/**
+ * @brief Bypass a stage of the edited bank or put it back
+ * @param[in] index The stage index
+ * @param[in] bypass 1 to bypass the stage, 0 to run its filter
+ * @return 0 on success or -1 on error
+ */
+int filter_chain_set_bypass(uint8_t index, uint8_t bypass)
+{
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(1);
+	if (!bank || index >= bank->num_of_stages)
+		return -1;
+
+	uint8_t prev = bank->bypass[index];
+	bank->bypass[index] = bypass ? 1 : 0;
+	if (filter_chain_design_stage(bank, index, m_chain.fs,
+			&bank->coeffs[index * BIQUAD_NUM_COEFFS]) < 0) {
+		bank->bypass[index] = prev;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Get a stage of the last commit, which is the chain that the
+ * 		interrupt runs after the swap. Call it from the main loop.
+ * @param[in] index The stage index
+ * @param[out] params The design parameters of the stage
+ * @param[out] bypass 1 if the stage is bypassed, can be NULL
+ * @return 0 on success or -1 on invalid index
+ */
+int filter_chain_get_stage(uint8_t index, struct biquad_params * params, uint8_t * bypass)
+{
+	const struct filter_chain_bank * bank = &m_chain.banks[m_chain.committed];
+
+	if (index >= bank->num_of_stages)
+		return -1;
+	*params = bank->stages[index];
+	if (bypass)
+		*bypass = bank->bypass[index];
+	return 0;
+}
+
+/**
+ * @brief Replace the edited bank with stages that are already designed,
+ * 		e.g. the build time tables of filter_chain_coeffs.h
+ * @param[in] params The parameters of each stage
+ * @param[in] coeffs BIQUAD_NUM_COEFFS coefficients per stage in CMSIS order
+ * @param[in] num_of_stages Number of stages
+ * @return 0 on success or -1 on error
+ */
+int filter_chain_load(const struct biquad_params * params, const float32_t * coeffs,
+		uint8_t num_of_stages)
+{
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(0);
+	if (!bank || num_of_stages > FILTER_CHAIN_MAX_STAGES)
+		return -1;
+
+	memcpy(bank->stages, params, num_of_stages * sizeof(struct biquad_params));
+	memcpy(bank->coeffs, coeffs, num_of_stages * BIQUAD_NUM_COEFFS * sizeof(float32_t));
+	memset(bank->bypass, 0, sizeof(bank->bypass));
+	bank->num_of_stages = num_of_stages;
+	return 0;
+}
+
+/**
+ * @brief Hand the edited bank to the interrupt. The banks are swapped at
+ * 		the start of the next processed block.
+ * @return 0 on success or -1 while a swap is in progress
+ */
+int filter_chain_commit(void)
+{
+	struct filter_chain_bank * bank = filter_chain_get_edit_bank(1);
+	if (!bank)
+		return -1;
+
+#ifndef USE_FPU
+	filter_chain_quantize_bank(bank);
+#endif
+	/* the interrupt only runs the stages of the active bank, so the state
+	 * of the rest is free to clear for the stages that are added */
+	filter_chain_clear_state(m_chain.banks[m_chain.active].num_of_stages);
+	m_chain.committed = m_chain.active ^ 1;
+	m_chain.edit_ready = 0;
+	__DMB();
+	m_chain.swap = FILTER_CHAIN_SWAP_PENDING;
+	return 0;
+}
+
+/**
+ * @brief Check if a swap is pending or ramping. Then the edit functions
+ * 		and filter_chain_commit() return -1.
+ */
+uint8_t filter_chain_busy(void)
+{
+	return m_chain.swap != FILTER_CHAIN_SWAP_IDLE;
+}
+
+/**
+ * @brief Swap the banks if there is a pending commit. Called at the start
+ * 		of every block.
+ */
+static inline void filter_chain_swap(void)
+{
+	if (m_chain.swap != FILTER_CHAIN_SWAP_PENDING)
+		return;
+
+	const struct filter_chain_bank * prev = &m_chain.banks[m_chain.active];
+	m_chain.active ^= 1;
+	struct filter_chain_bank * bank = &m_chain.banks[m_chain.active];
+
+	if (m_chain.ramp != FILTER_CHAIN_RAMP_NONE && bank->num_of_stages &&
+			prev->num_of_stages == bank->num_of_stages &&
+			BANK_POST_SHIFT(prev) == BANK_POST_SHIFT(bank)) {
+		m_chain.ramp_pos = 0;
+		filter_chain_use_coeffs(m_chain.ramp_coeffs, bank->num_of_stages,
+				BANK_POST_SHIFT(bank));
+		m_chain.swap = FILTER_CHAIN_SWAP_RAMP;
+	}
+	else {
+		filter_chain_use_coeffs(BANK_COEFFS(bank), bank->num_of_stages,
+				BANK_POST_SHIFT(bank));
+		m_chain.swap = FILTER_CHAIN_SWAP_IDLE;
+	}
+}
+
+/**
+ * @brief Update the ramp coefficients
+ * @param[in] n Number of samples left in the block
+ * @return Number of samples to process with the current coefficients
+ */
+static size_t filter_chain_ramp_step(size_t n)
+{
+	if (m_chain.swap != FILTER_CHAIN_SWAP_RAMP)
+		return n;
+
+	struct filter_chain_bank * bank = &m_chain.banks[m_chain.active];
+	if (m_chain.ramp_pos >= m_chain.ramp_len) {
+		filter_chain_use_coeffs(BANK_COEFFS(bank), bank->num_of_stages,
+				BANK_POST_SHIFT(bank));
+		m_chain.swap = FILTER_CHAIN_SWAP_IDLE;
+		return n;
+	}
+
+	const filter_chain_coeff_t * a = BANK_COEFFS(&m_chain.banks[m_chain.active ^ 1]);
+	const filter_chain_coeff_t * b = BANK_COEFFS(bank);
+	filter_chain_coeff_t * c = m_chain.ramp_coeffs;
+	int num = bank->num_of_stages * FILTER_CHAIN_STAGE_COEFFS;
+	size_t step = (n > FILTER_CHAIN_RAMP_STEP) ? FILTER_CHAIN_RAMP_STEP : n;
+
+	if (m_chain.ramp == FILTER_CHAIN_RAMP_LINEAR) {
+		uint32_t pos = m_chain.ramp_pos + step;
+		if (pos > m_chain.ramp_len)
+			pos = m_chain.ramp_len;
+#ifdef USE_FPU
+		float32_t t = (float32_t) pos / m_chain.ramp_len;
+		for (int i=0; i<num; i++)
+			c[i] = a[i] + (b[i] - a[i]) * t;
+#else
+		/* Q15 position */
+		int64_t t = ((int64_t) pos << 15) / m_chain.ramp_len;
+		for (int i=0; i<num; i++)
+			c[i] = a[i] + (filter_chain_coeff_t) ((((int64_t) b[i] - a[i]) * t) >> 15);
+#endif
+	}
+	else {
+		if (!m_chain.ramp_pos)
+			memcpy(c, a, num * sizeof(filter_chain_coeff_t));
+		for (int i=0; i<num; i++) {
+#ifdef USE_FPU
+			c[i] += (b[i] - c[i]) * m_chain.ramp_k;
+#else
+			c[i] += (filter_chain_coeff_t) ((((int64_t) b[i] - c[i]) * m_chain.ramp_k) >> 31);
+#endif
+		}
+	}
+	m_chain.ramp_pos += step;
+	return step;
+}
+
+/**
+ * @brief Change the sample rate and redesign the stages of the active bank
+ * 		for it. A pending commit is applied first. The coefficients and the
+ * 		filter state change at once, so like filter_chain_init() this is
+ * 		only for when the interrupt is stopped, e.g. to restart the
+ * 		sampling at another rate.
+ * @param[in] fs The new sample rate
+ * @return 0 on success or -1 if a stage is not valid at the new rate. Then
+ * 		the chain is not changed.
+ */
+int filter_chain_set_fs(uint32_t fs)
+{
+	float32_t coeffs[BIQUAD_NUM_COEFFS * FILTER_CHAIN_MAX_STAGES];
+
+	filter_chain_swap();
+	struct filter_chain_bank * bank = &m_chain.banks[m_chain.active];
+
+	for (int i=0; i<bank->num_of_stages; i++)
+		if (filter_chain_design_stage(bank, i, fs, &coeffs[i * BIQUAD_NUM_COEFFS]) < 0)
+			return -1;
+	memcpy(bank->coeffs, coeffs, bank->num_of_stages * BIQUAD_NUM_COEFFS * sizeof(float32_t));
+#ifndef USE_FPU
+	filter_chain_quantize_bank(bank);
+#endif
+
+	/* a ramp ends here and the edited bank starts over from the new one */
+	filter_chain_use_coeffs(BANK_COEFFS(bank), bank->num_of_stages, BANK_POST_SHIFT(bank));
+	filter_chain_clear_state(0);
+	m_chain.swap = FILTER_CHAIN_SWAP_IDLE;
+	m_chain.edit_ready = 0;
+	m_chain.fs = fs;
+	return 0;
+}
+
+#ifdef USE_FFT_CONV
+/**
+ * @brief Attach a convolution after the biquads of a channel. The change
+ * 		is seen from the next block, so wait a block before re-initializing
+ * 		a detached instance.
+ * @param[in] channel 0, or 1 for the second channel with USE_STEREO
+ * @param[in] conv An initialized instance or NULL to detach
+ * @return 0 on success or -1 on invalid channel
+ */
+int filter_chain_set_conv(uint8_t channel, struct fft_conv * conv)
+{
+	if (channel >= CHAIN_NUM_OF_CHANNELS)
+		return -1;
+	m_chain.conv[channel] = conv;
+	return 0;
+}
+#endif
+
+#ifdef USE_DC_TRACKER
+/**
+ * @brief Attach a DC tracker to the ADC input of a channel. Without a
+ * 		tracker the mid-scale is subtracted.
+ * @param[in] channel 0, or 1 for the second channel with USE_STEREO
+ * @param[in] dc An initialized instance or NULL to detach
+ * @return 0 on success or -1 on invalid channel
+ */
+int filter_chain_set_dc_tracker(uint8_t channel, struct dc_tracker * dc)
+{
+	if (channel >= CHAIN_NUM_OF_CHANNELS)
+		return -1;
+	m_chain.dc[channel] = dc;
+	return 0;
+}
+#endif
+
+#ifdef USE_OVERSAMPLING
+/**
+ * @brief Attach an oversampling front end to the chain. This changes the
+ * 		number of the ADC/DAC samples per block, so it has to be done
+ * 		before the sampling starts.
+ * @param[in] os An initialized instance or NULL to detach
+ */
+void filter_chain_set_oversampling(struct oversampling * os)
+{
+	m_chain.os = os;
+}
+#endif
+
+/**
+ * @brief Get the number of the stages of the last commit, which the
+ * 		interrupt runs after the swap
+ */
+uint8_t filter_chain_get_num_of_stages(void)
+{
+	return m_chain.banks[m_chain.committed].num_of_stages;
+}
+
+/**
+ * @brief Get the name of the cascade arithmetic
+ */
+const char * filter_chain_get_precision(void)
+{
+#if defined(USE_FPU)
+	return "f32";
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+	return "fast_q15";
+#elif defined(DSP_Q_FORMAT_Q31)
+	return "q31";
+#else
+	return "q31_64";
+#endif
+}
+
+/**
+ * @brief Run a buffer in-place through a cascade instance
+ */
+static inline void filter_chain_run(chain_inst_t * inst, chain_sample_t * buf, size_t n)
+{
+	if (!inst->numStages)
+		return;
+#if defined(USE_FPU)
+	arm_biquad_cascade_df2T_f32(inst, buf, buf, n);
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+	arm_biquad_cascade_df1_fast_q15(inst, buf, buf, n);
+#elif defined(DSP_Q_FORMAT_Q31)
+	arm_biquad_cascade_df1_q31(inst, buf, buf, n);
+#else
+	arm_biquad_cas_df1_32x64_q31(inst, buf, buf, n);
+#endif
+}
+
+/**
+ * @brief Get the ADC offset of a channel in Q16. With a DC tracker it's
+ * 		updated with the block, otherwise it's the mid-scale.
+ * @param[in] channel 0, or 1 for the second channel with USE_STEREO
+ * @param[in] src The ADC samples of the block
+ * @param[in] n Number of ADC samples
+ * @param[in] stride The distance of two samples of the channel
+ */
+static inline int32_t filter_chain_dc_offset(uint8_t channel, const uint16_t * src,
+		size_t n, size_t stride)
+{
+#ifdef USE_DC_TRACKER
+	struct dc_tracker * dc = m_chain.dc[channel];
+	if (dc)
+		return dc_tracker_update(dc, src, n, stride);
+#endif
+	return ADC_MID_SCALE << 16;
+}
+
+/**
+ * @brief Convert a 12-bit ADC sample to the cascade format
+ * @param[in] x The ADC sample
+ * @param[in] offset The ADC offset in Q16
+ */
+static inline chain_sample_t filter_chain_from_adc(uint16_t x, int32_t offset)
+{
+	int32_t y = ((int32_t) x << 16) - offset;
+#if defined(USE_FPU)
+	return (float32_t) y * (ADC_TO_F32 / 65536);
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+	y = (y + (1 << (15 - ADC_Q_SHIFT))) >> (16 - ADC_Q_SHIFT);
+#ifdef USE_DC_TRACKER
+	/* with any other offset than the mid-scale the range is more than 12 bits */
+	if (y > INT16_MAX) y = INT16_MAX;
+	else if (y < INT16_MIN) y = INT16_MIN;
+#endif
+	return (chain_sample_t) y;
+#else
+#ifdef USE_DC_TRACKER
+	if (y > (INT32_MAX >> (ADC_Q_SHIFT - 16))) y = INT32_MAX >> (ADC_Q_SHIFT - 16);
+	else if (y < (INT32_MIN >> (ADC_Q_SHIFT - 16))) y = INT32_MIN >> (ADC_Q_SHIFT - 16);
+#endif
+	return (chain_sample_t) (y * (1 << (ADC_Q_SHIFT - 16)));
+#endif
+}
+
+/**
+ * @brief Convert a cascade sample to a clamped 12-bit DAC sample
+ */
+static inline uint16_t filter_chain_to_dac(chain_sample_t x)
+{
+#if defined(USE_FPU)
+	int32_t y = (int32_t) (x * ADC_MID_SCALE) + ADC_MID_SCALE;
+#else
+	int32_t y = ((((int32_t) x >> (ADC_Q_SHIFT - 1)) + 1) >> 1) + ADC_MID_SCALE;
+#endif
+	if (y < 0) y = 0;
+	else if (y > DAC_MAX_VALUE) y = DAC_MAX_VALUE;
+	return (uint16_t) y;
+}
+
+/**
+ * @brief Convert a block of ADC samples to the work buffer
+ * @return The number of ADC samples that were used
+ */
+static inline size_t filter_chain_input(const uint16_t * src, size_t n)
+{
+	int32_t offset;
+#ifdef USE_OVERSAMPLING
+	struct oversampling * os = m_chain.os;
+	if (os) {
+		offset = filter_chain_dc_offset(0, src, n * os->factor, 1);
+		oversampling_decimate(os, src, n, offset);
+		for (size_t i=0; i<n; i++) {
+#if defined(DSP_Q_FORMAT_Q31) || defined(DSP_Q_FORMAT_Q31_64)
+			m_work[i] = (q31_t) os->base[i] << 16;
+#else
+			m_work[i] = os->base[i];
+#endif
+		}
+		return n * os->factor;
+	}
+#endif
+	offset = filter_chain_dc_offset(0, src, n, 1);
+	for (size_t i=0; i<n; i++)
+		m_work[i] = filter_chain_from_adc(src[i], offset);
+	return n;
+}
+
+/**
+ * @brief Convert the work buffer to a block of DAC samples
+ * @return The number of DAC samples that were written
+ */
+static inline size_t filter_chain_output(uint16_t * dst, size_t n)
+{
+#ifdef USE_OVERSAMPLING
+	struct oversampling * os = m_chain.os;
+	if (os) {
+		for (size_t i=0; i<n; i++) {
+#if defined(DSP_Q_FORMAT_Q31) || defined(DSP_Q_FORMAT_Q31_64)
+			int32_t y = ((m_work[i] >> 15) + 1) >> 1;
+			os->base[i] = (q15_t) ((y > INT16_MAX) ? INT16_MAX : y);
+#else
+			os->base[i] = m_work[i];
+#endif
+		}
+		oversampling_interpolate(os, dst, n);
+		return os->interpolate ? n * os->factor : n;
+	}
+#endif
+	for (size_t i=0; i<n; i++)
+		dst[i] = filter_chain_to_dac(m_work[i]);
+	return n;
+}
+
+/**
+ * @brief Run a block of 12-bit ADC samples through all the filter stages
+ * 		and write the clamped 12-bit result for the DAC
+ * @param[in] src Pointer to the ADC samples
+ * @param[out] dst Pointer to the DAC samples
+ * @param[in] len Number of samples at the sample rate of the chain
+ */
+void filter_chain_process(const uint16_t * src, uint16_t * dst, size_t len)
+{
+	while (len) {
+		size_t n = (len > DSP_BLOCK_SIZE) ? DSP_BLOCK_SIZE : len;
+		PROFILER_START(t);
+
+		filter_chain_swap();
+
+		src += filter_chain_input(src, n);
+		PROFILER_MARK(PROFILER_INPUT, t);
+
+		for (size_t i=0; i<n; ) {
+			size_t k = filter_chain_ramp_step(n - i);
+			filter_chain_run(&m_chain.inst, &m_work[i], k);
+			i += k;
+		}
+		PROFILER_MARK(PROFILER_BIQUADS, t);
+#ifdef USE_FFT_CONV
+		if (m_chain.conv[0]) {
+			fft_conv_process(m_chain.conv[0], m_work, n, 1);
+			PROFILER_MARK(PROFILER_CONV, t);
+		}
+#endif
+
+		dst += filter_chain_output(dst, n);
+		PROFILER_MARK(PROFILER_OUTPUT, t);
+		len -= n;
+	}
+}
+
+#ifdef USE_STEREO
+/**
+ * @brief Run a block of packed two channel 12-bit ADC samples through all
+ * 		the filter stages and write the packed 12-bit result for the DAC
+ * @param[in] src Pointer to the ADC samples, channel 1 in bits 0-11 and
+ * 		channel 2 in bits 16-27
+ * @param[out] dst Pointer to the DAC samples in the DHR12RD layout
+ * @param[in] len Number of sample pairs
+ */
+void filter_chain_process_stereo(const uint32_t * src, uint32_t * dst, size_t len)
+{
+	while (len) {
+		size_t n = (len > DSP_BLOCK_SIZE) ? DSP_BLOCK_SIZE : len;
+		PROFILER_START(t);
+		/* the half-words of the little endian words */
+		int32_t offset1 = filter_chain_dc_offset(0, (const uint16_t *) src, n, 2);
+		int32_t offset2 = filter_chain_dc_offset(1, (const uint16_t *) src + 1, n, 2);
+
+		filter_chain_swap();
+
+#if defined(USE_FPU)
+		/* interleaved {ch1, ch2} pairs for the stereo kernel */
+		for (size_t i=0; i<n; i++) {
+			m_work[2 * i] = filter_chain_from_adc(src[i] & 0xFFFF, offset1);
+			m_work[2 * i + 1] = filter_chain_from_adc(src[i] >> 16, offset2);
+		}
+		PROFILER_MARK(PROFILER_INPUT, t);
+
+		for (size_t i=0; i<n; ) {
+			size_t k = filter_chain_ramp_step(n - i);
+			if (m_chain.inst_stereo.numStages)
+				arm_biquad_cascade_stereo_df2T_f32(&m_chain.inst_stereo,
+						&m_work[2 * i], &m_work[2 * i], k);
+			i += k;
+		}
+		PROFILER_MARK(PROFILER_BIQUADS, t);
+#ifdef USE_FFT_CONV
+		if (m_chain.conv[0] || m_chain.conv[1]) {
+			for (int ch=0; ch<CHAIN_NUM_OF_CHANNELS; ch++)
+				if (m_chain.conv[ch])
+					fft_conv_process(m_chain.conv[ch], &m_work[ch], n, 2);
+			PROFILER_MARK(PROFILER_CONV, t);
+		}
+#endif
+
+		for (size_t i=0; i<n; i++)
+			dst[i] = filter_chain_to_dac(m_work[2 * i]) |
+				((uint32_t) filter_chain_to_dac(m_work[2 * i + 1]) << 16);
+		PROFILER_MARK(PROFILER_OUTPUT, t);
+#else
+		chain_sample_t * ch2 = &m_work[DSP_BLOCK_SIZE];
+
+		for (size_t i=0; i<n; i++) {
+			m_work[i] = filter_chain_from_adc(src[i] & 0xFFFF, offset1);
+			ch2[i] = filter_chain_from_adc(src[i] >> 16, offset2);
+		}
+		PROFILER_MARK(PROFILER_INPUT, t);
+
+		for (size_t i=0; i<n; ) {
+			size_t k = filter_chain_ramp_step(n - i);
+			filter_chain_run(&m_chain.inst, &m_work[i], k);
+			filter_chain_run(&m_chain.inst_ch2, &ch2[i], k);
+			i += k;
+		}
+		PROFILER_MARK(PROFILER_BIQUADS, t);
+
+		for (size_t i=0; i<n; i++)
+			dst[i] = filter_chain_to_dac(m_work[i]) |
+				((uint32_t) filter_chain_to_dac(ch2[i]) << 16);
+		PROFILER_MARK(PROFILER_OUTPUT, t);
+#endif
+		src += n;
+		dst += n;
+		len -= n;
+	}
+}
+#endif
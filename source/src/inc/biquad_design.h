@@ -0,0 +1,68 @@
+/*
+ * biquad_design.h
+ *
+ * Biquad coefficient design for all the filter types of the filters_lib.
+ * The equations are the same ones used in filters_lib (W. Pirkle, Designing
+ * Audio Effect Plug-Ins in C++), but the result is returned in the CMSIS-DSP
+ * order {b0, b1, b2, a1, a2}, with the feedback coefficients already negated,
+ * so it can be packed directly in an arm_biquad_cascade stage array.
+ * The shelving/parametric wet/dry mix (c0, d0) is folded in the numerator.
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef BIQUAD_DESIGN_H_
+#define BIQUAD_DESIGN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "arm_math.h"
+
+/* Number of coefficients per biquad stage */
+#define BIQUAD_NUM_COEFFS 5
+
+enum biquad_type {
+	FILTER_FO_APF = 0,
+	FILTER_FO_HPF,
+	FILTER_FO_LPF,
+	FILTER_FO_SHELVING_HIGH,
+	FILTER_FO_SHELVING_LOW,
+	FILTER_SO_APF,
+	FILTER_SO_BPF,
+	FILTER_SO_BSF,
+	FILTER_SO_BUTTERWORTH_BPF,
+	FILTER_SO_BUTTERWORTH_BSF,
+	FILTER_SO_BUTTERWORTH_HPF,
+	FILTER_SO_BUTTERWORTH_LPF,
+	FILTER_SO_HPF,
+	FILTER_SO_LINKWITZ_RILEY_HPF,
+	FILTER_SO_LINKWITZ_RILEY_LPF,
+	FILTER_SO_LPF,
+	FILTER_SO_PARAMETRIC_CQ_BOOST,
+	FILTER_SO_PARAMETRIC_CQ_CUT,
+	FILTER_SO_PARAMETRIC_NCQ,
+	FILTER_NUM_OF_TYPES
+};
+
+/**
+ * @brief The design parameters of a single biquad stage
+ */
+struct biquad_params {
+	enum biquad_type type;
+	float fc;		/* corner or center frequency in Hz */
+	float q;		/* quality factor. For band filters the bandwidth is fc/q */
+	float gain_db;	/* shelving and parametric gain in dB */
+};
+
+int biquad_design(const struct biquad_params * params, uint32_t fs,
+		float32_t * coeffs);
+const char * biquad_type_name(enum biquad_type type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BIQUAD_DESIGN_H_ */
@@ -0,0 +1,97 @@
+/*
+ * capture.h
+ *
+ * Sample capture stream of the ADC input and the DAC output on the debug
+ * UART. The interrupt only copies every CAPTURE_DECIMATION-th sample of a
+ * block with capture_process() in a frame of its stream. When a frame has
+ * CAPTURE_FRAME_SAMPLES samples per channel it's handed to the main loop
+ * through a lock-free ring of CAPTURE_NUM_OF_FRAMES frames per stream.
+ * capture_update() encodes one frame at a time and sends it with the send
+ * callback, a few bytes at a time if the callback can't take the whole
+ * frame. If the ring of a stream is full when a frame starts, the whole
+ * frame is dropped, but it still takes a sequence number, so the host sees
+ * the gap. The ISR never waits for the UART.
+ *
+ * The samples are not low-pass filtered before the decimation, so they
+ * alias if the signal has content above the captured fs / 2.
+ *
+ * Every frame is COBS encoded between two 0x00 delimiters, so the host
+ * finds the start of the next frame after any lost byte, and the text that
+ * is printed before the first frame, e.g. on boot, is not part of it. The
+ * decoded frame is (little endian):
+ * 	u8 type         CAPTURE_FRAME_TYPE
+ * 	u8 stream       enum capture_stream
+ * 	u8 channels     1 or 2, the samples are interleaved
+ * 	u8 decimation   CAPTURE_DECIMATION
+ * 	u32 seq         frame counter of the stream, the dropped frames too
+ * 	u32 fs          sample rate of the captured samples
+ * 	u32 dropped     dropped frames of the stream since capture_init()
+ * 	u16 num_of_samples  samples per channel
+ * 	u16 samples[]   12-bit samples
+ * 	u16 crc         CRC-16/CCITT-FALSE of all the bytes before
+ *
+ * Usage:
+ * 	capture_init(adc_fs, dac_fs, channels, &send_cbk);
+ * 	// in the interrupt
+ * 	capture_process(CAPTURE_ADC, adc_samples, len);
+ * 	capture_process(CAPTURE_DAC, dac_samples, len);
+ * 	// in the main loop
+ * 	capture_update();
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cobs_frame.h"
+
+/* Keep every Nth sample, 1 for the full rate */
+#ifndef CAPTURE_DECIMATION
+#define CAPTURE_DECIMATION 4
+#endif
+
+/* Samples per channel in a frame */
+#ifndef CAPTURE_FRAME_SAMPLES
+#define CAPTURE_FRAME_SAMPLES 128
+#endif
+
+/* Frames in the ring of every stream, a power of two */
+#ifndef CAPTURE_NUM_OF_FRAMES
+#define CAPTURE_NUM_OF_FRAMES 4
+#endif
+
+#define CAPTURE_MAX_CHANNELS 2
+#define CAPTURE_FRAME_TYPE 0x02
+#define CAPTURE_HEADER_SIZE 18
+#define CAPTURE_FRAME_SIZE(SAMPLES) (CAPTURE_HEADER_SIZE + (SAMPLES) * 2 + 2)
+/* The largest encoded frame, with the COBS overhead and both delimiters */
+#define CAPTURE_COBS_SIZE(LEN) COBS_FRAME_ENCODED_SIZE(LEN)
+
+enum capture_stream {
+	CAPTURE_ADC = 0,
+	CAPTURE_DAC,
+	CAPTURE_NUM_OF_STREAMS,
+};
+
+/**
+ * @brief Send callback. It returns the number of bytes that it could take.
+ */
+typedef size_t (*capture_send_t)(const uint8_t * buffer, size_t len);
+
+void capture_init(uint32_t adc_fs, uint32_t dac_fs, uint8_t channels, capture_send_t fp_send);
+void capture_process(enum capture_stream stream, const uint16_t * samples, size_t len);
+void capture_update(void);
+uint32_t capture_get_dropped(enum capture_stream stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,144 @@
+/*
+ * chain_cmd.h
+ *
+ * Binary command protocol of the debug UART, to list and edit the filter
+ * chain while it's running and to read the stats, without reflashing. The
+ * received bytes are parsed with chain_cmd_parse() from the UART callback,
+ * which dev_uart_update() calls from the main loop, never from the UART
+ * interrupt. Every edit is done in the edited bank of the filter chain and
+ * committed at once, so the interrupt swaps the coefficients at the start
+ * of the next block (see filter_chain.h). While a swap is pending or
+ * ramping, an edit is answered with CHAIN_CMD_ERR_BUSY and the host has to
+ * send it again.
+ *
+ * The frames use the sync and the checksum of the spectrum frames. A frame
+ * must arrive in one piece, since the parser starts over on every received
+ * chunk. The frame is (little endian):
+ * 	u8 sync[2]      CHAIN_CMD_SYNC0, CHAIN_CMD_SYNC1
+ * 	u8 type         the command, or the command | CHAIN_CMD_RESPONSE
+ * 	u8 len          length of the payload
+ * 	u8 payload[]
+ * 	u8 checksum     xor of all bytes after the sync
+ *
+ * Every command is answered with a response that starts with a u8 status.
+ * The f32 are IEEE 754 floats and a stage is:
+ * 	u8 type         enum biquad_type
+ * 	f32 fc, q, gain_db
+ *
+ * Command                  Payload             Response after the status
+ * CHAIN_CMD_LIST           -                   u32 fs, u8 num_of_stages, u8 max_stages
+ * CHAIN_CMD_GET            u8 index            u8 index, u8 bypass, stage
+ * CHAIN_CMD_INSERT         u8 index, stage     u8 index (an index past the end appends)
+ * CHAIN_CMD_REMOVE         u8 index            -
+ * CHAIN_CMD_SET            u8 index, stage     -
+ * CHAIN_CMD_BYPASS         u8 index, u8 bypass -
+ * CHAIN_CMD_STATS          -                   the fields of struct chain_cmd_stats in order
+ * CHAIN_CMD_RATE           u32 fs              u32 fs, the actual rate
+ *
+ * CHAIN_CMD_RATE restarts the sampling with sample_rate_set(), so the
+ * output has a short glitch. A rate that is not supported, or where a stage
+ * can't be designed, is answered with CHAIN_CMD_ERR_PARAM and the sampling
+ * continues at the previous rate.
+ *
+ * Usage:
+ * 	chain_cmd_init(&send_cbk, &stats_cbk);
+ * 	// in the UART callback
+ * 	chain_cmd_parse(buffer, bufferlen);
+ * 	// in the main loop
+ * 	chain_cmd_update();
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef CHAIN_CMD_H_
+#define CHAIN_CMD_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHAIN_CMD_SYNC0 0xA5
+#define CHAIN_CMD_SYNC1 0x5A
+/* sync, type and length */
+#define CHAIN_CMD_HEADER_SIZE 4
+#define CHAIN_CMD_MAX_PAYLOAD 64
+#define CHAIN_CMD_FRAME_SIZE(LEN) (CHAIN_CMD_HEADER_SIZE + (LEN) + 1)
+#define CHAIN_CMD_RESPONSE 0x80
+
+/* The size of the buffer of the responses that are not sent yet */
+#ifndef CHAIN_CMD_TX_SIZE
+#define CHAIN_CMD_TX_SIZE 128
+#endif
+
+enum chain_cmd_type {
+	CHAIN_CMD_LIST = 0x10,
+	CHAIN_CMD_GET,
+	CHAIN_CMD_INSERT,
+	CHAIN_CMD_REMOVE,
+	CHAIN_CMD_SET,
+	CHAIN_CMD_BYPASS,
+	CHAIN_CMD_STATS,
+	CHAIN_CMD_RATE,
+};
+
+enum chain_cmd_status {
+	CHAIN_CMD_OK = 0,
+	/* a swap is in progress, send the command again */
+	CHAIN_CMD_ERR_BUSY,
+	/* invalid index or stage parameters */
+	CHAIN_CMD_ERR_PARAM,
+	CHAIN_CMD_ERR_UNKNOWN,
+	CHAIN_CMD_ERR_LENGTH,
+};
+
+/* The valid parts of the stats */
+#define CHAIN_CMD_STATS_LOAD	(1 << 0)
+#define CHAIN_CMD_STATS_SIGNAL	(1 << 1)
+
+/**
+ * @brief The stats of the CHAIN_CMD_STATS response. The signal levels are
+ * 		in 12-bit steps.
+ */
+struct chain_cmd_stats {
+	uint32_t fs;
+	/* processed samples in the last second and filter chain cycles per sample */
+	uint32_t samples;
+	uint32_t cycles;
+	uint8_t flags;
+	/* load monitor: load and high-water mark in 0.01% steps */
+	uint16_t load;
+	uint16_t peak;
+	uint32_t late_blocks;
+	uint32_t overruns;
+	/* signal stats: rms, min, max, mean */
+	int16_t adc[4];
+	uint32_t adc_clips;
+	int16_t dac[4];
+	uint32_t dac_clips;
+};
+
+/* u8 status and the encoded struct chain_cmd_stats */
+#define CHAIN_CMD_STATS_SIZE 50
+
+/**
+ * @brief Send callback. It returns the number of bytes that it could take.
+ */
+typedef size_t (*chain_cmd_send_t)(const uint8_t * buffer, size_t len);
+
+/**
+ * @brief Stats callback. It fills the stats that the build has.
+ */
+typedef void (*chain_cmd_stats_t)(struct chain_cmd_stats * stats);
+
+void chain_cmd_init(chain_cmd_send_t fp_send, chain_cmd_stats_t fp_stats);
+void chain_cmd_parse(const uint8_t * buffer, size_t len);
+void chain_cmd_update(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHAIN_CMD_H_ */
@@ -0,0 +1,67 @@
+/*
+ * dc_tracker.h
+ *
+ * Tracking of the DC offset of the ADC input. The analog front end biases
+ * the input to about the mid-scale of the ADC, but the real offset drifts
+ * with the temperature and the supply, so subtracting a fixed 2048 leaves a
+ * DC in the chain that eats headroom and comes out of the DAC. The tracker
+ * measures the offset from the mean of every block, in fixed point. For the
+ * first startup_blocks blocks the offset is the running average of all the
+ * samples, so it settles fast after the boot. After that it's a one-pole
+ * leaky integrator of the block means:
+ * 	offset += (mean - offset) >> shift
+ * which is a high pass with a time constant of 2^shift blocks, so it only
+ * follows the slow drift and not the signal.
+ *
+ * The offset is in 12-bit steps with 16 fractional bits (Q16). The filter
+ * chain subtracts it from the ADC samples instead of ADC_MID_SCALE, so the
+ * stages get zero-centred samples.
+ *
+ * Usage:
+ * 	static struct dc_tracker dc;
+ * 	dc_tracker_init(&dc, DC_TRACKER_SHIFT, DC_TRACKER_STARTUP_BLOCKS);
+ * 	filter_chain_set_dc_tracker(0, &dc);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef DC_TRACKER_H_
+#define DC_TRACKER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Default time constant, 2^12 blocks is about 1.4 sec at 96KHz */
+#ifndef DC_TRACKER_SHIFT
+#define DC_TRACKER_SHIFT 12
+#endif
+
+/* Default number of blocks of the startup average */
+#ifndef DC_TRACKER_STARTUP_BLOCKS
+#define DC_TRACKER_STARTUP_BLOCKS 256
+#endif
+
+/* 2048 in Q16 */
+#define DC_TRACKER_MID_SCALE (2048 << 16)
+
+struct dc_tracker {
+	/* the offset in 12-bit steps, Q16 */
+	volatile int32_t offset;
+	uint16_t startup_blocks;
+	uint16_t count;
+	uint8_t shift;
+};
+
+void dc_tracker_init(struct dc_tracker * dc, uint8_t shift, uint16_t startup_blocks);
+int32_t dc_tracker_update(struct dc_tracker * dc, const uint16_t * src, size_t len,
+		size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DC_TRACKER_H_ */
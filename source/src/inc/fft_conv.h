@@ -0,0 +1,84 @@
+/*
+ * fft_conv.h
+ *
+ * Uniformly partitioned overlap-save convolution for long FIR filters, e.g.
+ * cabinet or room correction impulse responses (IR). The IR is split in
+ * partitions of B samples and the spectrum of each partition is calculated
+ * once in fft_conv_init(). Every B input samples the last 2B samples are
+ * transformed with arm_rfft_fast_f32, the spectrum is pushed in a frequency
+ * domain delay line and then it's multiplied with the partition spectra
+ * (arm_cmplx_mult_cmplx_f32). One inverse FFT gives the B new output
+ * samples. The cost per sample is two 2B point FFTs per B samples plus one
+ * complex multiply-add per partition, instead of one MAC per tap.
+ *
+ * The output is delayed by B samples. With B equal to DSP_BLOCK_SIZE the
+ * FFT work is done in every block, otherwise only in the block that
+ * completes a partition. B must be a power of two from 16 up to
+ * FFT_CONV_MAX_PARTITION_SIZE. This needs USE_FPU.
+ *
+ * Usage:
+ * 	static struct fft_conv conv;
+ * 	fft_conv_init(&conv, DSP_BLOCK_SIZE, ir, ir_len);
+ * 	filter_chain_set_conv(0, &conv);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef FFT_CONV_H_
+#define FFT_CONV_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arm_math.h"
+
+#ifndef USE_FPU
+#error "The FFT convolution needs USE_FPU"
+#endif
+
+/* Max partition size. The FFT size is twice that */
+#ifndef FFT_CONV_MAX_PARTITION_SIZE
+#define FFT_CONV_MAX_PARTITION_SIZE 32
+#endif
+
+/* Max IR length */
+#ifndef FFT_CONV_MAX_TAPS
+#define FFT_CONV_MAX_TAPS 512
+#endif
+
+/* Size of the partition spectra and of the delay line. The partitions
+ * round the IR length up to a multiple of the partition size. */
+#define FFT_CONV_SPECTRA_SIZE (2 * (FFT_CONV_MAX_TAPS + FFT_CONV_MAX_PARTITION_SIZE))
+
+struct fft_conv {
+	arm_rfft_fast_instance_f32 rfft;
+	/* the spectra of the IR partitions */
+	float32_t h[FFT_CONV_SPECTRA_SIZE];
+	/* the spectra of the last input blocks */
+	float32_t fdl[FFT_CONV_SPECTRA_SIZE];
+	/* the previous and the current input block */
+	float32_t in[2 * FFT_CONV_MAX_PARTITION_SIZE];
+	float32_t out[FFT_CONV_MAX_PARTITION_SIZE];
+	float32_t acc[2 * FFT_CONV_MAX_PARTITION_SIZE];
+	float32_t tmp[2 * FFT_CONV_MAX_PARTITION_SIZE];
+	uint16_t partition_size;
+	uint16_t num_of_partitions;
+	/* the newest spectrum in the delay line */
+	uint16_t fdl_pos;
+	/* the position in the current input block */
+	uint16_t pos;
+};
+
+int fft_conv_init(struct fft_conv * conv, uint16_t partition_size,
+		const float32_t * ir, uint16_t ir_len);
+void fft_conv_process(struct fft_conv * conv, float32_t * buf, size_t len,
+		size_t stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FFT_CONV_H_ */
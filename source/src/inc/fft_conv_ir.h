@@ -0,0 +1,69 @@
+/*
+ * fft_conv_ir.h
+ *
+ * The impulse response of the USE_FFT_CONV builds. Replace the table with
+ * your own IR (e.g. a cabinet or a room correction IR exported as float at
+ * the SAMPLE_RATE), up to FFT_CONV_MAX_TAPS samples.
+ *
+ * The example is a 256-tap Blackman windowed-sinc lowpass at 5KHz for 96KHz.
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef FFT_CONV_IR_H_
+#define FFT_CONV_IR_H_
+
+#include "arm_math.h"
+
+/* The sample rate of the IR */
+#define FFT_CONV_IR_FS 96000
+
+#define FFT_CONV_IR_TAPS 256
+
+static const float32_t fft_conv_ir[FFT_CONV_IR_TAPS] = {
+	2.67824351e-20f, -7.26224535e-08f, -1.25992599e-07f, 1.23482915e-07f, 9.33231255e-07f, 2.43974474e-06f,
+	4.58070353e-06f, 7.05276370e-06f, 9.31867578e-06f, 1.06695087e-05f, 1.03381600e-05f, 7.65044625e-06f,
+	2.19144245e-06f, -6.04112583e-06f, -1.65265416e-05f, -2.81811283e-05f, -3.94084171e-05f, -4.82474863e-05f,
+	-5.26129010e-05f, -5.06040638e-05f, -4.08473639e-05f, -2.28236093e-05f, 2.87210486e-06f, 3.43891627e-05f,
+	6.86403392e-05f, 1.01505358e-04f, 1.28220578e-04f, 1.43929727e-04f, 1.44343792e-04f, 1.26434823e-04f,
+	8.90723028e-05f, 3.35050058e-05f, -3.64018109e-05f, -1.14243786e-04f, -1.91506715e-04f, -2.58342838e-04f,
+	-3.04642038e-04f, -3.21299142e-04f, -3.01538761e-04f, -2.42132411e-04f, -1.44334328e-04f, -1.43757325e-05f,
+	1.36606592e-04f, 2.93274718e-04f, 4.37421464e-04f, 5.49843032e-04f, 6.12585561e-04f, 6.11330156e-04f,
+	5.37634155e-04f, 3.90729864e-04f, 1.78601347e-04f, -8.18831154e-05f, -3.65913691e-04f, -6.42768956e-04f,
+	-8.78811667e-04f, -1.04119533e-03f, -1.10190975e-03f, -1.04171027e-03f, -8.53438915e-04f, -5.44266074e-04f,
+	-1.36461580e-04f, 3.33558956e-04f, 8.17984616e-04f, 1.26201850e-03f, 1.60959332e-03f, 1.80984679e-03f,
+	1.82366320e-03f, 1.62950909e-03f, 1.22779790e-03f, 6.43117410e-04f, -7.61575706e-05f, -8.61081453e-04f,
+	-1.62808332e-03f, -2.28721011e-03f, -2.75192448e-03f, -2.94946184e-03f, -2.83059211e-03f, -2.37759442e-03f,
+	-1.60935131e-03f, -5.82704021e-04f, 6.10434303e-04f, 1.85026517e-03f, 3.00015876e-03f, 3.92065996e-03f,
+	4.48511211e-03f, 4.59526283e-03f, 4.19507576e-03f, 3.28102302e-03f, 1.90738275e-03f, 1.85504115e-04f,
+	-1.72340832e-03f, -3.62175115e-03f, -5.29426412e-03f, -6.53043574e-03f, -7.14841163e-03f, -7.01790215e-03f,
+	-6.07949088e-03f, -4.35792744e-03f, -1.96744519e-03f, 8.92152873e-04f, 3.94900853e-03f, 6.88170009e-03f,
+	9.34909396e-03f, 1.10250454e-02f, 1.16347480e-02f, 1.09891292e-02f, 9.01363358e-03f, 5.76805219e-03f,
+	1.45473598e-03f, -3.58648293e-03f, -8.89712285e-03f, -1.39317717e-02f, -1.81005169e-02f, -2.08187476e-02f,
+	-2.15600985e-02f, -1.99077887e-02f, -1.55995258e-02f, -8.56153320e-03f, 1.07192086e-03f, 1.29559088e-02f,
+	2.65500905e-02f, 4.11511616e-02f, 5.59402507e-02f, 7.00415971e-02f, 8.25877277e-02f, 9.27856668e-02f,
+	9.99785201e-02f, 1.03697103e-01f, 1.03697103e-01f, 9.99785201e-02f, 9.27856668e-02f, 8.25877277e-02f,
+	7.00415971e-02f, 5.59402507e-02f, 4.11511616e-02f, 2.65500905e-02f, 1.29559088e-02f, 1.07192086e-03f,
+	-8.56153320e-03f, -1.55995258e-02f, -1.99077887e-02f, -2.15600985e-02f, -2.08187476e-02f, -1.81005169e-02f,
+	-1.39317717e-02f, -8.89712285e-03f, -3.58648293e-03f, 1.45473598e-03f, 5.76805219e-03f, 9.01363358e-03f,
+	1.09891292e-02f, 1.16347480e-02f, 1.10250454e-02f, 9.34909396e-03f, 6.88170009e-03f, 3.94900853e-03f,
+	8.92152873e-04f, -1.96744519e-03f, -4.35792744e-03f, -6.07949088e-03f, -7.01790215e-03f, -7.14841163e-03f,
+	-6.53043574e-03f, -5.29426412e-03f, -3.62175115e-03f, -1.72340832e-03f, 1.85504115e-04f, 1.90738275e-03f,
+	3.28102302e-03f, 4.19507576e-03f, 4.59526283e-03f, 4.48511211e-03f, 3.92065996e-03f, 3.00015876e-03f,
+	1.85026517e-03f, 6.10434303e-04f, -5.82704021e-04f, -1.60935131e-03f, -2.37759442e-03f, -2.83059211e-03f,
+	-2.94946184e-03f, -2.75192448e-03f, -2.28721011e-03f, -1.62808332e-03f, -8.61081453e-04f, -7.61575706e-05f,
+	6.43117410e-04f, 1.22779790e-03f, 1.62950909e-03f, 1.82366320e-03f, 1.80984679e-03f, 1.60959332e-03f,
+	1.26201850e-03f, 8.17984616e-04f, 3.33558956e-04f, -1.36461580e-04f, -5.44266074e-04f, -8.53438915e-04f,
+	-1.04171027e-03f, -1.10190975e-03f, -1.04119533e-03f, -8.78811667e-04f, -6.42768956e-04f, -3.65913691e-04f,
+	-8.18831154e-05f, 1.78601347e-04f, 3.90729864e-04f, 5.37634155e-04f, 6.11330156e-04f, 6.12585561e-04f,
+	5.49843032e-04f, 4.37421464e-04f, 2.93274718e-04f, 1.36606592e-04f, -1.43757325e-05f, -1.44334328e-04f,
+	-2.42132411e-04f, -3.01538761e-04f, -3.21299142e-04f, -3.04642038e-04f, -2.58342838e-04f, -1.91506715e-04f,
+	-1.14243786e-04f, -3.64018109e-05f, 3.35050058e-05f, 8.90723028e-05f, 1.26434823e-04f, 1.44343792e-04f,
+	1.43929727e-04f, 1.28220578e-04f, 1.01505358e-04f, 6.86403392e-05f, 3.43891627e-05f, 2.87210486e-06f,
+	-2.28236093e-05f, -4.08473639e-05f, -5.06040638e-05f, -5.26129010e-05f, -4.82474863e-05f, -3.94084171e-05f,
+	-2.81811283e-05f, -1.65265416e-05f, -6.04112583e-06f, 2.19144245e-06f, 7.65044625e-06f, 1.03381600e-05f,
+	1.06695087e-05f, 9.31867578e-06f, 7.05276370e-06f, 4.58070353e-06f, 2.43974474e-06f, 9.33231255e-07f,
+	1.23482915e-07f, -1.25992599e-07f, -7.26224535e-08f, 2.67824351e-20f
+};
+
+#endif /* FFT_CONV_IR_H_ */
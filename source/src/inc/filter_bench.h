@@ -0,0 +1,55 @@
+/*
+ * filter_bench.h
+ *
+ * Benchmark of all the biquad filter types. Each type is designed with
+ * biquad_design() and then it runs as a single stage filter chain over a
+ * synthetic buffer. The results are printed as CSV with one line per
+ * filter type. The first line is the empty chain (passthrough), which is
+ * the cost of the sample conversion. With USE_FFT_CONV there is a line for
+ * the convolution with the IR of fft_conv_ir.h and the design time is the
+ * time of fft_conv_init(). With USE_DC_TRACKER the dc_tracker line is the
+ * passthrough with the offset tracking. With USE_OVERSAMPLING there is one line
+ * for each oversampling factor, with the decimation (and interpolation with
+ * USE_OVERSAMPLED_DAC) cost per sample of the chain.
+ *
+ * On the target the time is measured in CPU cycles with DWT->CYCCNT (it
+ * needs delay_init()) and the CSV columns are:
+ * 	filter,precision,block_size,design_cycles,cycles_per_sample,stages_72mhz,stages_128mhz
+ * where stages_* is how many stages of that filter fit in the sample period
+ * at 72MHz and at the 128MHz of overclock_stm32f303().
+ *
+ * On the host the time is measured in ns and the CSV columns are:
+ * 	filter,precision,block_size,design_ns,ns_per_sample,samples_per_sec
+ *
+ * Usage:
+ * 	filter_bench_run(SAMPLE_RATE, 16);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef FILTER_BENCH_H_
+#define FILTER_BENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Number of samples in the benchmark buffer */
+#ifndef FILTER_BENCH_SAMPLES
+#define FILTER_BENCH_SAMPLES 1024
+#endif
+
+/* Number of biquad_design() calls that are averaged */
+#ifndef FILTER_BENCH_DESIGN_RUNS
+#define FILTER_BENCH_DESIGN_RUNS 64
+#endif
+
+void filter_bench_run(uint32_t fs, uint32_t repeats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FILTER_BENCH_H_ */
@@ -0,0 +1,261 @@
+/*
+ * filter_chain.h
+ *
+ * Block based filter chain. All the filter stages are packed in a single
+ * CMSIS-DSP biquad cascade, so the whole chain runs with one cascade call
+ * per block instead of one function call per stage and per sample.
+ *
+ * With USE_FPU the cascade runs in float (arm_biquad_cascade_df2T_f32) and
+ * the 12-bit ADC samples are converted to zero-centred floats in the
+ * [-1, 1) range. Without USE_FPU the samples are converted once to Q15/Q31
+ * and the cascade runs in fixed point with the SMLAD/SMLAL based CMSIS
+ * kernels. The precision is selected at build time with one of:
+ * 	DSP_Q_FORMAT_FAST_Q15: arm_biquad_cascade_df1_fast_q15 (fastest)
+ * 	DSP_Q_FORMAT_Q31: arm_biquad_cascade_df1_q31 (default)
+ * 	DSP_Q_FORMAT_Q31_64: arm_biquad_cas_df1_32x64_q31 (64-bit state)
+ *
+ * With USE_STEREO the chain also processes two channels with the same
+ * filters. The samples are packed in 32-bit words, with the first channel
+ * in the low and the second channel in the high half-word, which is the
+ * layout of the dual ADC common data register and the DAC DHR12RD register.
+ * With USE_FPU both channels run interleaved through a single
+ * arm_biquad_cascade_stereo_df2T_f32 call. The fixed-point kernels have no
+ * stereo version, so each channel runs in its own cascade instance.
+ *
+ * The coefficients are double-buffered in two banks. The interrupt runs
+ * the active bank, while filter_chain_clear/add/load() edit the other one
+ * from the main loop. filter_chain_commit() marks the edited bank as ready
+ * and the interrupt swaps the banks at the start of the next block, which
+ * only changes the pointers of the cascade instances. Optionally the
+ * coefficients can ramp from the old to the new bank (linear or
+ * exponential) every FILTER_CHAIN_RAMP_STEP samples, to avoid zipper noise.
+ * The ramp is only possible when both banks have the same number of stages
+ * (and the same post-shift in fixed point), otherwise the swap is instant.
+ * While a swap is pending or ramping, the edit functions return -1.
+ * Besides appending stages, a stage can be inserted, removed, redesigned or
+ * bypassed by its index. A bypassed stage keeps its parameters and runs
+ * with unity coefficients, so the number of stages doesn't change and the
+ * bypass can ramp like any other edit. The filter state is not moved when
+ * stages are inserted or removed, so that gives a short transient.
+ * filter_chain_set_fs() redesigns all the stages for another sample rate,
+ * while the sampling is stopped.
+ *
+ * With USE_FFT_CONV an fft_conv instance (long FIR/IR) can be attached to
+ * each channel with filter_chain_set_conv(). It runs after the biquads.
+ *
+ * With USE_OVERSAMPLING an oversampling instance is attached with
+ * filter_chain_set_oversampling(). Then filter_chain_process() decimates
+ * len * M ADC samples to len samples for the chain and writes len * M DAC
+ * samples if the instance also interpolates.
+ *
+ * With USE_DC_TRACKER a dc_tracker instance can be attached to the ADC input
+ * of each channel with filter_chain_set_dc_tracker(). Then the tracked
+ * offset is subtracted from the ADC samples instead of ADC_MID_SCALE.
+ *
+ * Usage:
+ * 	filter_chain_init(SAMPLE_RATE);
+ * 	filter_chain_set_ramp(FILTER_CHAIN_RAMP_LINEAR, 480);
+ * 	filter_chain_add(FILTER_SO_BUTTERWORTH_HPF, 5000, 0, 0);
+ * 	filter_chain_add(FILTER_SO_BUTTERWORTH_LPF, 10000, 0, 0);
+ * 	// or with the build time coefficients of filter_chain_fixed.h
+ * 	filter_chain_load(filter_chain_fixed_params, filter_chain_fixed_coeffs,
+ * 			FILTER_CHAIN_FIXED_NUM_OF_STAGES);
+ * 	filter_chain_commit();
+ * 	...
+ * 	// in the DMA half/full transfer interrupt
+ * 	filter_chain_process(&adc_buffer[0], &dac_buffer[0], DSP_BLOCK_SIZE);
+ * 	// or for the two channels
+ * 	filter_chain_process_stereo(&adc_buffer[0], &dac_buffer[0], DSP_BLOCK_SIZE);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef FILTER_CHAIN_H_
+#define FILTER_CHAIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arm_math.h"
+#include "biquad_design.h"
+#ifdef USE_FFT_CONV
+#include "fft_conv.h"
+#endif
+#ifdef USE_OVERSAMPLING
+#include "oversampling.h"
+#endif
+#ifdef USE_DC_TRACKER
+#include "dc_tracker.h"
+#endif
+
+/* Number of samples in each half of the DMA ping-pong buffers */
+#ifndef DSP_BLOCK_SIZE
+#define DSP_BLOCK_SIZE 32
+#endif
+
+/* Max number of biquad stages in the cascade */
+#ifndef FILTER_CHAIN_MAX_STAGES
+#define FILTER_CHAIN_MAX_STAGES 16
+#endif
+
+/* The max value of the 12-bit DAC and the mid-scale of the 12-bit ADC */
+#define DAC_MAX_VALUE 4095
+#define ADC_MID_SCALE 2048
+
+/* Number of samples between the coefficient updates of a ramp */
+#ifndef FILTER_CHAIN_RAMP_STEP
+#define FILTER_CHAIN_RAMP_STEP 4
+#endif
+
+#if defined(USE_OVERSAMPLING) && defined(USE_STEREO)
+#error "The oversampling is only supported for the mono chain"
+#endif
+
+#if !defined(USE_FPU) && !defined(DSP_Q_FORMAT_FAST_Q15) && \
+	!defined(DSP_Q_FORMAT_Q31) && !defined(DSP_Q_FORMAT_Q31_64)
+#define DSP_Q_FORMAT_Q31
+#endif
+
+/* The coefficients of the cascade kernel */
+#if defined(USE_FPU)
+typedef float32_t filter_chain_coeff_t;
+#define FILTER_CHAIN_STAGE_COEFFS BIQUAD_NUM_COEFFS
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+/* {b0, 0, b1, b2, a1, a2} per stage */
+typedef q15_t filter_chain_coeff_t;
+#define FILTER_CHAIN_STAGE_COEFFS 6
+#else
+typedef q31_t filter_chain_coeff_t;
+#define FILTER_CHAIN_STAGE_COEFFS BIQUAD_NUM_COEFFS
+#endif
+
+enum filter_chain_ramp {
+	FILTER_CHAIN_RAMP_NONE = 0,
+	FILTER_CHAIN_RAMP_LINEAR,
+	FILTER_CHAIN_RAMP_EXP,
+};
+
+enum filter_chain_swap {
+	FILTER_CHAIN_SWAP_IDLE = 0,
+	FILTER_CHAIN_SWAP_PENDING,
+	FILTER_CHAIN_SWAP_RAMP,
+};
+
+/**
+ * @brief A complete coefficient set of the chain
+ */
+struct filter_chain_bank {
+	struct biquad_params stages[FILTER_CHAIN_MAX_STAGES];
+	/* the designed coefficients, also used to quantize the Q-format ones */
+	float32_t coeffs[BIQUAD_NUM_COEFFS * FILTER_CHAIN_MAX_STAGES];
+	/* the bypassed stages have unity coefficients */
+	uint8_t bypass[FILTER_CHAIN_MAX_STAGES];
+#ifndef USE_FPU
+	filter_chain_coeff_t coeffs_q[FILTER_CHAIN_STAGE_COEFFS * FILTER_CHAIN_MAX_STAGES];
+	uint8_t post_shift;
+#endif
+	uint8_t num_of_stages;
+};
+
+struct filter_chain {
+	struct filter_chain_bank banks[2];
+	/* the interpolated coefficients while ramping */
+	filter_chain_coeff_t ramp_coeffs[FILTER_CHAIN_STAGE_COEFFS * FILTER_CHAIN_MAX_STAGES];
+#if defined(USE_FPU)
+	arm_biquad_cascade_df2T_instance_f32 inst;
+	float32_t state[2 * FILTER_CHAIN_MAX_STAGES];
+#ifdef USE_STEREO
+	arm_biquad_cascade_stereo_df2T_instance_f32 inst_stereo;
+	float32_t state_stereo[4 * FILTER_CHAIN_MAX_STAGES];
+#endif
+#elif defined(DSP_Q_FORMAT_FAST_Q15)
+	arm_biquad_casd_df1_inst_q15 inst;
+	q15_t state[4 * FILTER_CHAIN_MAX_STAGES];
+#ifdef USE_STEREO
+	arm_biquad_casd_df1_inst_q15 inst_ch2;
+	q15_t state_ch2[4 * FILTER_CHAIN_MAX_STAGES];
+#endif
+#elif defined(DSP_Q_FORMAT_Q31)
+	arm_biquad_casd_df1_inst_q31 inst;
+	q31_t state[4 * FILTER_CHAIN_MAX_STAGES];
+#ifdef USE_STEREO
+	arm_biquad_casd_df1_inst_q31 inst_ch2;
+	q31_t state_ch2[4 * FILTER_CHAIN_MAX_STAGES];
+#endif
+#elif defined(DSP_Q_FORMAT_Q31_64)
+	arm_biquad_cas_df1_32x64_ins_q31 inst;
+	q63_t state[4 * FILTER_CHAIN_MAX_STAGES];
+#ifdef USE_STEREO
+	arm_biquad_cas_df1_32x64_ins_q31 inst_ch2;
+	q63_t state_ch2[4 * FILTER_CHAIN_MAX_STAGES];
+#endif
+#endif
+	/* the bank of the interrupt, the other one is edited by the main loop */
+	volatile uint8_t active;
+	volatile enum filter_chain_swap swap;
+	/* the bank of the last commit, it's the active one after the swap */
+	uint8_t committed;
+	/* the edited bank is a copy of the active one */
+	uint8_t edit_ready;
+	enum filter_chain_ramp ramp;
+	uint16_t ramp_len;
+	uint16_t ramp_pos;
+#ifdef USE_FPU
+	float32_t ramp_k;
+#else
+	q31_t ramp_k;
+#endif
+	uint32_t fs;
+#ifdef USE_FFT_CONV
+	/* the convolution of each channel or NULL */
+	struct fft_conv * volatile conv[2];
+#endif
+#ifdef USE_OVERSAMPLING
+	struct oversampling * os;
+#endif
+#ifdef USE_DC_TRACKER
+	/* the DC tracker of each channel or NULL */
+	struct dc_tracker * volatile dc[2];
+#endif
+};
+
+void filter_chain_init(uint32_t fs);
+int filter_chain_set_ramp(enum filter_chain_ramp ramp, uint16_t len);
+int filter_chain_clear(void);
+int filter_chain_add(enum biquad_type type, float fc, float q, float gain_db);
+int filter_chain_insert(uint8_t index, enum biquad_type type, float fc, float q,
+		float gain_db);
+int filter_chain_remove(uint8_t index);
+int filter_chain_set_stage(uint8_t index, enum biquad_type type, float fc, float q,
+		float gain_db);
+int filter_chain_set_bypass(uint8_t index, uint8_t bypass);
+int filter_chain_get_stage(uint8_t index, struct biquad_params * params, uint8_t * bypass);
+int filter_chain_load(const struct biquad_params * params, const float32_t * coeffs,
+		uint8_t num_of_stages);
+int filter_chain_commit(void);
+uint8_t filter_chain_busy(void);
+int filter_chain_set_fs(uint32_t fs);
+uint8_t filter_chain_get_num_of_stages(void);
+const char * filter_chain_get_precision(void);
+void filter_chain_process(const uint16_t * src, uint16_t * dst, size_t len);
+#ifdef USE_STEREO
+void filter_chain_process_stereo(const uint32_t * src, uint32_t * dst, size_t len);
+#endif
+#ifdef USE_FFT_CONV
+int filter_chain_set_conv(uint8_t channel, struct fft_conv * conv);
+#endif
+#ifdef USE_OVERSAMPLING
+void filter_chain_set_oversampling(struct oversampling * os);
+#endif
+#ifdef USE_DC_TRACKER
+int filter_chain_set_dc_tracker(uint8_t channel, struct dc_tracker * dc);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FILTER_CHAIN_H_ */
@@ -0,0 +1,25 @@
+/*
+ * filter_chain_fixed.h
+ *
+ * The fixed filter chain for USE_FIXED_CHAIN builds. The coefficients of
+ * these stages are calculated at build time by host/coeffs_gen.c and they
+ * are stored in flash as const tables in the generated filter_chain_coeffs.h
+ * header, so there is no coefficient calculation on boot.
+ *
+ * Add one FILTER_STAGE(type, fc, q, gain_db) line per stage. The parameters
+ * are the same as the ones of filter_chain_add().
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef FILTER_CHAIN_FIXED_H_
+#define FILTER_CHAIN_FIXED_H_
+
+/* The sample rate of the coefficients */
+#define FILTER_CHAIN_FIXED_FS 96000
+
+#define FILTER_CHAIN_FIXED_STAGES \
+	FILTER_STAGE(FILTER_SO_BUTTERWORTH_HPF, 5000, 0, 0) \
+	FILTER_STAGE(FILTER_SO_BUTTERWORTH_LPF, 10000, 0, 0)
+
+#endif /* FILTER_CHAIN_FIXED_H_ */
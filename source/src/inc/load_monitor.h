@@ -0,0 +1,81 @@
+/*
+ * load_monitor.h
+ *
+ * CPU load and overrun monitor of the sample interrupt. For every block the
+ * interrupt reports the cycles that it was busy and whether it missed its
+ * deadline. The load of a block is the busy cycles over the cycles of a
+ * block (the budget) and the monitor keeps a rolling average of it, a
+ * one-pole average of 2^LOAD_MONITOR_SHIFT blocks, and the high-water mark.
+ * A block is late if it's finished after the DMA has moved to its half
+ * buffer again, so the DAC has played samples that were not ready, and
+ * an ADC overrun means that a conversion was lost. The late blocks and the
+ * overruns are counted.
+ *
+ * When a block is late, an overrun happens or the load of a block is above
+ * LOAD_MONITOR_THRESHOLD percent, the interrupt raises an event, which the
+ * main loop gets with load_monitor_get_events(), so a unit can report that
+ * it runs out of headroom.
+ *
+ * The loads are in 0.01% steps, so 10000 is 100%.
+ *
+ * Usage:
+ * 	load_monitor_init(SystemCoreClock / fs * DSP_BLOCK_SIZE);
+ * 	// in the interrupt
+ * 	load_monitor_block(busy_cycles, late, adc_overrun);
+ * 	// in the main loop
+ * 	if (load_monitor_get_events() & LOAD_MONITOR_EVENT_LATE)
+ * 		...
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef LOAD_MONITOR_H_
+#define LOAD_MONITOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Default time constant, 2^8 blocks is about 85ms at 96KHz */
+#ifndef LOAD_MONITOR_SHIFT
+#define LOAD_MONITOR_SHIFT 8
+#endif
+
+/* Default load of a block that raises LOAD_MONITOR_EVENT_HIGH_LOAD */
+#ifndef LOAD_MONITOR_THRESHOLD
+#define LOAD_MONITOR_THRESHOLD 90
+#endif
+
+/* 100% */
+#define LOAD_MONITOR_FULL_SCALE 10000
+
+enum {
+	LOAD_MONITOR_EVENT_HIGH_LOAD = (1 << 0),
+	LOAD_MONITOR_EVENT_LATE = (1 << 1),
+	LOAD_MONITOR_EVENT_OVERRUN = (1 << 2),
+};
+
+struct load_monitor_result {
+	/* the rolling average and the high-water mark in 0.01% steps */
+	uint16_t load;
+	uint16_t peak;
+	/* the cycles of the slowest block and the budget */
+	uint32_t peak_cycles;
+	uint32_t budget;
+	uint32_t num_of_blocks;
+	uint32_t late_blocks;
+	uint32_t overruns;
+};
+
+void load_monitor_init(uint32_t budget);
+void load_monitor_block(uint32_t cycles, uint8_t late, uint8_t overrun);
+uint32_t load_monitor_get_events(void);
+void load_monitor_get(struct load_monitor_result * result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOAD_MONITOR_H_ */
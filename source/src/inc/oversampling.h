@@ -0,0 +1,90 @@
+/*
+ * oversampling.h
+ *
+ * Oversampling front end of the filter chain. The ADC samples at M times
+ * the sample rate of the chain and the samples are decimated by M with a
+ * windowed-sinc FIR (arm_fir_decimate_f32 with USE_FPU, otherwise
+ * arm_fir_decimate_fast_q15), so the chain runs at the base rate with more
+ * effective bits and the analog anti-alias filter can be much simpler.
+ * Optionally the output of the chain is interpolated by M with the same
+ * FIR response (arm_fir_interpolate_f32/q15) and the DAC also runs at M
+ * times the base rate, which moves the DAC images away from the audio band.
+ *
+ * The FIR has OVERSAMPLING_TAPS_PER_PHASE * M taps and its -6dB point is at
+ * half the base rate. The instance owns the M * DSP_BLOCK_SIZE high rate
+ * buffer and the DSP_BLOCK_SIZE base rate buffer that the chain uses. The
+ * oversampling is only supported for the mono chain.
+ *
+ * Usage:
+ * 	static struct oversampling os;
+ * 	oversampling_init(&os, 4, 1);
+ * 	filter_chain_set_oversampling(&os);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef OVERSAMPLING_H_
+#define OVERSAMPLING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arm_math.h"
+
+#ifndef DSP_BLOCK_SIZE
+#define DSP_BLOCK_SIZE 32
+#endif
+
+/* Max oversampling factor */
+#ifndef OVERSAMPLING_MAX_FACTOR
+#define OVERSAMPLING_MAX_FACTOR 8
+#endif
+
+/* FIR taps per polyphase branch */
+#ifndef OVERSAMPLING_TAPS_PER_PHASE
+#define OVERSAMPLING_TAPS_PER_PHASE 16
+#endif
+
+#define OVERSAMPLING_MAX_TAPS (OVERSAMPLING_TAPS_PER_PHASE * OVERSAMPLING_MAX_FACTOR)
+
+#ifdef USE_FPU
+typedef float32_t oversampling_sample_t;
+#else
+/* 12-bit samples in Q15, so 3 extra bits are left for the decimation */
+typedef q15_t oversampling_sample_t;
+#endif
+
+struct oversampling {
+#ifdef USE_FPU
+	arm_fir_decimate_instance_f32 dec;
+	arm_fir_interpolate_instance_f32 interp;
+#else
+	arm_fir_decimate_instance_q15 dec;
+	arm_fir_interpolate_instance_q15 interp;
+#endif
+	oversampling_sample_t dec_coeffs[OVERSAMPLING_MAX_TAPS];
+	/* the interpolation coefficients have a gain of M */
+	oversampling_sample_t interp_coeffs[OVERSAMPLING_MAX_TAPS];
+	oversampling_sample_t dec_state[OVERSAMPLING_MAX_TAPS + OVERSAMPLING_MAX_FACTOR * DSP_BLOCK_SIZE - 1];
+	oversampling_sample_t interp_state[OVERSAMPLING_TAPS_PER_PHASE + DSP_BLOCK_SIZE - 1];
+	/* high rate samples */
+	oversampling_sample_t buf[OVERSAMPLING_MAX_FACTOR * DSP_BLOCK_SIZE];
+	/* base rate samples, the input and the output of the chain */
+	oversampling_sample_t base[DSP_BLOCK_SIZE];
+	uint8_t factor;
+	uint8_t interpolate;
+};
+
+int oversampling_init(struct oversampling * os, uint8_t factor, uint8_t interpolate);
+void oversampling_decimate(struct oversampling * os, const uint16_t * src, size_t len,
+		int32_t offset);
+void oversampling_interpolate(struct oversampling * os, uint16_t * dst, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OVERSAMPLING_H_ */
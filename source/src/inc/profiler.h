@@ -0,0 +1,112 @@
+/*
+ * profiler.h
+ *
+ * Cycle profiler of the sample interrupt. The interrupt is split in
+ * sections and every section is timed with DWT->CYCCNT (ns on the host).
+ * For every section the profiler keeps the count, the min/max/mean and a
+ * histogram with log2 buckets: bucket 0 is 0 cycles, bucket k is from
+ * 2^(k-1) to 2^k - 1 cycles and the last bucket has everything above. The
+ * main loop prints them with profiler_dump().
+ *
+ * The sections are timed with two macros, which are empty without
+ * USE_PROFILER, so the instrumented code is the same as without them:
+ * 	PROFILER_START(t);
+ * 	...
+ * 	PROFILER_MARK(PROFILER_BIQUADS, t);	// the time from t, then t = now
+ * The time of the bookkeeping is not added to the next section, but the
+ * PROFILER_IRQ section includes the bookkeeping of the inner sections.
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef USE_HOST
+#include <time.h>
+#include "core_cm0.h"
+#else
+#include "stm32f30x.h"
+#endif
+
+#define PROFILER_NUM_OF_BUCKETS 20
+
+enum profiler_point {
+	/* the whole block in the interrupt */
+	PROFILER_IRQ = 0,
+	/* ADC to the cascade format, DC tracker and decimation */
+	PROFILER_INPUT,
+	/* the biquad cascade with the ramp */
+	PROFILER_BIQUADS,
+	/* the FFT convolution */
+	PROFILER_CONV,
+	/* the cascade format to the DAC buffer and interpolation */
+	PROFILER_OUTPUT,
+	/* spectrum capture and signal statistics */
+	PROFILER_MONITOR,
+	/* the filters of the extra channels of the ADC scan */
+	PROFILER_SCAN,
+	PROFILER_NUM_OF_POINTS
+};
+
+struct profiler_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[PROFILER_NUM_OF_BUCKETS];
+};
+
+#ifdef USE_PROFILER
+
+#define PROFILER_START(VAR) uint32_t VAR = profiler_ticks()
+#define PROFILER_MARK(POINT, VAR) VAR = profiler_mark(POINT, VAR)
+
+/**
+ * @brief Get the profiler time. Cycles on the target, ns on the host
+ */
+static inline uint32_t profiler_ticks(void)
+{
+#ifdef USE_HOST
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#else
+	return DWT->CYCCNT;
+#endif
+}
+
+void profiler_add(enum profiler_point point, uint32_t ticks);
+
+/**
+ * @brief Add the time from start to a section
+ * @return The time after the bookkeeping, the start of the next section
+ */
+static inline uint32_t profiler_mark(enum profiler_point point, uint32_t start)
+{
+	profiler_add(point, profiler_ticks() - start);
+	return profiler_ticks();
+}
+
+void profiler_reset(void);
+void profiler_get(enum profiler_point point, struct profiler_stats * stats);
+void profiler_dump(uint32_t budget);
+
+#else
+
+#define PROFILER_START(VAR)
+#define PROFILER_MARK(POINT, VAR)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILER_H_ */
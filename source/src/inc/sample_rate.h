@@ -0,0 +1,46 @@
+/*
+ * sample_rate.h
+ *
+ * Runtime selection of the sample rate. The firmware boots at SAMPLE_RATE
+ * and sample_rate_set() restarts the sampling at another rate, without a
+ * reset. The TIM1 (ADC) and TIM2 (DAC) periods are calculated from the
+ * actual clock tree with RCC_GetClocksFreq(), so they are also correct with
+ * USE_OVERCLOCKING, and the ADC sample time is the longest that fits in
+ * the new period. The rate is rounded to the closest rate that the timer
+ * clock can divide, e.g. 44100 is 44090 at 72MHz. All the stages of the
+ * filter chain are redesigned for the actual rate with filter_chain_set_fs().
+ *
+ * Usage:
+ * 	// in the main loop
+ * 	uint32_t fs = sample_rate_set(48000);
+ * 	if (!fs)
+ * 		// not supported, still at sample_rate_get()
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef SAMPLE_RATE_H_
+#define SAMPLE_RATE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SAMPLE_RATE_MIN 8000
+#ifdef USE_ADC_INTERLEAVED
+/* each ADC converts every second sample */
+#define SAMPLE_RATE_MAX 384000
+#else
+#define SAMPLE_RATE_MAX 192000
+#endif
+
+uint32_t sample_rate_set(uint32_t fs);
+uint32_t sample_rate_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SAMPLE_RATE_H_ */
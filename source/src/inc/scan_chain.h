@@ -0,0 +1,100 @@
+/*
+ * scan_chain.h
+ *
+ * Filter graph of the extra channels of the ADC scan. With USE_ADC_SCAN
+ * ADC1 converts ADC_SCAN_CHANNELS channels on every TIM1 trigger and the
+ * DMA writes them interleaved, one scan after the other. The first channel
+ * is the input of the filter chain and every other channel, e.g. a sensor,
+ * has its own biquad cascade here. scan_chain_process() splits a block of
+ * scans to a contiguous run of samples per channel and then runs the
+ * cascades one channel after the other, so each cascade reads its own
+ * samples, coefficients and state sequentially. The last output sample of
+ * every channel is kept in 12-bit steps for the main loop.
+ *
+ * With USE_FPU the cascades run in float (arm_biquad_cascade_df2T_f32),
+ * otherwise always in Q31 (arm_biquad_cascade_df1_q31), whatever the
+ * DSP_Q_FORMAT of the filter chain is, because the low corner frequencies
+ * of the sensor filters need the precision. Even so, the corner frequency
+ * should not be lower than about fs / 1000, where the poles of a biquad are
+ * too close to 1 and the DC gain is off by a few percent.
+ *
+ * The stages are added and redesigned while the sampling is stopped, there
+ * is no double buffering like in the filter chain.
+ *
+ * Usage:
+ * 	scan_chain_init(fs, ADC_SCAN_CHANNELS - 1);
+ * 	scan_chain_add(0, FILTER_SO_BUTTERWORTH_LPF, 100, 0, 0);
+ * 	// in the interrupt, without the first channel
+ * 	scan_chain_process(&scan_buffer[1], DSP_BLOCK_SIZE, ADC_SCAN_CHANNELS);
+ * 	// in the main loop
+ * 	uint16_t value = scan_chain_get(0);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef SCAN_CHAIN_H_
+#define SCAN_CHAIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arm_math.h"
+#include "biquad_design.h"
+
+#ifndef DSP_BLOCK_SIZE
+#define DSP_BLOCK_SIZE 32
+#endif
+
+/* Max number of channels, the first channel of the scan is not included */
+#ifndef SCAN_CHAIN_MAX_CHANNELS
+#define SCAN_CHAIN_MAX_CHANNELS 7
+#endif
+
+/* Max number of biquad stages per channel */
+#ifndef SCAN_CHAIN_MAX_STAGES
+#define SCAN_CHAIN_MAX_STAGES 4
+#endif
+
+/**
+ * @brief The cascade of a channel. Everything that the interrupt uses for a
+ * 		channel is in one place.
+ */
+struct scan_chain_channel {
+#ifdef USE_FPU
+	arm_biquad_cascade_df2T_instance_f32 inst;
+	float32_t coeffs[BIQUAD_NUM_COEFFS * SCAN_CHAIN_MAX_STAGES];
+	float32_t state[2 * SCAN_CHAIN_MAX_STAGES];
+#else
+	arm_biquad_casd_df1_inst_q31 inst;
+	q31_t coeffs[BIQUAD_NUM_COEFFS * SCAN_CHAIN_MAX_STAGES];
+	q31_t state[4 * SCAN_CHAIN_MAX_STAGES];
+#endif
+	/* the last output sample in 12-bit steps */
+	volatile uint16_t value;
+};
+
+struct scan_chain {
+	struct scan_chain_channel channels[SCAN_CHAIN_MAX_CHANNELS];
+	/* the design parameters, only used by the main loop */
+	struct biquad_params stages[SCAN_CHAIN_MAX_CHANNELS][SCAN_CHAIN_MAX_STAGES];
+	uint8_t num_of_stages[SCAN_CHAIN_MAX_CHANNELS];
+	uint8_t num_of_channels;
+	uint32_t fs;
+};
+
+void scan_chain_init(uint32_t fs, uint8_t num_of_channels);
+int scan_chain_add(uint8_t channel, enum biquad_type type, float fc, float q, float gain_db);
+int scan_chain_clear(uint8_t channel);
+int scan_chain_set_fs(uint32_t fs);
+void scan_chain_process(const uint16_t * src, size_t len, size_t stride);
+uint16_t scan_chain_get(uint8_t channel);
+uint8_t scan_chain_get_num_of_channels(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCAN_CHAIN_H_ */
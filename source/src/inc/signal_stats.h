@@ -0,0 +1,81 @@
+/*
+ * signal_stats.h
+ *
+ * Statistics of the ADC input and the DAC output. For every block the
+ * interrupt calls signal_stats_process(), which converts the 12-bit samples
+ * to zero-centred samples (float with USE_FPU, otherwise Q15) and gets the
+ * RMS, the min/max and the mean with the CMSIS-DSP block functions
+ * (arm_rms/min/max/mean_f32 or _q15). The same loop counts the ADC samples
+ * on the rails (0 or 4095) and the DAC samples that are clipped. The block
+ * values are accumulated in a window of num_of_blocks blocks. When the
+ * window is complete it's copied to the result, which the main loop reads
+ * with signal_stats_get() without disabling the interrupts.
+ *
+ * In stereo mode only the first channel is measured.
+ *
+ * Usage:
+ * 	signal_stats_init(SAMPLE_RATE / DSP_BLOCK_SIZE);
+ * 	// in the interrupt
+ * 	signal_stats_process(adc, adc_len, dac, dac_len, 1);
+ * 	// in the main loop
+ * 	struct signal_stats_result result;
+ * 	uint32_t window = signal_stats_get(&result);
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef SIGNAL_STATS_H_
+#define SIGNAL_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "arm_math.h"
+
+#ifndef DSP_BLOCK_SIZE
+#define DSP_BLOCK_SIZE 32
+#endif
+
+/* Default window length */
+#ifndef SIGNAL_STATS_WINDOW_MS
+#define SIGNAL_STATS_WINDOW_MS 1000
+#endif
+
+#ifdef USE_FPU
+/* [-1, 1) */
+typedef float32_t signal_stats_sample_t;
+#else
+/* 12-bit samples in Q15 */
+typedef q15_t signal_stats_sample_t;
+#endif
+
+struct signal_stats_channel {
+	signal_stats_sample_t rms;
+	signal_stats_sample_t min;
+	signal_stats_sample_t max;
+	/* the DC offset */
+	signal_stats_sample_t mean;
+	/* ADC samples on the rails or clipped DAC samples */
+	uint32_t clips;
+};
+
+struct signal_stats_result {
+	struct signal_stats_channel adc;
+	struct signal_stats_channel dac;
+	uint32_t num_of_blocks;
+};
+
+void signal_stats_init(uint32_t num_of_blocks);
+void signal_stats_process(const uint16_t * adc, size_t adc_len,
+		const uint16_t * dac, size_t dac_len, size_t stride);
+uint32_t signal_stats_get(struct signal_stats_result * result);
+int32_t signal_stats_to_lsb(signal_stats_sample_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIGNAL_STATS_H_ */
@@ -0,0 +1,88 @@
+/*
+ * spectrum.h
+ *
+ * Background spectrum analyzer of the DAC output. The interrupt only copies
+ * the processed samples in a lock-free capture ring with spectrum_capture().
+ * The main loop consumes the ring in spectrum_update(), applies a Hann
+ * window to every SPECTRUM_FFT_SIZE samples and runs arm_rfft_fast_f32 and
+ * arm_cmplx_mag_f32. The magnitudes are averaged until spectrum_publish()
+ * is called, e.g. from a timer, which encodes the averaged bins in a binary
+ * frame. The frame is sent from spectrum_update() with the send callback,
+ * a few bytes at a time if the callback can't take the whole frame. Since
+ * everything except the copy runs in the main loop, the audio path is not
+ * affected. If the main loop is too slow, the ring overflows and the new
+ * samples are dropped and counted.
+ *
+ * The bins are normalized so a full-scale sine is 0dBFS and they are sent
+ * with 0.5dB steps from -127.5 to 0dBFS. The frame is (little endian):
+ * 	u8 sync[2]      SPECTRUM_SYNC0, SPECTRUM_SYNC1
+ * 	u8 type         SPECTRUM_FRAME_TYPE
+ * 	u16 num_of_bins bins from DC up to (num_of_bins - 1) * fs / (2 * num_of_bins)
+ * 	u32 fs          sample rate of the captured samples
+ * 	u16 averages    number of averaged FFTs
+ * 	u16 dropped     captured samples dropped since the last frame
+ * 	u8 bins[]       level in dBFS = bins[k] / 2 - 127.5
+ * 	u8 checksum     xor of all bytes after the sync
+ *
+ * Usage:
+ * 	spectrum_init(fs, &send_cbk);
+ * 	mod_timer_add(NULL, SPECTRUM_PUBLISH_MS, (void*) &spectrum_publish, &list);
+ * 	// in the interrupt
+ * 	spectrum_capture(samples, len, 1);
+ * 	// in the main loop
+ * 	spectrum_update();
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* FFT size, a power of two from 32 to 4096 */
+#ifndef SPECTRUM_FFT_SIZE
+#define SPECTRUM_FFT_SIZE 512
+#endif
+
+/* Capture ring size in samples, a power of two */
+#ifndef SPECTRUM_RING_SIZE
+#define SPECTRUM_RING_SIZE 1024
+#endif
+
+/* Default publish period */
+#ifndef SPECTRUM_PUBLISH_MS
+#define SPECTRUM_PUBLISH_MS 250
+#endif
+
+#define SPECTRUM_NUM_OF_BINS (SPECTRUM_FFT_SIZE / 2)
+
+#define SPECTRUM_SYNC0 0xA5
+#define SPECTRUM_SYNC1 0x5A
+#define SPECTRUM_FRAME_TYPE 0x01
+#define SPECTRUM_HEADER_SIZE 13
+#define SPECTRUM_FRAME_SIZE(BINS) (SPECTRUM_HEADER_SIZE + (BINS) + 1)
+/* dBFS of the bin value 0 and the step per bin value */
+#define SPECTRUM_DB_MIN (-127.5f)
+#define SPECTRUM_DB_STEP 0.5f
+
+/**
+ * @brief Send callback. It returns the number of bytes that it could take.
+ */
+typedef size_t (*spectrum_send_t)(const uint8_t * buffer, size_t len);
+
+void spectrum_init(uint32_t fs, spectrum_send_t fp_send);
+void spectrum_capture(const uint16_t * samples, size_t len, size_t stride);
+void spectrum_update(void);
+void spectrum_publish(void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPECTRUM_H_ */
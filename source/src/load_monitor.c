@@ -0,0 +1,104 @@
+/*
+ * load_monitor.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include "load_monitor.h"
+#ifdef USE_HOST
+#include "core_cm0.h"
+#else
+#include "stm32f30x.h"
+#endif
+
+struct tp_load_monitor {
+	uint32_t budget;
+	/* the rolling average in 0.01% steps with LOAD_MONITOR_SHIFT fractional bits */
+	uint32_t load_acc;
+	uint32_t peak_cycles;
+	uint32_t num_of_blocks;
+	uint32_t late_blocks;
+	uint32_t overruns;
+	volatile uint32_t events;
+};
+
+static struct tp_load_monitor m_load;
+
+/**
+ * @brief Initialize the monitor and clear the counters
+ * @param[in] budget The cycles of a block
+ */
+void load_monitor_init(uint32_t budget)
+{
+	__disable_irq();
+	memset(&m_load, 0, sizeof(m_load));
+	m_load.budget = budget ? budget : 1;
+	__enable_irq();
+}
+
+/**
+ * @brief Add a block. This is called from the interrupt.
+ * @param[in] cycles The cycles that the interrupt was busy with the block
+ * @param[in] late The block was finished after its deadline
+ * @param[in] overrun Number of the ADC overruns since the last block
+ */
+void load_monitor_block(uint32_t cycles, uint8_t late, uint8_t overrun)
+{
+	uint32_t load = (uint32_t) ((uint64_t) cycles * LOAD_MONITOR_FULL_SCALE / m_load.budget);
+	uint32_t events = 0;
+
+	if (!m_load.num_of_blocks)
+		/* start from the first block instead of zero */
+		m_load.load_acc = load << LOAD_MONITOR_SHIFT;
+	else
+		m_load.load_acc += load - (m_load.load_acc >> LOAD_MONITOR_SHIFT);
+	m_load.num_of_blocks++;
+
+	if (cycles > m_load.peak_cycles)
+		m_load.peak_cycles = cycles;
+	if (load > LOAD_MONITOR_THRESHOLD * (LOAD_MONITOR_FULL_SCALE / 100))
+		events |= LOAD_MONITOR_EVENT_HIGH_LOAD;
+	if (late) {
+		m_load.late_blocks++;
+		events |= LOAD_MONITOR_EVENT_LATE;
+	}
+	if (overrun) {
+		m_load.overruns += overrun;
+		events |= LOAD_MONITOR_EVENT_OVERRUN;
+	}
+	if (events)
+		m_load.events |= events;
+}
+
+/**
+ * @brief Get and clear the events that were raised since the last call.
+ * 		This is called from the main loop.
+ * @return The LOAD_MONITOR_EVENT_* flags
+ */
+uint32_t load_monitor_get_events(void)
+{
+	__disable_irq();
+	uint32_t events = m_load.events;
+	m_load.events = 0;
+	__enable_irq();
+	return events;
+}
+
+/**
+ * @brief Get the load and the counters. This is called from the main loop.
+ */
+void load_monitor_get(struct load_monitor_result * result)
+{
+	__disable_irq();
+	uint32_t load = m_load.load_acc >> LOAD_MONITOR_SHIFT;
+	uint32_t peak = (uint32_t) ((uint64_t) m_load.peak_cycles * LOAD_MONITOR_FULL_SCALE
+			/ m_load.budget);
+	result->peak_cycles = m_load.peak_cycles;
+	result->budget = m_load.budget;
+	result->num_of_blocks = m_load.num_of_blocks;
+	result->late_blocks = m_load.late_blocks;
+	result->overruns = m_load.overruns;
+	__enable_irq();
+	result->load = (load > UINT16_MAX) ? UINT16_MAX : load;
+	result->peak = (peak > UINT16_MAX) ? UINT16_MAX : peak;
+}
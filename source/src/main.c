@@ -5,12 +5,45 @@
 #ifdef USE_DBGUART
 #include "dev_uart.h"
 #endif
-#ifdef USE_STTERM
+#if defined(USE_STTERM) || defined(USE_STTERM_RING)
 #include "stlinky.h"
 #endif
 #include "mod_led.h"
 #include "timer_sched.h"
-#include "filter_includes.h"
+#include "filter_chain.h"
+#ifdef USE_FIXED_CHAIN
+#include "filter_chain_coeffs.h"
+#endif
+#ifdef USE_FILTER_BENCH
+#include "filter_bench.h"
+#endif
+#ifdef USE_FFT_CONV
+#include "fft_conv_ir.h"
+#endif
+#ifdef USE_SPECTRUM
+#include "spectrum.h"
+#endif
+#ifdef USE_SIGNAL_STATS
+#include "signal_stats.h"
+#endif
+#ifdef USE_DC_TRACKER
+#include "dc_tracker.h"
+#endif
+#ifdef USE_LOAD_MONITOR
+#include "load_monitor.h"
+#endif
+#ifdef USE_ADC_SCAN
+#include "dev_adc.h"
+#include "scan_chain.h"
+#endif
+#ifdef USE_CHAIN_CMD
+#include "chain_cmd.h"
+#endif
+#ifdef USE_CAPTURE
+#include "capture.h"
+#endif
+#include "sample_rate.h"
+#include "profiler.h"
 
 #define LED_TIMER_MS 500
 #define LED_PORT GPIOC
@@ -18,37 +51,245 @@
 
 #define ADC_PORT GPIOA
 #define ADC_PIN	GPIO_Pin_0
+/* ADC2 channel 3 is the second channel of the stereo mode. In interleaved
+ * mode it must be connected to ADC_PIN. */
+#define ADC2_PIN GPIO_Pin_6
 
 #define DBG_PIN GPIO_Pin_7
 #define DBG_PORT GPIOB
 
+/* The sample rate after the boot, see sample_rate_set() */
 #define SAMPLE_RATE 96000
 
+#ifndef DSP_OVERSAMPLING
+#define DSP_OVERSAMPLING 1
+#endif
+
+/* With oversampling the ADC, and optionally the DAC, run at M * fs and the
+ * DMA half buffers have M * DSP_BLOCK_SIZE samples. DAC_DECIMATION is the
+ * ratio of the ADC and the DAC rate. */
+#define ADC_BLOCK_SIZE (DSP_BLOCK_SIZE * DSP_OVERSAMPLING)
+#ifdef USE_OVERSAMPLED_DAC
+#define DAC_DECIMATION 1
+#define DAC_BLOCK_SIZE ADC_BLOCK_SIZE
+#else
+#define DAC_DECIMATION DSP_OVERSAMPLING
+#define DAC_BLOCK_SIZE DSP_BLOCK_SIZE
+#endif
+
+/* In interleaved mode ADC1 and ADC2 take turns, each at half of the ADC
+ * rate. TIM1 has twice the period, its update triggers ADC1 and its CC1
+ * half way triggers ADC2. timers_start() starts TIM1 with the update, so
+ * ADC1 converts the first sample of every pair. Each ADC has its own DMA
+ * buffer of ADC_BLOCK_SIZE samples, with half of every block, and they are
+ * merged in the interrupt of ADC2, which converts the last sample of every
+ * pair. */
+#ifdef USE_ADC_INTERLEAVED
+#define ADC_INTERLEAVE 2
+#define BLOCK_DMA DMA2_Channel1
+#define BLOCK_DMA_IRQn DMA2_Channel1_IRQn
+#define BLOCK_DMA_IT_HT DMA2_IT_HT1
+#define BLOCK_DMA_IT_TC DMA2_IT_TC1
+#define BLOCK_DMA_IT_GL DMA2_IT_GL1
+#define BLOCK_DMA_FLAG_HT DMA2_FLAG_HT1
+#define BLOCK_DMA_FLAG_TC DMA2_FLAG_TC1
+#else
+#define ADC_INTERLEAVE 1
+#define BLOCK_DMA DMA1_Channel1
+#define BLOCK_DMA_IRQn DMA1_Channel1_IRQn
+#define BLOCK_DMA_IT_HT DMA1_IT_HT1
+#define BLOCK_DMA_IT_TC DMA1_IT_TC1
+#define BLOCK_DMA_IT_GL DMA1_IT_GL1
+#define BLOCK_DMA_FLAG_HT DMA1_FLAG_HT1
+#define BLOCK_DMA_FLAG_TC DMA1_FLAG_TC1
+#endif
+/* With USE_ADC_SCAN ADC1 converts ADC_SCAN_CHANNELS channels on every
+ * trigger and the DMA buffer has one scan after the other. The first
+ * channel of every scan is the input of the filter chain. */
+#ifndef ADC_SCAN_CHANNELS
+#define ADC_SCAN_CHANNELS 1
+#endif
+/* The DMA transfers of a half buffer of each ADC */
+#define ADC_DMA_BLOCK_SIZE (ADC_BLOCK_SIZE / ADC_INTERLEAVE * ADC_SCAN_CHANNELS)
+
+#if defined(USE_ADC_INTERLEAVED) && defined(USE_STEREO)
+#error "USE_ADC_INTERLEAVED uses ADC2 for the first channel"
+#endif
+
+#if defined(USE_ADC_INTERLEAVED) && (ADC_BLOCK_SIZE % 2)
+#error "USE_ADC_INTERLEAVED needs an even number of ADC samples per block"
+#endif
+
+#if defined(USE_ADC_SCAN) && \
+	(defined(USE_STEREO) || defined(USE_ADC_INTERLEAVED) || defined(USE_OVERSAMPLING))
+#error "USE_ADC_SCAN is only supported for the mono chain without oversampling"
+#endif
+
+#if defined(USE_ADC_SCAN) && (ADC_SCAN_CHANNELS < 2 || ADC_SCAN_CHANNELS > 8)
+#error "ADC_SCAN_CHANNELS must be from 2 to 8"
+#endif
+
+/* The timer clock is the APB clock, or twice the APB clock if the APB
+ * prescaler is not 1 */
+#define TIMER_CLOCK(PCLK, HCLK) (((PCLK) == (HCLK)) ? (PCLK) : 2 * (PCLK))
+
+/* A conversion takes the sample time plus 12.5 cycles of the ADC clock. The
+ * ADC_SampleTime_xCycles5 values index this table of the sample times in
+ * half cycles. */
+#define ADC_CONVERSION_HALF_CYCLES 25
+static const uint16_t adc_sample_half_cycles[] = {
+	3, 5, 9, 15, 39, 123, 363, 1203
+};
+
+#if defined(USE_FIXED_CHAIN) && (FILTER_CHAIN_FIXED_FS != SAMPLE_RATE)
+#error "FILTER_CHAIN_FIXED_FS in filter_chain_fixed.h must be the SAMPLE_RATE"
+#endif
+
+#if defined(USE_FFT_CONV) && (FFT_CONV_IR_FS != SAMPLE_RATE)
+#error "FFT_CONV_IR_FS in fft_conv_ir.h must be the SAMPLE_RATE"
+#endif
+
+#if defined(USE_FFT_CONV) && \
+	(DSP_BLOCK_SIZE < 16 || DSP_BLOCK_SIZE > FFT_CONV_MAX_PARTITION_SIZE)
+#error "DSP_BLOCK_SIZE must be a valid FFT_CONV partition size"
+#endif
+
+#if defined(USE_SPECTRUM) && !defined(USE_DBGUART)
+#error "USE_SPECTRUM sends the frames on the debug UART"
+#endif
+
+#if defined(USE_PROFILER) && !defined(USE_DBGUART)
+#error "USE_PROFILER is dumped on the debug UART"
+#endif
+
+#if defined(USE_CHAIN_CMD) && (!defined(USE_DBGUART) || defined(USE_SPECTRUM))
+#error "USE_CHAIN_CMD needs the debug UART without USE_SPECTRUM"
+#endif
+
+#if defined(USE_CAPTURE) && \
+	(!defined(USE_DBGUART) || defined(USE_SPECTRUM) || defined(USE_CHAIN_CMD))
+#error "USE_CAPTURE needs the debug UART without USE_SPECTRUM and USE_CHAIN_CMD"
+#endif
+
+#if defined(USE_TRACE_LOG) && (!defined(USE_DBGUART) || defined(USE_SPECTRUM) || \
+	defined(USE_CHAIN_CMD) || defined(USE_CAPTURE))
+#error "USE_TRACE_LOG needs the debug UART without USE_SPECTRUM, USE_CHAIN_CMD and USE_CAPTURE"
+#endif
+
+/* Passes over the benchmark buffer for each filter type */
+#define FILTER_BENCH_REPEATS 16
+
 #define ADC1_DR_ADDRESS     0x50000040
+#define ADC2_DR_ADDRESS     0x50000140
+#define ADC12_CDR_ADDRESS   0x5000030C
+#define DAC_DHR12R1_Address      0x40007408
 #define DAC_DHR12RD_Address      0x40007420
 __IO uint16_t calibration_value = 0;
 
 volatile uint32_t glb_tmr_1ms;
 volatile uint32_t glb_tmr_1s;
 volatile uint32_t irq_count;
+volatile uint32_t irq_cycles;
+#ifdef USE_CHAIN_CMD
+/* the samples and the cycles per sample of the last second */
+static uint32_t m_last_count;
+static uint32_t m_last_cycles;
+#endif
 uint32_t trace_levels;
 
-#define NUM_OF_FILTERS 5
-F_SIZE (*filter_p[NUM_OF_FILTERS])(F_SIZE sample);
+/* The timer periods and the ADC sample time of a sample rate */
+struct tp_rate {
+	/* the actual rate, that the timer clock can divide */
+	uint32_t fs;
+	/* TIM1 and TIM2 periods in timer clocks */
+	uint32_t adc_period;
+	uint32_t dac_period;
+	uint8_t adc_sample_time;
+};
+static struct tp_rate m_rate;
+
+#ifdef USE_OVERSAMPLING
+static struct oversampling m_os;
+#endif
+
+#ifdef USE_DC_TRACKER
+/* The ADC offset of each channel */
+#ifdef USE_STEREO
+static struct dc_tracker m_dc[2];
+#else
+static struct dc_tracker m_dc[1];
+#endif
+#endif
+
+#ifdef USE_ADC_SCAN
+/* The ADC1 channels in the order of the scan, the first ADC_SCAN_CHANNELS
+ * are used. The first is the input of the filter chain. The internal
+ * channels need a long sample time, so they are only accurate at low
+ * sample rates. */
+static struct adc_channel m_scan_channels[] = {
+	{ .channel = ADC_Channel_1, .port = GPIOA, .pin = GPIO_Pin_0 },
+	{ .channel = ADC_Channel_2, .port = GPIOA, .pin = GPIO_Pin_1 },
+	{ .channel = ADC_Channel_3, .port = GPIOA, .pin = GPIO_Pin_2 },
+	{ .channel = ADC_Channel_4, .port = GPIOA, .pin = GPIO_Pin_3 },
+	{ .channel = ADC_Channel_14, .port = GPIOB, .pin = GPIO_Pin_11 },
+	{ .channel = ADC_Channel_TempSensor, .port = NULL },
+	{ .channel = ADC_Channel_Vrefint, .port = NULL },
+	{ .channel = ADC_Channel_Vbat, .port = NULL },
+};
+#endif
+
+#ifdef USE_FFT_CONV
+/* The IR convolution of each channel. The partition size is the block
+ * size, so the FFT work is spread evenly in the interrupts. */
+#ifdef USE_STEREO
+static struct fft_conv m_conv[2];
+#else
+static struct fft_conv m_conv[1];
+#endif
+#endif
 
+/* The DMA buffers are split in two halves of ADC/DAC_BLOCK_SIZE samples.
+ * While the DMA fills/drains one half, the CPU processes the other. A block
+ * is written at the same index of the DAC buffer, which is played one
+ * buffer later, so the latency is fixed to 2 * DAC_BLOCK_SIZE + 2 DAC
+ * periods (the TIM2 phase and the DHR to DOR transfer of the DAC).
+ * In stereo mode every sample is a 32-bit word with ADC1/DAC channel 1 in
+ * the low and ADC2/DAC channel 2 in the high half-word.
+ */
 struct tp_io {
-	uint32_t adc_sample;
-	uint32_t dac_sample;
-	uint8_t sample_ready;
+#ifdef USE_STEREO
+	uint32_t adc_buffer[2 * ADC_BLOCK_SIZE];
+	uint32_t dac_buffer[2 * DAC_BLOCK_SIZE];
+#else
+	uint16_t adc_buffer[2 * ADC_BLOCK_SIZE];
+	uint16_t dac_buffer[2 * DAC_BLOCK_SIZE];
+#endif
+#ifdef USE_ADC_INTERLEAVED
+	/* the even samples from ADC1 and the odd from ADC2 */
+	uint16_t adc1_buffer[2 * ADC_DMA_BLOCK_SIZE];
+	uint16_t adc2_buffer[2 * ADC_DMA_BLOCK_SIZE];
+#endif
+#ifdef USE_ADC_SCAN
+	/* the scans of all the channels, the first channel is copied to adc_buffer */
+	uint16_t adc_scan_buffer[2 * ADC_DMA_BLOCK_SIZE];
+#endif
+	volatile uint8_t sample_ready;
 };
-volatile struct tp_io io;
+struct tp_io io;
 
 /* Create the list head for the timer */
 static LIST_HEAD(obj_timer_list);
 
 // Declare uart
 #ifdef USE_DBGUART
-DECLARE_UART_DEV(dbg_uart, USART1, 115200, 256, 10, 1);
+#ifndef DBGUART_BAUDRATE
+#define DBGUART_BAUDRATE 115200
+#endif
+#ifdef USE_DBGUART_DMA
+DECLARE_UART_DEV_DMA(dbg_uart, USART1, DBGUART_BAUDRATE, 256, 10, 1);
+#else
+DECLARE_UART_DEV(dbg_uart, USART1, DBGUART_BAUDRATE, 256, 10, 1);
+#endif
 #endif
 
 #ifdef USE_OVERCLOCKING
@@ -57,9 +298,308 @@ extern uint32_t overclock_stm32f303(void);
 
 static void TIMER_Config(void);
 static void ADC_Config(void);
+static void sampling_stop(void);
+static void sampling_start(void);
+static void timers_start(void);
 static void DMA_Config(void);
 static void DAC_Config(void);
 
+#if defined(USE_SPECTRUM) || defined(USE_CHAIN_CMD) || defined(USE_CAPTURE)
+static size_t dbg_uart_send(const uint8_t * buffer, size_t len)
+{
+	return dev_uart_send_buffer(&dbg_uart, (uint8_t *) buffer, len);
+}
+#endif
+
+#ifdef USE_TRACE_LOG
+/* A whole frame or nothing, so a printf can't split a frame */
+static size_t dbg_uart_send_frame(const uint8_t * buffer, size_t len)
+{
+	if (spsc_ring_free(&dbg_uart.uart_buff.tx_ring) < len)
+		return 0;
+	return dev_uart_send_buffer(&dbg_uart, (uint8_t *) buffer, len);
+}
+#endif
+
+#if defined(USE_SIGNAL_STATS) && !defined(USE_SPECTRUM)
+/**
+ * @brief Print the last window of the signal statistics in 12-bit steps:
+ * 		adc <rms> <min> <max> <dc> <rails> dac <rms> <min> <max> <dc> <clips>
+ */
+static void print_signal_stats(void)
+{
+	static uint32_t last_window;
+	struct signal_stats_result r;
+	uint32_t window = signal_stats_get(&r);
+
+	if (window == last_window)
+		return;
+	last_window = window;
+	printf("adc %d %d %d %d %d dac %d %d %d %d %d\n",
+			(int) signal_stats_to_lsb(r.adc.rms), (int) signal_stats_to_lsb(r.adc.min),
+			(int) signal_stats_to_lsb(r.adc.max), (int) signal_stats_to_lsb(r.adc.mean),
+			(int) r.adc.clips,
+			(int) signal_stats_to_lsb(r.dac.rms), (int) signal_stats_to_lsb(r.dac.min),
+			(int) signal_stats_to_lsb(r.dac.max), (int) signal_stats_to_lsb(r.dac.mean),
+			(int) r.dac.clips);
+}
+#endif
+
+/**
+ * @brief Initialize the modules that depend on the sample rate
+ */
+static void sample_rate_init_modules(uint32_t fs)
+{
+#ifdef USE_SIGNAL_STATS
+	signal_stats_init((uint32_t) ((uint64_t) SIGNAL_STATS_WINDOW_MS * fs
+			/ (1000 * DSP_BLOCK_SIZE)));
+#endif
+#ifdef USE_SPECTRUM
+	/* Analyze the DAC output, at the DAC rate */
+	spectrum_init(fs * DSP_OVERSAMPLING / DAC_DECIMATION, &dbg_uart_send);
+#endif
+#ifdef USE_CAPTURE
+#ifdef USE_STEREO
+	capture_init(fs * DSP_OVERSAMPLING, fs * DSP_OVERSAMPLING / DAC_DECIMATION, 2, &dbg_uart_send);
+#else
+	capture_init(fs * DSP_OVERSAMPLING, fs * DSP_OVERSAMPLING / DAC_DECIMATION, 1, &dbg_uart_send);
+#endif
+#endif
+#ifdef USE_LOAD_MONITOR
+	/* the cycles of a block */
+	load_monitor_init((uint32_t) ((uint64_t) SystemCoreClock * DSP_BLOCK_SIZE / fs));
+#endif
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/**
+ * @brief Calculate the timer periods and the ADC sample time of a sample
+ * 		rate from the current clock tree. TIM1 triggers the ADC and runs
+ * 		from PCLK2, TIM2 triggers the DAC and runs from PCLK1 and the ADC
+ * 		runs from HCLK. The TIM1 period is rounded so that TIM2 has the
+ * 		exact DAC period, then both timers run at the same rate.
+ * @param[in] fs The requested sample rate
+ * @param[out] rate The periods and the actual sample rate
+ * @return 0 on success or -1 if the rate is not supported
+ */
+static int sample_rate_calc(uint32_t fs, struct tp_rate * rate)
+{
+	RCC_ClocksTypeDef clocks;
+
+	if (fs < SAMPLE_RATE_MIN || fs > SAMPLE_RATE_MAX)
+		return -1;
+
+	RCC_GetClocksFreq(&clocks);
+	uint32_t hclk = clocks.HCLK_Frequency;
+	uint32_t adc_clk = TIMER_CLOCK(clocks.PCLK2_Frequency, hclk);
+	uint32_t dac_clk = TIMER_CLOCK(clocks.PCLK1_Frequency, hclk);
+	uint32_t adc_rate = fs * DSP_OVERSAMPLING;
+
+	/* the smallest TIM1 period step that TIM2 can follow */
+	uint32_t step = adc_clk / gcd(adc_clk, dac_clk * DAC_DECIMATION);
+	uint32_t period = (adc_clk + adc_rate / 2) / adc_rate;
+	period = ((period + step / 2) / step) * step;
+	if (!period)
+		period = step;
+
+	rate->adc_period = period;
+	rate->dac_period = (uint32_t) ((uint64_t) period * DAC_DECIMATION * dac_clk / adc_clk);
+	rate->fs = adc_clk / (period * DSP_OVERSAMPLING);
+	if (rate->adc_period * ADC_INTERLEAVE > 0x10000 || rate->dac_period > 0x10000)
+		return -1;
+
+	/* The longest sample time that leaves at least half of the period free.
+	 * In interleaved mode every ADC has two periods and in scan mode the
+	 * channels share the period. */
+	uint32_t adc_half_cycles = (uint32_t) ((uint64_t) period * ADC_INTERLEAVE * hclk / adc_clk)
+			/ ADC_SCAN_CHANNELS;
+	int i = sizeof(adc_sample_half_cycles) / sizeof(adc_sample_half_cycles[0]) - 1;
+	while (i >= 0 && adc_sample_half_cycles[i] + ADC_CONVERSION_HALF_CYCLES > adc_half_cycles)
+		i--;
+	if (i < 0)
+		return -1;
+	rate->adc_sample_time = (uint8_t) i;
+	return 0;
+}
+
+/**
+ * @brief Restart the sampling at another rate, without a reset. The ADC
+ * 		and the DAC are stopped, the timers and the ADC sample time are set
+ * 		for the current clock tree and all the filter chain stages are
+ * 		redesigned for the new rate. The filters start from zero state, so
+ * 		there is a short glitch in the output. Call it from the main loop,
+ * 		not from an interrupt.
+ * @param[in] fs The sample rate, from SAMPLE_RATE_MIN to SAMPLE_RATE_MAX
+ * @return The actual sample rate, which is the closest rate that the timer
+ * 		clock can divide, or 0 if fs is not supported or a stage is not
+ * 		valid at fs. Then the sampling continues at the previous rate.
+ */
+uint32_t sample_rate_set(uint32_t fs)
+{
+	struct tp_rate rate;
+
+	if (sample_rate_calc(fs, &rate) < 0)
+		return 0;
+
+	sampling_stop();
+#ifdef USE_ADC_SCAN
+	if (scan_chain_set_fs(rate.fs) < 0) {
+		sampling_start();
+		return 0;
+	}
+#endif
+	if (filter_chain_set_fs(rate.fs) < 0) {
+#ifdef USE_ADC_SCAN
+		/* it was valid at the previous rate */
+		scan_chain_set_fs(m_rate.fs);
+#endif
+		sampling_start();
+		return 0;
+	}
+	m_rate = rate;
+
+	TIM_SetAutoreload(TIM1, rate.adc_period * ADC_INTERLEAVE - 1);
+	TIM_SetAutoreload(TIM2, rate.dac_period - 1);
+#ifdef USE_ADC_SCAN
+	adc_set_sample_time(rate.adc_sample_time);
+#else
+	ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 1, rate.adc_sample_time);
+#endif
+#if defined(USE_STEREO) || defined(USE_ADC_INTERLEAVED)
+	ADC_RegularChannelConfig(ADC2, ADC_Channel_3, 1, rate.adc_sample_time);
+#endif
+#ifdef USE_ADC_INTERLEAVED
+	TIM_SetCompare1(TIM1, rate.adc_period);
+#endif
+
+#ifdef USE_OVERSAMPLING
+	/* The decimator and the interpolator are normalized to the rate, only
+	 * their state is cleared */
+	oversampling_init(&m_os, DSP_OVERSAMPLING, DAC_DECIMATION == 1);
+#endif
+#ifdef USE_FFT_CONV
+	/* The IR is designed for SAMPLE_RATE, only the tail is cleared */
+	for (int i=0; i<(int) (sizeof(m_conv) / sizeof(m_conv[0])); i++)
+		fft_conv_init(&m_conv[i], DSP_BLOCK_SIZE, fft_conv_ir, FFT_CONV_IR_TAPS);
+#endif
+	sample_rate_init_modules(rate.fs);
+
+	sampling_start();
+	return rate.fs;
+}
+
+/**
+ * @brief Get the actual sample rate
+ */
+uint32_t sample_rate_get(void)
+{
+	return m_rate.fs;
+}
+
+#if defined(USE_LOAD_MONITOR) && !defined(USE_SPECTRUM)
+/**
+ * @brief Print the load in %, the high-water mark in %, the late blocks and
+ * 		the ADC overruns, and the events since the last call:
+ * 		load <load> <peak> <late> <overruns>
+ * 		load warning [high] [late] [overrun]
+ */
+static void print_load(void)
+{
+	struct load_monitor_result r;
+	uint32_t events = load_monitor_get_events();
+
+	load_monitor_get(&r);
+	printf("load %d.%02d %d.%02d %d %d\n", r.load / 100, r.load % 100,
+			r.peak / 100, r.peak % 100, (int) r.late_blocks, (int) r.overruns);
+	if (events)
+		printf("load warning%s%s%s\n",
+				(events & LOAD_MONITOR_EVENT_HIGH_LOAD) ? " high" : "",
+				(events & LOAD_MONITOR_EVENT_LATE) ? " late" : "",
+				(events & LOAD_MONITOR_EVENT_OVERRUN) ? " overrun" : "");
+}
+#endif
+
+#if defined(USE_ADC_SCAN) && !defined(USE_SPECTRUM)
+/**
+ * @brief Print the filtered value of every extra channel of the scan in
+ * 		12-bit steps: scan <channel 2> ... <channel ADC_SCAN_CHANNELS>
+ */
+static void print_scan(void)
+{
+	printf("scan");
+	for (int i=0; i<scan_chain_get_num_of_channels(); i++)
+		printf(" %d", (int) scan_chain_get(i));
+	printf("\n");
+}
+#endif
+
+#ifdef USE_CHAIN_CMD
+/**
+ * @brief Fill the stats of the CHAIN_CMD_STATS command
+ */
+static void chain_cmd_get_stats(struct chain_cmd_stats * stats)
+{
+	stats->samples = m_last_count;
+	stats->cycles = m_last_cycles;
+#ifdef USE_LOAD_MONITOR
+	struct load_monitor_result load;
+	load_monitor_get(&load);
+	stats->flags |= CHAIN_CMD_STATS_LOAD;
+	stats->load = load.load;
+	stats->peak = load.peak;
+	stats->late_blocks = load.late_blocks;
+	stats->overruns = load.overruns;
+#endif
+#ifdef USE_SIGNAL_STATS
+	struct signal_stats_result r;
+	signal_stats_get(&r);
+	stats->flags |= CHAIN_CMD_STATS_SIGNAL;
+	stats->adc[0] = signal_stats_to_lsb(r.adc.rms);
+	stats->adc[1] = signal_stats_to_lsb(r.adc.min);
+	stats->adc[2] = signal_stats_to_lsb(r.adc.max);
+	stats->adc[3] = signal_stats_to_lsb(r.adc.mean);
+	stats->adc_clips = r.adc.clips;
+	stats->dac[0] = signal_stats_to_lsb(r.dac.rms);
+	stats->dac[1] = signal_stats_to_lsb(r.dac.min);
+	stats->dac[2] = signal_stats_to_lsb(r.dac.max);
+	stats->dac[3] = signal_stats_to_lsb(r.dac.mean);
+	stats->dac_clips = r.dac.clips;
+#endif
+}
+#endif
+
+#if defined(USE_PROFILER) || defined(USE_CHAIN_CMD)
+/**
+ * @brief Debug UART commands: 'p' prints the profiler statistics and 'r'
+ * 		clears them, and the binary frames of chain_cmd.h edit the filter
+ * 		chain. This runs from the main loop.
+ */
+static void dbg_uart_parser(uint8_t *buffer, size_t bufferlen, uint8_t sender)
+{
+	if (!bufferlen)
+		return;
+#ifdef USE_CHAIN_CMD
+	chain_cmd_parse(buffer, bufferlen);
+#endif
+#ifdef USE_PROFILER
+	if (buffer[0] == 'p')
+		/* the cycles of a block */
+		profiler_dump(SystemCoreClock / sample_rate_get() * DSP_BLOCK_SIZE);
+	else if (buffer[0] == 'r')
+		profiler_reset();
+#endif
+}
+#endif
+
 static inline void main_loop(void)
 {
 	/* 1 ms timer */
@@ -68,15 +608,49 @@ static inline void main_loop(void)
 		glb_tmr_1s++;
 		mod_timer_polling(&obj_timer_list);
 	}
+#ifdef USE_CHAIN_CMD
+	chain_cmd_update();
+#endif
+#ifdef USE_TRACE_LOG
+	trace_log_update();
+#endif
+#ifdef USE_SPECTRUM
+	/* The FFT runs here, so it's preempted by the DMA interrupt. The stats
+	 * are not printed, because the text would break the frames. */
+	spectrum_update();
+#elif defined(USE_CAPTURE)
+	/* The same for the capture frames */
+	capture_update();
+#else
 	if (glb_tmr_1s >= 1000) {
 		glb_tmr_1s = 0;
 		if (io.sample_ready) {
+			__disable_irq();
 			uint32_t count = irq_count;
+			uint32_t cycles = irq_cycles;
 			irq_count = 0;
-			printf("%d\n", (int)count);
+			irq_cycles = 0;
+			__enable_irq();
+			/* processed samples per second and filter chain cycles per sample */
+			printf("%d %s %d\n", (int)count, filter_chain_get_precision(),
+					count ? (int)(cycles / count) : 0);
+#ifdef USE_CHAIN_CMD
+			m_last_count = count;
+			m_last_cycles = count ? cycles / count : 0;
+#endif
+#ifdef USE_SIGNAL_STATS
+			print_signal_stats();
+#endif
+#ifdef USE_LOAD_MONITOR
+			print_load();
+#endif
+#ifdef USE_ADC_SCAN
+			print_scan();
+#endif
 			io.sample_ready = 0;
 		}
 	}
+#endif
 }
 
 void led_on(void *data)
@@ -138,12 +712,21 @@ int main(void)
 	initialise_monitor_handles();
 #elif USE_STTERM
 	stlinky_init();
+#elif USE_STTERM_RING
+	stlinky_ring_init();
 #elif USE_DBGUART
 	// setup uart port
 	dev_uart_add(&dbg_uart);
 	// set callback for uart rx
+#if defined(USE_PROFILER) || defined(USE_CHAIN_CMD)
+ 	dbg_uart.fp_dev_uart_cb = dbg_uart_parser;
+#else
  	dbg_uart.fp_dev_uart_cb = NULL;
+#endif
  	mod_timer_add((void*) &dbg_uart, 5, (void*) &dev_uart_update, &obj_timer_list);
+#ifdef USE_TRACE_LOG
+	trace_log_init(&dbg_uart_send_frame);
+#endif
 #endif
 
 	/* Declare LED module and initialize it */
@@ -156,18 +739,76 @@ int main(void)
 	dev_led_add(&def_led);
 	dev_led_set_pattern(&def_led, 0b11001100);
 
+	/* The periods of the boot rate for the clock tree, e.g. with overclocking */
+	if (sample_rate_calc(SAMPLE_RATE, &m_rate) < 0) {
+		TRACE(("Invalid SAMPLE_RATE\n"));
+		while (1);
+	}
+
+#ifdef USE_FILTER_BENCH
+	/* Print the benchmark CSV before the sampling starts */
+	filter_bench_run(m_rate.fs, FILTER_BENCH_REPEATS);
+#endif
+
+	filter_chain_init(m_rate.fs);
+#ifdef USE_FIXED_CHAIN
+	/* The chain of filter_chain_fixed.h with the build time coefficients */
+	filter_chain_load(filter_chain_fixed_params, filter_chain_fixed_coeffs,
+			FILTER_CHAIN_FIXED_NUM_OF_STAGES);
+#else
 	/* Set your filter here: */
-	so_butterworth_lpf_calculate_coeffs(10000, SAMPLE_RATE);
-	so_butterworth_hpf_calculate_coeffs(5000, SAMPLE_RATE);
-	so_butterworth_hpf_set_offset(2048);
-	filter_p[0] = &so_butterworth_hpf_filter;
-	filter_p[1] = &so_butterworth_lpf_filter;
+	filter_chain_add(FILTER_SO_BUTTERWORTH_HPF, 5000, 0, 0);
+	filter_chain_add(FILTER_SO_BUTTERWORTH_LPF, 10000, 0, 0);
+#endif
+	filter_chain_commit();
+
+#ifdef USE_ADC_SCAN
+	/* Set the filters of the other channels of the scan here: */
+	scan_chain_init(m_rate.fs, ADC_SCAN_CHANNELS - 1);
+	for (int i=0; i<ADC_SCAN_CHANNELS - 1; i++)
+		scan_chain_add(i, FILTER_SO_BUTTERWORTH_LPF, 100, 0, 0);
+#endif
+
+#ifdef USE_OVERSAMPLING
+#ifdef USE_OVERSAMPLED_DAC
+	oversampling_init(&m_os, DSP_OVERSAMPLING, 1);
+#else
+	oversampling_init(&m_os, DSP_OVERSAMPLING, 0);
+#endif
+	filter_chain_set_oversampling(&m_os);
+#endif
+
+#ifdef USE_DC_TRACKER
+	/* The offset is measured in the first blocks and then it's tracked */
+	for (int i=0; i<(int) (sizeof(m_dc) / sizeof(m_dc[0])); i++) {
+		dc_tracker_init(&m_dc[i], DC_TRACKER_SHIFT, DC_TRACKER_STARTUP_BLOCKS);
+		filter_chain_set_dc_tracker(i, &m_dc[i]);
+	}
+#endif
+
+#ifdef USE_FFT_CONV
+	for (int i=0; i<(int) (sizeof(m_conv) / sizeof(m_conv[0])); i++) {
+		fft_conv_init(&m_conv[i], DSP_BLOCK_SIZE, fft_conv_ir, FFT_CONV_IR_TAPS);
+		filter_chain_set_conv(i, &m_conv[i]);
+	}
+#endif
+
+	sample_rate_init_modules(m_rate.fs);
+#ifdef USE_CHAIN_CMD
+	chain_cmd_init(&dbg_uart_send, &chain_cmd_get_stats);
+#endif
+#ifdef USE_SPECTRUM
+	mod_timer_add(NULL, SPECTRUM_PUBLISH_MS, (void*) &spectrum_publish, &obj_timer_list);
+#endif
 
-	/* Configure peripherals */
+	/* Configure peripherals. The timers are configured first, so the
+	 * update event of their init doesn't trigger the ADC, and they are
+	 * started last so the ADC and DAC DMA buffers begin at the same index. */
 	TIMER_Config();
 	ADC_Config();
 	DAC_Config();
 	DMA_Config();
+	timers_start();
 
 	TRACE(("Program started\n"));
 
@@ -177,6 +818,20 @@ int main(void)
 	}
 }
 
+#ifdef USE_ADC_SCAN
+static void ADC_Config(void)
+{
+	/* ADC1 converts all the channels on every TIM1 TRGO. The DMA buffer
+	 * and the block interrupt are the same as without the scan, only the
+	 * half buffers have ADC_SCAN_CHANNELS samples per ADC sample. */
+	adc_module_init(io.adc_scan_buffer, 2 * ADC_BLOCK_SIZE, ADC_ExternalTrigConvEvent_9);
+	adc_set_sample_time(m_rate.adc_sample_time);
+	for (int i=0; i<ADC_SCAN_CHANNELS; i++)
+		adc_add_channel(&m_scan_channels[i]);
+	adc_enable_irq(0);
+	adc_start();
+}
+#else
 static void ADC_Config(void)
 {
 	GPIO_InitTypeDef   GPIO_InitStructure;
@@ -193,7 +848,11 @@ static void ADC_Config(void)
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_ADC12, ENABLE);
 
 	/* Configure PC.1 (ADC Channel7) in analog mode */
+#if defined(USE_STEREO) || defined(USE_ADC_INTERLEAVED)
+	GPIO_InitStructure.GPIO_Pin = ADC_PIN | ADC2_PIN;
+#else
 	GPIO_InitStructure.GPIO_Pin = ADC_PIN;
+#endif
 	GPIO_InitStructure.GPIO_Mode  = GPIO_Mode_AN;
 	GPIO_InitStructure.GPIO_PuPd  = GPIO_PuPd_NOPULL;
 	GPIO_Init(ADC_PORT, &GPIO_InitStructure);  
@@ -212,11 +871,28 @@ static void ADC_Config(void)
 	while(ADC_GetCalibrationStatus(ADC1) != RESET );
 	calibration_value = ADC_GetCalibrationValue(ADC1);
 
-	/* Configure the ADC1 in continuous mode */
+#if defined(USE_STEREO) || defined(USE_ADC_INTERLEAVED)
+	ADC_VoltageRegulatorCmd(ADC2, ENABLE);
+	delay_us(10);
+	ADC_SelectCalibrationMode(ADC2, ADC_CalibrationMode_Single);
+	ADC_StartCalibration(ADC2);
+	while(ADC_GetCalibrationStatus(ADC2) != RESET );
+#endif
+
+#ifdef USE_STEREO
+	/* ADC1 is the master and ADC2 converts at the same time. Both results
+	 * are packed in the common data register and read with one DMA word. */
+	ADC_CommonInitStructure.ADC_Mode = ADC_Mode_RegSimul;
+	ADC_CommonInitStructure.ADC_DMAMode = ADC_DMAMode_Circular;
+#else
+	/* Configure the ADC1 in continuous mode. In interleaved mode ADC2 is
+	 * independent too: the dual interleaved mode delays ADC2 by a few ADC
+	 * cycles, not by a sample period, so ADC2 has its own trigger. */
 	ADC_CommonInitStructure.ADC_Mode = ADC_Mode_Independent;
+	ADC_CommonInitStructure.ADC_DMAMode = ADC_DMAMode_OneShot;
+#endif
 	ADC_CommonInitStructure.ADC_Clock = ADC_Clock_SynClkModeDiv1;
 	ADC_CommonInitStructure.ADC_DMAAccessMode = ADC_DMAAccessMode_1;
-	ADC_CommonInitStructure.ADC_DMAMode = ADC_DMAMode_OneShot;
 	ADC_CommonInitStructure.ADC_TwoSamplingDelay = 0;
 
 	ADC_CommonInit(ADC1, &ADC_CommonInitStructure);
@@ -232,7 +908,26 @@ static void ADC_Config(void)
 	ADC_Init(ADC1, &ADC_InitStructure);
 
 	/* ADC1 regular channel7 configuration */
-	ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 1, ADC_SampleTime_181Cycles5);
+	ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 1, m_rate.adc_sample_time);
+
+#ifdef USE_STEREO
+	/* The slave is triggered by the master */
+	ADC_InitStructure.ADC_ExternalTrigEventEdge = ADC_ExternalTrigEventEdge_None;
+	ADC_Init(ADC2, &ADC_InitStructure);
+	ADC_RegularChannelConfig(ADC2, ADC_Channel_3, 1, m_rate.adc_sample_time);
+	ADC_Cmd(ADC2, ENABLE);
+	while(!ADC_GetFlagStatus(ADC2, ADC_FLAG_RDY));
+#elif defined(USE_ADC_INTERLEAVED)
+	/* ADC2 is triggered by TIM1 CC1, one sample period after ADC1 */
+	ADC_InitStructure.ADC_ExternalTrigConvEvent = ADC_ExternalTrigConvEvent_0;
+	ADC_Init(ADC2, &ADC_InitStructure);
+	ADC_RegularChannelConfig(ADC2, ADC_Channel_3, 1, m_rate.adc_sample_time);
+	ADC_Cmd(ADC2, ENABLE);
+	while(!ADC_GetFlagStatus(ADC2, ADC_FLAG_RDY));
+	ADC_DMACmd(ADC2, ENABLE);
+	ADC_DMAConfig(ADC2, ADC_DMAMode_Circular);
+	ADC_StartConversion(ADC2);
+#endif
 
 	/* Enable ADC1 */
 	ADC_Cmd(ADC1, ENABLE);
@@ -240,23 +935,29 @@ static void ADC_Config(void)
 	/* wait for ADRDY */
 	while(!ADC_GetFlagStatus(ADC1, ADC_FLAG_RDY));
 
-	/* ADC1 DMA Enable */
+#ifndef USE_STEREO
+	/* ADC1 DMA Enable. In dual mode the DMA is set by the common config */
 	ADC_DMACmd(ADC1, ENABLE);
 	ADC_DMAConfig(ADC1, ADC_DMAMode_Circular);
+#endif
 
 	/* Start ADC1 Software Conversion */ 
 	ADC_StartConversion(ADC1);
 }
+#endif
 
 static void TIMER_Config() 
 {
     TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure;
+#ifdef USE_ADC_INTERLEAVED
+	TIM_OCInitTypeDef TIM_OCInitStructure;
+#endif
 
 	RCC_HRTIM1CLKConfig(RCC_HRTIM1CLK_PLLCLK);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_TIM1, ENABLE);
 
     TIM_TimeBaseStructInit(&TIM_TimeBaseInitStructure);
-    TIM_TimeBaseInitStructure.TIM_Period = (72000000 / SAMPLE_RATE) - 1;
+    TIM_TimeBaseInitStructure.TIM_Period = m_rate.adc_period * ADC_INTERLEAVE - 1;
     TIM_TimeBaseInitStructure.TIM_Prescaler = 0;
     TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
     TIM_TimeBaseInitStructure.TIM_ClockDivision = 0;
@@ -264,36 +965,98 @@ static void TIMER_Config()
 
 	TIM_SelectOutputTrigger(TIM1, TIM_TRGOSource_Update); // ADC_ExternalTrigConv_T2_TRGO
 
-    TIM_Cmd(TIM1, ENABLE); 
+#ifdef USE_ADC_INTERLEAVED
+	/* CC1 triggers ADC2 in the middle of the TIM1 period. The CC1 event of
+	 * the advanced timer needs the main output, but the pin is not mapped. */
+	TIM_OCStructInit(&TIM_OCInitStructure);
+	TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM2;
+	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
+	TIM_OCInitStructure.TIM_Pulse = m_rate.adc_period;
+	TIM_OC1Init(TIM1, &TIM_OCInitStructure);
+	TIM_CtrlPWMOutputs(TIM1, ENABLE);
+#endif
+
+	/* TIM2 paces the DAC DMA, because the DAC can't be triggered by TIM1.
+	 * It has the same period as TIM1, unless only the ADC is oversampled.
+	 * TIM2 is a slave of TIM1 (ITR0 is TIM1 TRGO) in trigger mode, so it
+	 * starts on the first ADC trigger and the DAC triggers have a fixed
+	 * phase of one DAC period after the ADC triggers. */
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2, ENABLE);
+	TIM_TimeBaseInitStructure.TIM_Period = m_rate.dac_period - 1;
+	TIM_TimeBaseInit(TIM2,&TIM_TimeBaseInitStructure);
+	TIM_SelectOutputTrigger(TIM2, TIM_TRGOSource_Update);
+	TIM_SelectInputTrigger(TIM2, TIM_TS_ITR0);
+	TIM_SelectSlaveMode(TIM2, TIM_SlaveMode_Trigger);
+}
+
+/**
+ * @brief Start TIM1 one tick before its update, so the first trigger is the
+ * 		update that converts ADC1 and starts TIM2. In interleaved mode CC1
+ * 		comes half a period later, so ADC2 always converts the second sample
+ * 		of a pair, after the boot and after a sample_rate_set().
+ */
+static void timers_start(void)
+{
+	TIM_SetCounter(TIM2, 0);
+	TIM_SetCounter(TIM1, TIM1->ARR);
+	TIM_Cmd(TIM1, ENABLE);
 }
 
 static void DMA_Config(void)
 {
 	DMA_InitTypeDef  DMA_InitStructure;
+#ifndef USE_ADC_SCAN
   	NVIC_InitTypeDef NVIC_InitStructure;
+#endif
 
 	/* Enable DMA1 clock */
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 
-	DMA_DeInit(DMA1_Channel1);
+#ifdef USE_STEREO
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)ADC12_CDR_ADDRESS;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+#else
 	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)ADC1_DR_ADDRESS;
-	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)&io.adc_sample;
-	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
-	DMA_InitStructure.DMA_BufferSize = 1;
-	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
-	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Disable;
 	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
 	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+#endif
+#ifdef USE_ADC_INTERLEAVED
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)io.adc1_buffer;
+#else
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)io.adc_buffer;
+#endif
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = 2 * ADC_DMA_BLOCK_SIZE;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
 	DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
 	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
 	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+#ifndef USE_ADC_SCAN
+	/* With USE_ADC_SCAN the channel and its interrupt are set by dev_adc */
+	DMA_DeInit(DMA1_Channel1);
 	DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+#endif
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
+
+#ifdef USE_ADC_INTERLEAVED
+	/* ADC2 converts the odd samples. DMA2 Channel1 is the default ADC2 request. */
+	DMA_DeInit(DMA2_Channel1);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)ADC2_DR_ADDRESS;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)io.adc2_buffer;
+	DMA_Init(DMA2_Channel1, &DMA_InitStructure);
+	DMA_Cmd(DMA2_Channel1, ENABLE);
+#endif
 
-	/* Enable DMA1 Channel1 Transfer Complete interrupt */
-	DMA_ITConfig(DMA1_Channel1, DMA_IT_TC, ENABLE);
+#ifndef USE_ADC_SCAN
+	/* Enable the Half Transfer and Transfer Complete interrupts of the
+	 * channel that ends the blocks */
+	DMA_ITConfig(BLOCK_DMA, DMA_IT_HT | DMA_IT_TC, ENABLE);
 
-	/* Enable DMA1 channel1 IRQ Channel */
-	NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel1_IRQn;
+	/* Enable the block DMA IRQ Channel */
+	NVIC_InitStructure.NVIC_IRQChannel = BLOCK_DMA_IRQn;
 	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
 	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
 	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
@@ -301,6 +1064,88 @@ static void DMA_Config(void)
 
 	/* Enable DMA1 Channel1 transfer */
 	DMA_Cmd(DMA1_Channel1, ENABLE);
+#endif
+
+	/* DAC1 channel1 output block. DMA2 Channel3 is the default DAC1_CH1 request.
+	 * In stereo mode a single word store to DHR12RD updates both channels */
+	DMA_DeInit(DMA2_Channel3);
+#ifdef USE_STEREO
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)DAC_DHR12RD_Address;
+#else
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)DAC_DHR12R1_Address;
+#endif
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)io.dac_buffer;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_BufferSize = 2 * DAC_BLOCK_SIZE;
+	DMA_Init(DMA2_Channel3, &DMA_InitStructure);
+	DMA_Cmd(DMA2_Channel3, ENABLE);
+
+	DAC_DMACmd(DAC1, DAC_Channel_1, ENABLE);
+}
+
+/**
+ * @brief Stop the timers, the ADC and the DMA channels. The interrupt of a
+ * 		half buffer that is already pending is dropped.
+ */
+static void sampling_stop(void)
+{
+	TIM_Cmd(TIM1, DISABLE);
+	TIM_Cmd(TIM2, DISABLE);
+
+#ifdef USE_ADC_SCAN
+	adc_stop();
+#else
+	ADC_StopConversion(ADC1);
+	while (ADC_GetStartConversionStatus(ADC1) != RESET);
+	/* a conversion that ended after the stop is not read by the DMA */
+	ADC_ClearFlag(ADC1, ADC_FLAG_EOC | ADC_FLAG_OVR);
+	DMA_Cmd(DMA1_Channel1, DISABLE);
+#endif
+#ifdef USE_ADC_INTERLEAVED
+	ADC_StopConversion(ADC2);
+	while (ADC_GetStartConversionStatus(ADC2) != RESET);
+	ADC_ClearFlag(ADC2, ADC_FLAG_EOC | ADC_FLAG_OVR);
+	DMA_Cmd(DMA2_Channel1, DISABLE);
+#endif
+
+	DAC_DMACmd(DAC1, DAC_Channel_1, DISABLE);
+	DMA_Cmd(DMA2_Channel3, DISABLE);
+	DMA_ClearITPendingBit(BLOCK_DMA_IT_GL);
+	NVIC_ClearPendingIRQ(BLOCK_DMA_IRQn);
+}
+
+/**
+ * @brief Start the sampling from the start of the DMA buffers, with a
+ * 		silent DAC buffer. Like in main() the timers are started last, so
+ * 		the ADC and DAC buffers begin at the same index.
+ */
+static void sampling_start(void)
+{
+	for (int i=0; i<(int) (sizeof(io.dac_buffer) / sizeof(io.dac_buffer[0])); i++)
+#ifdef USE_STEREO
+		io.dac_buffer[i] = ADC_MID_SCALE | (ADC_MID_SCALE << 16);
+#else
+		io.dac_buffer[i] = ADC_MID_SCALE;
+#endif
+
+	DMA_SetCurrDataCounter(DMA2_Channel3, 2 * DAC_BLOCK_SIZE);
+	DMA_Cmd(DMA2_Channel3, ENABLE);
+	DAC_DMACmd(DAC1, DAC_Channel_1, ENABLE);
+#ifdef USE_ADC_INTERLEAVED
+	DMA_SetCurrDataCounter(DMA2_Channel1, 2 * ADC_DMA_BLOCK_SIZE);
+	DMA_Cmd(DMA2_Channel1, ENABLE);
+	ADC_StartConversion(ADC2);
+#endif
+
+#ifdef USE_ADC_SCAN
+	adc_start();
+#else
+	DMA_SetCurrDataCounter(DMA1_Channel1, 2 * ADC_DMA_BLOCK_SIZE);
+	DMA_Cmd(DMA1_Channel1, ENABLE);
+	ADC_StartConversion(ADC1);
+#endif
+
+	timers_start();
 }
 
 static void DAC_Config(void)
@@ -312,7 +1157,11 @@ static void DAC_Config(void)
 	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_GPIOA, ENABLE);
 
 	/* Configure PA.04 (DAC1_OUT1), PA.05 (DAC1_OUT2) as analog */
+#ifdef USE_STEREO
+	GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_4 | GPIO_Pin_5;
+#else
 	GPIO_InitStructure.GPIO_Pin =  GPIO_Pin_4;
+#endif
 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
 	GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
 	GPIO_Init(GPIOA, &GPIO_InitStructure);
@@ -324,7 +1173,7 @@ static void DAC_Config(void)
 	DAC_StructInit(&DAC_InitStructure);
 
 	/* Fill DAC InitStructure */
-	DAC_InitStructure.DAC_Trigger = DAC_Trigger_None;
+	DAC_InitStructure.DAC_Trigger = DAC_Trigger_T2_TRGO;
 	DAC_InitStructure.DAC_WaveGeneration = DAC_WaveGeneration_None;
 	DAC_InitStructure.DAC_LFSRUnmask_TriangleAmplitude = DAC_LFSRUnmask_Bits2_0;  
 	DAC_InitStructure.DAC_Buffer_Switch = DAC_BufferSwitch_Disable;
@@ -335,23 +1184,163 @@ static void DAC_Config(void)
 	/* Enable DAC Channel1: Once the DAC channel1 is enabled, PA.04 is 
 	automatically connected to the DAC converter. */
 	DAC_Cmd(DAC1, DAC_Channel_1, ENABLE);
+
+#ifdef USE_STEREO
+	/* DAC channel2 uses the same trigger, so both outputs update together */
+	DAC_Init(DAC1, DAC_Channel_2, &DAC_InitStructure);
+	DAC_Cmd(DAC1, DAC_Channel_2, ENABLE);
+#endif
+}
+
+#ifdef USE_LOAD_MONITOR
+/**
+ * @brief Check if a block was finished too late. The ADC and the DAC DMA
+ * 		run at the same index, so while the interrupt processes a half,
+ * 		the DMA must be in the other half. If it's back in this half, or
+ * 		it has already finished this half again, the DAC has played samples
+ * 		that were not ready and ADC samples were lost.
+ */
+static inline uint8_t block_late(uint8_t half)
+{
+	uint32_t pos = 2 * ADC_DMA_BLOCK_SIZE - DMA_GetCurrDataCounter(BLOCK_DMA);
+
+	if (pos / ADC_DMA_BLOCK_SIZE == half)
+		return 1;
+	return DMA_GetFlagStatus(half ? BLOCK_DMA_FLAG_TC : BLOCK_DMA_FLAG_HT) != RESET;
+}
+
+/**
+ * @brief Get and clear the ADC overrun flags. An overrun means that the DMA
+ * 		didn't read a conversion before the next one.
+ */
+static inline uint8_t adc_overruns(void)
+{
+	uint8_t overruns = 0;
+
+	if (ADC_GetFlagStatus(ADC1, ADC_FLAG_OVR)) {
+		ADC_ClearFlag(ADC1, ADC_FLAG_OVR);
+		overruns++;
+	}
+#if defined(USE_STEREO) || defined(USE_ADC_INTERLEAVED)
+	if (ADC_GetFlagStatus(ADC2, ADC_FLAG_OVR)) {
+		ADC_ClearFlag(ADC2, ADC_FLAG_OVR);
+		overruns++;
+	}
+#endif
+	return overruns;
+}
+#endif
+
+#ifdef USE_ADC_INTERLEAVED
+/**
+ * @brief Merge the even samples of ADC1 and the odd samples of ADC2 of a
+ * 		half buffer in the ADC buffer
+ */
+static inline void adc_interleave(uint8_t half)
+{
+	const uint16_t * even = &io.adc1_buffer[half * ADC_DMA_BLOCK_SIZE];
+	const uint16_t * odd = &io.adc2_buffer[half * ADC_DMA_BLOCK_SIZE];
+	uint16_t * dst = &io.adc_buffer[half * ADC_BLOCK_SIZE];
+
+	for (int i=0; i<ADC_DMA_BLOCK_SIZE; i++) {
+		*dst++ = even[i];
+		*dst++ = odd[i];
+	}
+}
+#endif
+
+#ifdef USE_ADC_SCAN
+/**
+ * @brief Copy the first channel of the scans of a half buffer to the ADC
+ * 		buffer
+ */
+static inline void adc_scan_split(uint8_t half)
+{
+	const uint16_t * src = &io.adc_scan_buffer[half * ADC_DMA_BLOCK_SIZE];
+	uint16_t * dst = &io.adc_buffer[half * ADC_BLOCK_SIZE];
+
+	for (int i=0; i<ADC_BLOCK_SIZE; i++)
+		dst[i] = src[i * ADC_SCAN_CHANNELS];
+}
+#endif
+
+static inline void process_block(uint8_t half)
+{
+	PROFILER_START(t_irq);
+	/* DWT->CYCCNT is enabled by delay_init() */
+	uint32_t start = DWT->CYCCNT;
+#ifdef USE_ADC_INTERLEAVED
+	adc_interleave(half);
+#elif defined(USE_ADC_SCAN)
+	adc_scan_split(half);
+#endif
+#ifdef USE_STEREO
+	filter_chain_process_stereo(&io.adc_buffer[half * ADC_BLOCK_SIZE],
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DSP_BLOCK_SIZE);
+#else
+	filter_chain_process(&io.adc_buffer[half * ADC_BLOCK_SIZE],
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DSP_BLOCK_SIZE);
+#endif
+	irq_cycles += DWT->CYCCNT - start;
+#ifdef USE_ADC_SCAN
+	/* the other channels after the audio path */
+	PROFILER_START(t_scan);
+	scan_chain_process(&io.adc_scan_buffer[half * ADC_DMA_BLOCK_SIZE + 1], ADC_BLOCK_SIZE,
+			ADC_SCAN_CHANNELS);
+	PROFILER_MARK(PROFILER_SCAN, t_scan);
+#endif
+#if defined(USE_SPECTRUM) || defined(USE_SIGNAL_STATS) || defined(USE_CAPTURE)
+	PROFILER_START(t);
+#endif
+#ifdef USE_SPECTRUM
+	/* Only a copy of the output in the interrupt, outside of the measured cycles */
+#ifdef USE_STEREO
+	spectrum_capture((uint16_t *) &io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 2);
+#else
+	spectrum_capture(&io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 1);
+#endif
+#endif
+#ifdef USE_SIGNAL_STATS
+#ifdef USE_STEREO
+	signal_stats_process((uint16_t *) &io.adc_buffer[half * ADC_BLOCK_SIZE], ADC_BLOCK_SIZE,
+			(uint16_t *) &io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 2);
+#else
+	signal_stats_process(&io.adc_buffer[half * ADC_BLOCK_SIZE], ADC_BLOCK_SIZE,
+			&io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE, 1);
+#endif
+#endif
+#ifdef USE_CAPTURE
+	/* the stereo buffers are the interleaved channels */
+	capture_process(CAPTURE_ADC, (uint16_t *) &io.adc_buffer[half * ADC_BLOCK_SIZE], ADC_BLOCK_SIZE);
+	capture_process(CAPTURE_DAC, (uint16_t *) &io.dac_buffer[half * DAC_BLOCK_SIZE], DAC_BLOCK_SIZE);
+#endif
+#if defined(USE_SPECTRUM) || defined(USE_SIGNAL_STATS) || defined(USE_CAPTURE)
+	PROFILER_MARK(PROFILER_MONITOR, t);
+#endif
+	io.sample_ready = 1;
+	irq_count += DSP_BLOCK_SIZE;
+#ifdef USE_LOAD_MONITOR
+	load_monitor_block(DWT->CYCCNT - start, block_late(half), adc_overruns());
+#endif
+	PROFILER_MARK(PROFILER_IRQ, t_irq);
 }
 
+#ifdef USE_ADC_INTERLEAVED
+void DMA2_Channel1_IRQHandler(void)
+#else
 void DMA1_Channel1_IRQHandler(void)
+#endif
 {
-	/* Test on DMA1 Channel1 Transfer Complete interrupt */
-	if(DMA_GetITStatus(DMA1_IT_TC1))
+	/* First half of the buffer is filled, the DMA now writes the second half */
+	if(DMA_GetITStatus(BLOCK_DMA_IT_HT))
 	{
-		io.sample_ready = 1;
-		io.dac_sample = io.adc_sample;
-		for (int i=0; i<NUM_OF_FILTERS; i++) {
-			if (filter_p[i])
-				io.dac_sample = filter_p[i](io.dac_sample);
-		}
-    	DAC_SetChannel1Data(DAC1, DAC_Align_12b_R, io.dac_sample);
-		irq_count++;
-
-		/* Clear DMA1 Channel1 Half Transfer, Transfer Complete and Global interrupt pending bits */
-		DMA_ClearITPendingBit(DMA1_IT_TC1);
+		DMA_ClearITPendingBit(BLOCK_DMA_IT_HT);
+		process_block(0);
+	}
+	/* Second half is filled, the DMA wrapped around to the first half */
+	if(DMA_GetITStatus(BLOCK_DMA_IT_TC))
+	{
+		DMA_ClearITPendingBit(BLOCK_DMA_IT_TC);
+		process_block(1);
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,141 @@
+/*
+ * oversampling.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include <math.h>
+#include "oversampling.h"
+#include "filter_chain.h"
+
+#ifdef USE_FPU
+#define ADC_TO_F32 (1.0f / ADC_MID_SCALE)
+#else
+/* 12-bit to Q15 */
+#define ADC_Q15_SHIFT 4
+#endif
+
+/**
+ * @brief Prepare the decimation and interpolation filters
+ * @param[in] os The oversampling instance
+ * @param[in] factor The oversampling factor M
+ * @param[in] interpolate Also interpolate the output by M for the DAC
+ * @return 0 on success or -1 on invalid factor
+ */
+int oversampling_init(struct oversampling * os, uint8_t factor, uint8_t interpolate)
+{
+	uint16_t num_taps = OVERSAMPLING_TAPS_PER_PHASE * factor;
+	float32_t h[OVERSAMPLING_MAX_TAPS];
+	float32_t sum = 0;
+
+	if (factor < 2 || factor > OVERSAMPLING_MAX_FACTOR)
+		return -1;
+	memset(os, 0, sizeof(*os));
+	os->factor = factor;
+	os->interpolate = interpolate;
+
+	/* Blackman windowed-sinc with the -6dB point at half the base rate */
+	for (int i=0; i<num_taps; i++) {
+		float32_t x = PI * ((float32_t) i - (num_taps - 1) * 0.5f) / factor;
+		float32_t t = 2.0f * PI * i / (num_taps - 1);
+
+		h[i] = (x == 0) ? 1.0f : sinf(x) / x;
+		h[i] *= 0.42f - 0.5f * cosf(t) + 0.08f * cosf(2.0f * t);
+		sum += h[i];
+	}
+	for (int i=0; i<num_taps; i++) {
+		float32_t dec = h[i] / sum;
+		float32_t interp = dec * factor;
+#ifdef USE_FPU
+		os->dec_coeffs[i] = dec;
+		os->interp_coeffs[i] = interp;
+#else
+		arm_float_to_q15(&dec, &os->dec_coeffs[i], 1);
+		arm_float_to_q15(&interp, &os->interp_coeffs[i], 1);
+#endif
+	}
+
+#ifdef USE_FPU
+	arm_fir_decimate_init_f32(&os->dec, num_taps, factor, os->dec_coeffs,
+			os->dec_state, factor * DSP_BLOCK_SIZE);
+	arm_fir_interpolate_init_f32(&os->interp, factor, num_taps, os->interp_coeffs,
+			os->interp_state, DSP_BLOCK_SIZE);
+#else
+	arm_fir_decimate_init_q15(&os->dec, num_taps, factor, os->dec_coeffs,
+			os->dec_state, factor * DSP_BLOCK_SIZE);
+	arm_fir_interpolate_init_q15(&os->interp, factor, num_taps, os->interp_coeffs,
+			os->interp_state, DSP_BLOCK_SIZE);
+#endif
+	return 0;
+}
+
+/**
+ * @brief Decimate a block of high rate ADC samples to os->base
+ * @param[in] os The oversampling instance
+ * @param[in] src len * M 12-bit ADC samples
+ * @param[in] len Number of base rate samples, up to DSP_BLOCK_SIZE
+ * @param[in] offset The ADC offset in 12-bit steps, Q16
+ */
+void oversampling_decimate(struct oversampling * os, const uint16_t * src, size_t len,
+		int32_t offset)
+{
+	size_t n = len * os->factor;
+
+	for (size_t i=0; i<n; i++) {
+		int32_t x = ((int32_t) src[i] << 16) - offset;
+#ifdef USE_FPU
+		os->buf[i] = (float32_t) x * (ADC_TO_F32 / 65536);
+#else
+		x = (x + (1 << (15 - ADC_Q15_SHIFT))) >> (16 - ADC_Q15_SHIFT);
+#ifdef USE_DC_TRACKER
+		/* with any other offset than the mid-scale the range is more than 12 bits */
+		if (x > INT16_MAX) x = INT16_MAX;
+		else if (x < INT16_MIN) x = INT16_MIN;
+#endif
+		os->buf[i] = (q15_t) x;
+#endif
+	}
+#ifdef USE_FPU
+	arm_fir_decimate_f32(&os->dec, os->buf, os->base, n);
+#else
+	arm_fir_decimate_fast_q15(&os->dec, os->buf, os->base, n);
+#endif
+}
+
+/**
+ * @brief Convert a sample to a clamped 12-bit DAC sample
+ */
+static inline uint16_t oversampling_to_dac(oversampling_sample_t x)
+{
+#ifdef USE_FPU
+	int32_t y = (int32_t) (x * ADC_MID_SCALE) + ADC_MID_SCALE;
+#else
+	int32_t y = ((((int32_t) x >> (ADC_Q15_SHIFT - 1)) + 1) >> 1) + ADC_MID_SCALE;
+#endif
+	if (y < 0) y = 0;
+	else if (y > DAC_MAX_VALUE) y = DAC_MAX_VALUE;
+	return (uint16_t) y;
+}
+
+/**
+ * @brief Write os->base to the DAC buffer, interpolated by M if enabled
+ * @param[in] os The oversampling instance
+ * @param[out] dst len * M, or len without the interpolation, 12-bit samples
+ * @param[in] len Number of base rate samples, up to DSP_BLOCK_SIZE
+ */
+void oversampling_interpolate(struct oversampling * os, uint16_t * dst, size_t len)
+{
+	if (!os->interpolate) {
+		for (size_t i=0; i<len; i++)
+			dst[i] = oversampling_to_dac(os->base[i]);
+		return;
+	}
+
+#ifdef USE_FPU
+	arm_fir_interpolate_f32(&os->interp, os->base, os->buf, len);
+#else
+	arm_fir_interpolate_q15(&os->interp, os->base, os->buf, len);
+#endif
+	for (size_t i=0; i<len * os->factor; i++)
+		dst[i] = oversampling_to_dac(os->buf[i]);
+}
@@ -0,0 +1,77 @@
+/*
+ * profiler.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <stdio.h>
+#include <string.h>
+#include "profiler.h"
+
+static const char * const profiler_names[PROFILER_NUM_OF_POINTS] = {
+	"irq", "input", "biquads", "conv", "output", "monitor", "scan"
+};
+
+static struct profiler_stats m_profiler[PROFILER_NUM_OF_POINTS];
+
+/**
+ * @brief Add the time of a section. This is called from the interrupt.
+ */
+void profiler_add(enum profiler_point point, uint32_t ticks)
+{
+	struct profiler_stats * stats = &m_profiler[point];
+	uint32_t bucket = ticks ? 32 - __builtin_clz(ticks) : 0;
+
+	if (bucket >= PROFILER_NUM_OF_BUCKETS)
+		bucket = PROFILER_NUM_OF_BUCKETS - 1;
+	stats->buckets[bucket]++;
+	if (!stats->count || ticks < stats->min)
+		stats->min = ticks;
+	if (ticks > stats->max)
+		stats->max = ticks;
+	stats->sum += ticks;
+	stats->count++;
+}
+
+/**
+ * @brief Clear the statistics of all sections
+ */
+void profiler_reset(void)
+{
+	__disable_irq();
+	memset(m_profiler, 0, sizeof(m_profiler));
+	__enable_irq();
+}
+
+/**
+ * @brief Get a copy of the statistics of a section. This is called from
+ * 		the main loop.
+ */
+void profiler_get(enum profiler_point point, struct profiler_stats * stats)
+{
+	__disable_irq();
+	memcpy(stats, &m_profiler[point], sizeof(*stats));
+	__enable_irq();
+}
+
+/**
+ * @brief Print the statistics of the sections that were executed, one
+ * 		line per section:
+ * 		prof <name> <count> <min> <max> <mean> <bucket 0> ... <bucket 19>
+ * @param[in] budget The time of a block, to compare with the irq line
+ */
+void profiler_dump(uint32_t budget)
+{
+	struct profiler_stats stats;
+
+	printf("prof budget %d\n", (int) budget);
+	for (int i=0; i<PROFILER_NUM_OF_POINTS; i++) {
+		profiler_get(i, &stats);
+		if (!stats.count)
+			continue;
+		printf("prof %s %d %d %d %d", profiler_names[i], (int) stats.count,
+				(int) stats.min, (int) stats.max, (int) (stats.sum / stats.count));
+		for (int k=0; k<PROFILER_NUM_OF_BUCKETS; k++)
+			printf(" %d", (int) stats.buckets[k]);
+		printf("\n");
+	}
+}
@@ -0,0 +1,241 @@
+/*
+ * scan_chain.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include "scan_chain.h"
+#include "filter_chain.h"
+
+#ifdef USE_FPU
+#define ADC_TO_F32 (1.0f / ADC_MID_SCALE)
+typedef float32_t scan_sample_t;
+#else
+/* 12-bit to Q31 */
+#define ADC_Q_SHIFT 20
+typedef q31_t scan_sample_t;
+#endif
+
+static struct scan_chain m_scan;
+/* the samples of every channel are contiguous */
+static scan_sample_t m_work[SCAN_CHAIN_MAX_CHANNELS * DSP_BLOCK_SIZE];
+
+/**
+ * @brief Design the stages of a channel at a sample rate
+ * @return 0 on success or -1 if a stage is not valid at fs
+ */
+static int scan_chain_design(uint8_t channel, uint32_t fs, float32_t * coeffs)
+{
+	for (int i=0; i<m_scan.num_of_stages[channel]; i++)
+		if (biquad_design(&m_scan.stages[channel][i], fs, &coeffs[i * BIQUAD_NUM_COEFFS]) < 0)
+			return -1;
+	return 0;
+}
+
+/**
+ * @brief Load the designed coefficients of a channel in its cascade and
+ * 		clear the state
+ */
+static void scan_chain_load(uint8_t channel, const float32_t * coeffs)
+{
+	struct scan_chain_channel * ch = &m_scan.channels[channel];
+	uint8_t num_of_stages = m_scan.num_of_stages[channel];
+	uint32_t n = num_of_stages * BIQUAD_NUM_COEFFS;
+
+#ifdef USE_FPU
+	if (n)
+		memcpy(ch->coeffs, coeffs, n * sizeof(float32_t));
+	arm_biquad_cascade_df2T_init_f32(&ch->inst, num_of_stages, ch->coeffs, ch->state);
+#else
+	float32_t max = 0;
+	uint8_t shift = 0;
+
+	/* the post-shift brings all the coefficients in the [-1, 1) range */
+	for (uint32_t i=0; i<n; i++) {
+		float32_t c = coeffs[i] < 0 ? -coeffs[i] : coeffs[i];
+		if (c > max) max = c;
+	}
+	while (max >= (float32_t) (1 << shift))
+		shift++;
+	for (uint32_t i=0; i<n; i++) {
+		float32_t c = coeffs[i] / (float32_t) (1 << shift);
+		arm_float_to_q31(&c, &ch->coeffs[i], 1);
+	}
+	arm_biquad_cascade_df1_init_q31(&ch->inst, num_of_stages, ch->coeffs, ch->state, shift);
+#endif
+}
+
+/**
+ * @brief Initialize the channels without any stages. Their output is the
+ * 		input. Don't call it while the interrupt is running.
+ * @param[in] fs The sample rate that is used for the coefficients
+ * @param[in] num_of_channels Number of channels, up to SCAN_CHAIN_MAX_CHANNELS
+ */
+void scan_chain_init(uint32_t fs, uint8_t num_of_channels)
+{
+	memset(&m_scan, 0, sizeof(m_scan));
+	m_scan.fs = fs;
+	m_scan.num_of_channels = (num_of_channels > SCAN_CHAIN_MAX_CHANNELS) ?
+			SCAN_CHAIN_MAX_CHANNELS : num_of_channels;
+	for (int i=0; i<m_scan.num_of_channels; i++) {
+		scan_chain_load(i, NULL);
+		m_scan.channels[i].value = ADC_MID_SCALE;
+	}
+}
+
+/**
+ * @brief Add a stage at the end of the cascade of a channel. Call it while
+ * 		the sampling is stopped.
+ * @param[in] channel The channel, 0 is the second channel of the scan
+ * @param[in] type The filter type
+ * @param[in] fc The corner or center frequency in Hz
+ * @param[in] q The quality factor
+ * @param[in] gain_db The gain of the shelving and parametric filters
+ * @return 0 on success or -1 on invalid channel or parameters, or if the
+ * 		cascade is full
+ */
+int scan_chain_add(uint8_t channel, enum biquad_type type, float fc, float q, float gain_db)
+{
+	float32_t coeffs[BIQUAD_NUM_COEFFS * SCAN_CHAIN_MAX_STAGES];
+
+	if (channel >= m_scan.num_of_channels ||
+			m_scan.num_of_stages[channel] >= SCAN_CHAIN_MAX_STAGES)
+		return -1;
+
+	struct biquad_params * p = &m_scan.stages[channel][m_scan.num_of_stages[channel]];
+	p->type = type;
+	p->fc = fc;
+	p->q = q;
+	p->gain_db = gain_db;
+
+	m_scan.num_of_stages[channel]++;
+	if (scan_chain_design(channel, m_scan.fs, coeffs) < 0) {
+		m_scan.num_of_stages[channel]--;
+		return -1;
+	}
+	scan_chain_load(channel, coeffs);
+	return 0;
+}
+
+/**
+ * @brief Remove all the stages of a channel. Call it while the sampling is
+ * 		stopped.
+ * @param[in] channel The channel
+ * @return 0 on success or -1 on invalid channel
+ */
+int scan_chain_clear(uint8_t channel)
+{
+	if (channel >= m_scan.num_of_channels)
+		return -1;
+	m_scan.num_of_stages[channel] = 0;
+	scan_chain_load(channel, NULL);
+	return 0;
+}
+
+/**
+ * @brief Redesign the stages of all the channels for another sample rate.
+ * 		The filter state is cleared. Call it while the sampling is stopped.
+ * @param[in] fs The new sample rate
+ * @return 0 on success or -1 if a stage is not valid at the new rate. Then
+ * 		no channel is changed.
+ */
+int scan_chain_set_fs(uint32_t fs)
+{
+	float32_t coeffs[BIQUAD_NUM_COEFFS * SCAN_CHAIN_MAX_STAGES];
+
+	for (int i=0; i<m_scan.num_of_channels; i++)
+		if (scan_chain_design(i, fs, coeffs) < 0)
+			return -1;
+	for (int i=0; i<m_scan.num_of_channels; i++) {
+		scan_chain_design(i, fs, coeffs);
+		scan_chain_load(i, coeffs);
+	}
+	m_scan.fs = fs;
+	return 0;
+}
+
+/**
+ * @brief Convert a 12-bit ADC sample to the cascade format
+ */
+static inline scan_sample_t scan_chain_from_adc(uint16_t x)
+{
+#ifdef USE_FPU
+	return (float32_t) ((int32_t) x - ADC_MID_SCALE) * ADC_TO_F32;
+#else
+	return (q31_t) (((int32_t) x - ADC_MID_SCALE) * (1 << ADC_Q_SHIFT));
+#endif
+}
+
+/**
+ * @brief Convert a cascade sample to a clamped 12-bit value
+ */
+static inline uint16_t scan_chain_to_adc(scan_sample_t x)
+{
+#ifdef USE_FPU
+	int32_t y = (int32_t) (x * ADC_MID_SCALE) + ADC_MID_SCALE;
+#else
+	int32_t y = ((((int32_t) x >> (ADC_Q_SHIFT - 1)) + 1) >> 1) + ADC_MID_SCALE;
+#endif
+	if (y < 0) y = 0;
+	else if (y > DAC_MAX_VALUE) y = DAC_MAX_VALUE;
+	return (uint16_t) y;
+}
+
+/**
+ * @brief Run a block of scans through the cascades. This is called from
+ * 		the interrupt.
+ * @param[in] src The sample of the first channel in the first scan
+ * @param[in] len Number of scans
+ * @param[in] stride The distance of two scans in the buffer, the number of
+ * 		the channels of the whole scan
+ */
+void scan_chain_process(const uint16_t * src, size_t len, size_t stride)
+{
+	uint8_t num_of_channels = m_scan.num_of_channels;
+
+	while (len) {
+		size_t n = (len > DSP_BLOCK_SIZE) ? DSP_BLOCK_SIZE : len;
+
+		/* the buffer is read in order and every channel is written to its own run */
+		for (size_t i=0; i<n; i++) {
+			const uint16_t * scan = &src[i * stride];
+			for (int c=0; c<num_of_channels; c++)
+				m_work[c * DSP_BLOCK_SIZE + i] = scan_chain_from_adc(scan[c]);
+		}
+
+		for (int c=0; c<num_of_channels; c++) {
+			struct scan_chain_channel * ch = &m_scan.channels[c];
+			scan_sample_t * buf = &m_work[c * DSP_BLOCK_SIZE];
+
+			if (ch->inst.numStages) {
+#ifdef USE_FPU
+				arm_biquad_cascade_df2T_f32(&ch->inst, buf, buf, n);
+#else
+				arm_biquad_cascade_df1_q31(&ch->inst, buf, buf, n);
+#endif
+			}
+			ch->value = scan_chain_to_adc(buf[n - 1]);
+		}
+		src += n * stride;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Get the last output sample of a channel in 12-bit steps
+ * @param[in] channel The channel, 0 is the second channel of the scan
+ */
+uint16_t scan_chain_get(uint8_t channel)
+{
+	if (channel >= m_scan.num_of_channels)
+		return 0;
+	return m_scan.channels[channel].value;
+}
+
+/**
+ * @brief Get the number of the channels
+ */
+uint8_t scan_chain_get_num_of_channels(void)
+{
+	return m_scan.num_of_channels;
+}
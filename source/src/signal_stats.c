@@ -0,0 +1,208 @@
+/*
+ * signal_stats.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include <math.h>
+#include "signal_stats.h"
+#include "filter_chain.h"
+
+#ifdef USE_FPU
+#define ADC_TO_F32 (1.0f / ADC_MID_SCALE)
+#else
+/* 12-bit to Q15 */
+#define ADC_Q15_SHIFT 4
+#endif
+
+/* The 12-bit full scale of the ADC and the DAC */
+#define SAMPLE_MAX_VALUE (2 * ADC_MID_SCALE - 1)
+
+struct tp_signal_stats_acc {
+#ifdef USE_FPU
+	float32_t sum_sq;
+	float32_t sum;
+#else
+	/* Q30 and Q15 sums */
+	int64_t sum_sq;
+	int64_t sum;
+#endif
+	signal_stats_sample_t min;
+	signal_stats_sample_t max;
+	uint32_t clips;
+	uint32_t num_of_samples;
+};
+
+struct tp_signal_stats {
+	struct tp_signal_stats_acc adc;
+	struct tp_signal_stats_acc dac;
+	uint32_t num_of_blocks;
+	uint32_t count;
+	/* odd while the interrupt writes the result */
+	volatile uint32_t seq;
+	struct signal_stats_result result;
+	signal_stats_sample_t buf[DSP_BLOCK_SIZE];
+};
+
+static struct tp_signal_stats m_stats;
+
+static void signal_stats_reset(struct tp_signal_stats_acc * acc)
+{
+	memset(acc, 0, sizeof(*acc));
+#ifdef USE_FPU
+	acc->min = 1.0f;
+	acc->max = -1.0f;
+#else
+	acc->min = INT16_MAX;
+	acc->max = INT16_MIN;
+#endif
+}
+
+/**
+ * @brief Initialize the statistics
+ * @param[in] num_of_blocks The window length in blocks
+ */
+void signal_stats_init(uint32_t num_of_blocks)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.num_of_blocks = num_of_blocks ? num_of_blocks : 1;
+	signal_stats_reset(&m_stats.adc);
+	signal_stats_reset(&m_stats.dac);
+}
+
+/**
+ * @brief Add the samples of one channel to the window
+ */
+static void signal_stats_add(struct tp_signal_stats_acc * acc, const uint16_t * src,
+		size_t len, size_t stride)
+{
+	signal_stats_sample_t * buf = m_stats.buf;
+
+	/* the oversampled blocks are longer than the buffer */
+	while (len) {
+		size_t n = (len > DSP_BLOCK_SIZE) ? DSP_BLOCK_SIZE : len;
+		signal_stats_sample_t rms, min, max, mean;
+		uint32_t index;
+
+		for (size_t i=0; i<n; i++) {
+			uint16_t x = src[i * stride];
+
+			if (x == 0 || x >= SAMPLE_MAX_VALUE)
+				acc->clips++;
+#ifdef USE_FPU
+			buf[i] = (float32_t) ((int32_t) x - ADC_MID_SCALE) * ADC_TO_F32;
+#else
+			buf[i] = (q15_t) (((int32_t) x - ADC_MID_SCALE) * (1 << ADC_Q15_SHIFT));
+#endif
+		}
+#ifdef USE_FPU
+		arm_rms_f32(buf, n, &rms);
+		arm_min_f32(buf, n, &min, &index);
+		arm_max_f32(buf, n, &max, &index);
+		arm_mean_f32(buf, n, &mean);
+		acc->sum_sq += rms * rms * n;
+		acc->sum += mean * n;
+#else
+		arm_rms_q15(buf, n, &rms);
+		arm_min_q15(buf, n, &min, &index);
+		arm_max_q15(buf, n, &max, &index);
+		arm_mean_q15(buf, n, &mean);
+		acc->sum_sq += (int64_t) ((int32_t) rms * rms) * n;
+		acc->sum += (int64_t) mean * n;
+#endif
+		if (min < acc->min) acc->min = min;
+		if (max > acc->max) acc->max = max;
+		acc->num_of_samples += n;
+
+		src += n * stride;
+		len -= n;
+	}
+}
+
+/**
+ * @brief Calculate the result of a channel from the window sums
+ */
+static void signal_stats_finish(struct signal_stats_channel * ch,
+		const struct tp_signal_stats_acc * acc)
+{
+#ifdef USE_FPU
+	ch->rms = sqrtf(acc->sum_sq / acc->num_of_samples);
+	ch->mean = acc->sum / acc->num_of_samples;
+#else
+	q31_t mean_sq = (q31_t) ((acc->sum_sq / acc->num_of_samples) << 1);
+	q31_t rms;
+
+	/* Q30 to Q31 can only overflow for a full-scale square wave */
+	if (mean_sq < 0)
+		mean_sq = INT32_MAX;
+	arm_sqrt_q31(mean_sq, &rms);
+	ch->rms = (q15_t) (rms >> 16);
+	ch->mean = (q15_t) (acc->sum / acc->num_of_samples);
+#endif
+	ch->min = acc->min;
+	ch->max = acc->max;
+	ch->clips = acc->clips;
+}
+
+/**
+ * @brief Add a block to the window. This is called from the interrupt.
+ * @param[in] adc The 12-bit ADC samples
+ * @param[in] adc_len Number of ADC samples
+ * @param[in] dac The 12-bit DAC samples
+ * @param[in] dac_len Number of DAC samples
+ * @param[in] stride The distance of two samples in the buffers, e.g. 2 for
+ * 		the first channel of the stereo buffers
+ */
+void signal_stats_process(const uint16_t * adc, size_t adc_len,
+		const uint16_t * dac, size_t dac_len, size_t stride)
+{
+	signal_stats_add(&m_stats.adc, adc, adc_len, stride);
+	signal_stats_add(&m_stats.dac, dac, dac_len, stride);
+
+	if (++m_stats.count < m_stats.num_of_blocks)
+		return;
+
+	m_stats.seq++;
+	__DMB();
+	signal_stats_finish(&m_stats.result.adc, &m_stats.adc);
+	signal_stats_finish(&m_stats.result.dac, &m_stats.dac);
+	m_stats.result.num_of_blocks = m_stats.count;
+	__DMB();
+	m_stats.seq++;
+
+	signal_stats_reset(&m_stats.adc);
+	signal_stats_reset(&m_stats.dac);
+	m_stats.count = 0;
+}
+
+/**
+ * @brief Get the result of the last complete window. This is called from
+ * 		the main loop and it retries if the interrupt updates the result
+ * 		in the meantime.
+ * @param[out] result The result
+ * @return The number of complete windows. If it's 0, result is empty.
+ */
+uint32_t signal_stats_get(struct signal_stats_result * result)
+{
+	uint32_t seq;
+
+	do {
+		seq = m_stats.seq;
+		__DMB();
+		memcpy(result, &m_stats.result, sizeof(*result));
+		__DMB();
+	} while ((seq & 1) || seq != m_stats.seq);
+	return seq / 2;
+}
+
+/**
+ * @brief Convert a value of the result to 12-bit ADC/DAC steps
+ */
+int32_t signal_stats_to_lsb(signal_stats_sample_t value)
+{
+#ifdef USE_FPU
+	return (int32_t) lroundf(value * ADC_MID_SCALE);
+#else
+	return ((int32_t) value + (1 << (ADC_Q15_SHIFT - 1))) >> ADC_Q15_SHIFT;
+#endif
+}
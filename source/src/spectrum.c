@@ -0,0 +1,191 @@
+/*
+ * spectrum.c
+ *
+ *  Author: Dimitris Tassopoulos
+ */
+#include <string.h>
+#include <math.h>
+#include "arm_math.h"
+#include "spectrum.h"
+#include "filter_chain.h"
+
+#if (SPECTRUM_RING_SIZE & (SPECTRUM_RING_SIZE - 1))
+#error "SPECTRUM_RING_SIZE must be a power of two"
+#endif
+
+#define SPECTRUM_RING_MASK (SPECTRUM_RING_SIZE - 1)
+
+struct tp_spectrum {
+	arm_rfft_fast_instance_f32 rfft;
+	/* Hann window, also scaled so a full-scale sine is 1.0 */
+	float32_t window[SPECTRUM_FFT_SIZE];
+	/* the windowed samples and then the magnitudes */
+	float32_t in[SPECTRUM_FFT_SIZE];
+	float32_t out[SPECTRUM_FFT_SIZE];
+	float32_t avg[SPECTRUM_NUM_OF_BINS];
+	/* the capture ring. Only the interrupt writes the head and only the
+	 * main loop writes the tail, so there's no lock */
+	uint16_t ring[SPECTRUM_RING_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	volatile uint32_t dropped;
+	uint32_t dropped_sent;
+	uint16_t fill;
+	uint16_t averages;
+	uint8_t frame[SPECTRUM_FRAME_SIZE(SPECTRUM_NUM_OF_BINS)];
+	uint16_t frame_len;
+	uint16_t frame_pos;
+	uint32_t fs;
+	spectrum_send_t fp_send;
+};
+
+static struct tp_spectrum m_spectrum;
+
+/**
+ * @brief Initialize the analyzer
+ * @param[in] fs The sample rate of the captured samples
+ * @param[in] fp_send The callback that sends the frames
+ */
+void spectrum_init(uint32_t fs, spectrum_send_t fp_send)
+{
+	/* the window gain is N/2 for a sine and 0.5 for the Hann window */
+	float32_t scale = 4.0f / (SPECTRUM_FFT_SIZE * ADC_MID_SCALE);
+
+	memset(&m_spectrum, 0, sizeof(m_spectrum));
+	arm_rfft_fast_init_f32(&m_spectrum.rfft, SPECTRUM_FFT_SIZE);
+	for (int i=0; i<SPECTRUM_FFT_SIZE; i++)
+		m_spectrum.window[i] = scale * (0.5f - 0.5f * cosf(2.0f * PI * i / SPECTRUM_FFT_SIZE));
+	m_spectrum.fs = fs;
+	m_spectrum.fp_send = fp_send;
+}
+
+/**
+ * @brief Copy samples in the capture ring. This is called from the interrupt.
+ * 		If the ring doesn't have space for all the samples, they are dropped.
+ * @param[in] samples The 12-bit DAC samples
+ * @param[in] len Number of samples
+ * @param[in] stride The distance of two samples in the buffer, e.g. 2 for
+ * 		the first channel of the stereo buffers
+ */
+void spectrum_capture(const uint16_t * samples, size_t len, size_t stride)
+{
+	uint32_t head = m_spectrum.head;
+
+	if (SPECTRUM_RING_SIZE - (head - m_spectrum.tail) < len) {
+		m_spectrum.dropped += len;
+		return;
+	}
+	for (size_t i=0; i<len; i++)
+		m_spectrum.ring[(head + i) & SPECTRUM_RING_MASK] = samples[i * stride];
+	/* the samples must be in the ring before the main loop sees the head */
+	__DMB();
+	m_spectrum.head = head + len;
+}
+
+/**
+ * @brief Run the FFT of a full window and add the magnitudes to the average
+ */
+static void spectrum_fft(void)
+{
+	arm_rfft_fast_f32(&m_spectrum.rfft, m_spectrum.in, m_spectrum.out, 0);
+	/* the imaginary part of the first bin is the Nyquist bin, which isn't sent */
+	m_spectrum.out[1] = 0;
+	arm_cmplx_mag_f32(m_spectrum.out, m_spectrum.in, SPECTRUM_NUM_OF_BINS);
+	/* the DC has no negative frequency */
+	m_spectrum.in[0] *= 0.5f;
+	arm_add_f32(m_spectrum.avg, m_spectrum.in, m_spectrum.avg, SPECTRUM_NUM_OF_BINS);
+	if (m_spectrum.averages < UINT16_MAX)
+		m_spectrum.averages++;
+}
+
+/**
+ * @brief Consume the capture ring, run at most one FFT and send the pending
+ * 		frame bytes. This is called from the main loop.
+ */
+void spectrum_update(void)
+{
+	uint32_t tail = m_spectrum.tail;
+	uint32_t avail = m_spectrum.head - tail;
+	uint32_t n = SPECTRUM_FFT_SIZE - m_spectrum.fill;
+	float32_t * in = &m_spectrum.in[m_spectrum.fill];
+	const float32_t * window = &m_spectrum.window[m_spectrum.fill];
+
+	if (n > avail)
+		n = avail;
+	for (uint32_t i=0; i<n; i++) {
+		int32_t x = (int32_t) m_spectrum.ring[(tail + i) & SPECTRUM_RING_MASK] - ADC_MID_SCALE;
+		in[i] = (float32_t) x * window[i];
+	}
+	/* the samples are read before the interrupt can overwrite them */
+	__DMB();
+	m_spectrum.tail = tail + n;
+
+	m_spectrum.fill += n;
+	if (m_spectrum.fill == SPECTRUM_FFT_SIZE) {
+		spectrum_fft();
+		m_spectrum.fill = 0;
+	}
+
+	if (m_spectrum.frame_pos < m_spectrum.frame_len)
+		m_spectrum.frame_pos += m_spectrum.fp_send(&m_spectrum.frame[m_spectrum.frame_pos],
+				m_spectrum.frame_len - m_spectrum.frame_pos);
+}
+
+static inline uint8_t * spectrum_put_u16(uint8_t * p, uint16_t value)
+{
+	*p++ = value & 0xFF;
+	*p++ = value >> 8;
+	return p;
+}
+
+static inline uint8_t * spectrum_put_u32(uint8_t * p, uint32_t value)
+{
+	p = spectrum_put_u16(p, value & 0xFFFF);
+	return spectrum_put_u16(p, value >> 16);
+}
+
+/**
+ * @brief Encode the averaged bins in a new frame and restart the average.
+ * 		Nothing is done if the previous frame is still sent or if there's
+ * 		no new FFT. This runs in the main loop, e.g. from a timer.
+ * @param[in] data Not used, it's the timer parent object
+ */
+void spectrum_publish(void * data)
+{
+	uint8_t * p = m_spectrum.frame;
+	uint32_t dropped = m_spectrum.dropped;
+	uint32_t dropped_new = dropped - m_spectrum.dropped_sent;
+	float32_t scale;
+	uint8_t checksum = 0;
+
+	if (m_spectrum.frame_pos < m_spectrum.frame_len || !m_spectrum.averages)
+		return;
+
+	*p++ = SPECTRUM_SYNC0;
+	*p++ = SPECTRUM_SYNC1;
+	*p++ = SPECTRUM_FRAME_TYPE;
+	p = spectrum_put_u16(p, SPECTRUM_NUM_OF_BINS);
+	p = spectrum_put_u32(p, m_spectrum.fs);
+	p = spectrum_put_u16(p, m_spectrum.averages);
+	p = spectrum_put_u16(p, (dropped_new > UINT16_MAX) ? UINT16_MAX : dropped_new);
+
+	scale = 1.0f / m_spectrum.averages;
+	for (int k=0; k<SPECTRUM_NUM_OF_BINS; k++) {
+		float32_t db = 20.0f * log10f(m_spectrum.avg[k] * scale + 1e-9f);
+		float32_t level = (db - SPECTRUM_DB_MIN) / SPECTRUM_DB_STEP + 0.5f;
+
+		if (level < 0) level = 0;
+		else if (level > 255) level = 255;
+		*p++ = (uint8_t) level;
+	}
+
+	for (uint8_t * c = &m_spectrum.frame[2]; c < p; c++)
+		checksum ^= *c;
+	*p++ = checksum;
+
+	arm_fill_f32(0, m_spectrum.avg, SPECTRUM_NUM_OF_BINS);
+	m_spectrum.averages = 0;
+	m_spectrum.dropped_sent = dropped;
+	m_spectrum.frame_len = p - m_spectrum.frame;
+	m_spectrum.frame_pos = 0;
+}